@@ -15,9 +15,11 @@ CONFIG   -= app_bundle
 TEMPLATE = app
 
 
-SOURCES += main.cpp
+SOURCES += main.cpp \
+    centralworker.cpp
 
-HEADERS +=
+HEADERS += \
+    centralworker.h
 
 
 unix:!macx: LIBS += -L$$OUT_PWD/../libdcp/ -ldcp
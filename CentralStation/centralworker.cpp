@@ -0,0 +1,186 @@
+/*
+ *  This file is part of the CentralStation Project
+ *  Copyright (C) 15/04/2014 -- centralworker.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "centralworker.h"
+
+#include <QMetaObject>
+#include <QMetaType>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+CentralWorker::CentralWorker(int index, QHostAddress addr, quint16 port,
+                             DCPCentralRegistry *registry,
+                             DCPCentralStorage *storage,
+                             DCPLiveness *liveness) :
+    QObject(),
+    index(index),
+    addr(addr),
+    port(port),
+    registry(registry),
+    storage(storage),
+    liveness(liveness),
+    sock(NULL),
+    central(NULL),
+    clockOffset(0),
+    ackDelay(DCP_ACKDELAY)
+{
+    // Arguments queued between the workers
+    qRegisterMetaType<QHostAddress>("QHostAddress");
+    qRegisterMetaType<DCPPacket*>("DCPPacket*");
+}
+
+CentralWorker::~CentralWorker()
+{
+    delete this->central;
+    delete this->sock;
+}
+
+void CentralWorker::setSiblings(QList<CentralWorker*> siblings)
+{
+    this->siblings = siblings;
+}
+
+/*
+ * Runs in the worker thread: the socket is created there since it can
+ * only be used from the thread which owns it.
+ * */
+void CentralWorker::start()
+{
+    this->sock = CentralWorker::bindReusePort(this->addr, this->port);
+    if(!this->sock)
+        qFatal("Central station worker %d: could not bind socket",
+               this->index);
+
+    this->central = new DCPServerCentral(this->sock, this->registry,
+                                         this->storage, this->liveness);
+    this->central->setClockOffset(this->clockOffset);
+    this->central->setAckDelay(this->ackDelay);
+    this->central->setWorker(this->index);
+    // A single worker pings, the drones are in the shared registry
+    this->central->setPingDrones(this->index == 0);
+    connect(this->central,
+            SIGNAL(unmatchedAck(QHostAddress,quint16,qint16,qint32)),
+            this, SLOT(forwardAck(QHostAddress,quint16,qint16,qint32)));
+    connect(this->central, SIGNAL(packetForOwner(int,DCPPacket*)),
+            this, SLOT(forwardPacket(int,DCPPacket*)));
+}
+
+/*
+ * Only worker 0 sends packets whose ack may arrive elsewhere.
+ * */
+void CentralWorker::forwardAck(QHostAddress addr, quint16 port,
+                               qint16 sessID, qint32 timestamp)
+{
+    if(this->index == 0 || this->siblings.isEmpty())
+        return;
+
+    QMetaObject::invokeMethod(this->siblings.first(), "ackFromSibling",
+                              Qt::QueuedConnection,
+                              Q_ARG(QHostAddress, addr), Q_ARG(quint16, port),
+                              Q_ARG(qint16, sessID),
+                              Q_ARG(qint32, timestamp));
+}
+
+void CentralWorker::ackFromSibling(QHostAddress addr, quint16 port,
+                                   qint16 sessID, qint32 timestamp)
+{
+    if(!this->central)
+        return;
+
+    this->central->acknowledge(addr, port, sessID, timestamp);
+}
+
+/*
+ * The owner sends it, and gives it back to its own pool.
+ * */
+void CentralWorker::forwardPacket(int owner, DCPPacket *packet)
+{
+    if(owner >= this->siblings.size() || owner == this->index)
+    {
+        this->central->sendPacket(packet);
+        return;
+    }
+
+    QMetaObject::invokeMethod(this->siblings.at(owner), "packetFromSibling",
+                              Qt::QueuedConnection,
+                              Q_ARG(DCPPacket*, packet));
+}
+
+void CentralWorker::packetFromSibling(DCPPacket *packet)
+{
+    this->central->sendPacket(packet);
+}
+
+/*
+ * Bind a UDP socket with SO_REUSEPORT and hand it over to Qt: QUdpSocket
+ * has no way of setting the option before binding.
+ * */
+QUdpSocket* CentralWorker::bindReusePort(QHostAddress addr, quint16 port)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int fd, one = 1;
+    QUdpSocket *sock;
+
+    memset(&ss, 0, sizeof(ss));
+    if(addr.protocol() == QAbstractSocket::IPv6Protocol)
+    {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6*)&ss;
+        Q_IPV6ADDR ip6 = addr.toIPv6Address();
+        in6->sin6_family    = AF_INET6;
+        in6->sin6_port      = htons(port);
+        memcpy(&(in6->sin6_addr), &ip6, sizeof(in6->sin6_addr));
+        len = sizeof(*in6);
+    }
+    else
+    {
+        struct sockaddr_in *in = (struct sockaddr_in*)&ss;
+        in->sin_family      = AF_INET;
+        in->sin_port        = htons(port);
+        in->sin_addr.s_addr = htonl(addr.toIPv4Address());
+        len = sizeof(*in);
+    }
+
+    if((fd = ::socket(ss.ss_family, SOCK_DGRAM, 0)) < 0)
+        return NULL;
+
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+#ifdef SO_REUSEPORT
+       setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+#endif
+       ::bind(fd, (struct sockaddr*)&ss, len) < 0)
+    {
+        ::close(fd);
+        return NULL;
+    }
+
+    sock = new QUdpSocket();
+    if(!sock->setSocketDescriptor(fd, QAbstractSocket::BoundState))
+    {
+        ::close(fd);
+        delete sock;
+        return NULL;
+    }
+
+    return sock;
+}
@@ -0,0 +1,94 @@
+/*
+ *  This file is part of the CentralStation Project
+ *  Copyright (C) 15/04/2014 -- centralworker.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef CENTRALWORKER_H
+#define CENTRALWORKER_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QHostAddress>
+#include <QUdpSocket>
+
+#include <dcpservercentral.h>
+#include <dcpcentralregistry.h>
+#include <dcpcentralstorage.h>
+#include <dcpliveness.h>
+
+
+
+/*
+ * Central station I/O worker.
+ * Lives in its own thread with its own socket and DCPServerCentral. All
+ * the workers' sockets are bound to the same address with SO_REUSEPORT,
+ * the kernel spreads the peers between them.
+ * Stations and sessions are shared through the registry, which the
+ * workers write back through a single storage. Traffic from the
+ * stations is recorded by every worker in the shared liveness tracker,
+ * the first worker pings the silent ones.
+ * A station's packets are handed to the worker its traffic arrives at,
+ * which sends them and gets their acks. Worker 0 sends to the stations
+ * not heard from yet: acks which do not match locally are forwarded to it.
+ * */
+class CentralWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    CentralWorker(int index, QHostAddress addr, quint16 port,
+                  DCPCentralRegistry *registry, DCPCentralStorage *storage,
+                  DCPLiveness *liveness);
+    ~CentralWorker();
+
+    // Every worker, by index
+    void setSiblings(QList<CentralWorker*> siblings);
+    // Before start(), see DCPServer::setClockOffset
+    inline void setClockOffset(qint64 msec) { this->clockOffset = msec; }
+    // Before start(), see DCPServer::setAckDelay
+    inline void setAckDelay(int msec) { this->ackDelay = msec; }
+
+public slots:
+    void start();
+    void ackFromSibling(QHostAddress addr, quint16 port, qint16 sessID,
+                        qint32 timestamp);
+    void packetFromSibling(DCPPacket *packet);
+
+private slots:
+    void forwardAck(QHostAddress addr, quint16 port, qint16 sessID,
+                    qint32 timestamp);
+    void forwardPacket(int owner, DCPPacket *packet);
+
+private:
+    static QUdpSocket*  bindReusePort(QHostAddress addr, quint16 port);
+
+    int                     index;
+    QHostAddress            addr;
+    quint16                 port;
+    DCPCentralRegistry      *registry;
+    DCPCentralStorage       *storage;
+    DCPLiveness             *liveness;
+    QUdpSocket              *sock;
+    DCPServerCentral        *central;
+    QList<CentralWorker*>   siblings;
+    qint64                  clockOffset;
+    int                     ackDelay;
+};
+
+#endif // CENTRALWORKER_H
@@ -19,51 +19,180 @@
  * */
 
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
 #include <QHostAddress>
-#include <QUdpSocket>
 #include <QThread>
+#include <QList>
 #include <QtSql/QSqlDatabase>
-#include <QSqlQuery>
-#include <QSqlError>
 #include <QDebug>
 
 #include <dcp.h>
 #include <dcpservercentral.h>
+#include <dcpcentralregistry.h>
+#include <dcpcentralstorage.h>
+#include <dcpcentraldatabase.h>
+#include <dcpcentralmemorystorage.h>
+#include <dcpcentralschema.h>
+#include <dcpliveness.h>
+
+#include "centralworker.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
-    QString strAddr = a.arguments().at(1);
-    QString strPort = a.arguments().at(2);
 
-    QUdpSocket *sock = new QUdpSocket();
-    sock->bind(QHostAddress(strAddr), strPort.toUShort());
+    QCommandLineParser parser;
+    parser.setApplicationDescription("DCP central station");
+    parser.addHelpOption();
+    parser.addPositionalArgument("address", "Address to listen on.");
+    parser.addPositionalArgument("port", "UDP port to listen on.");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+            "Number of I/O worker threads, sharing the port with "
+            "SO_REUSEPORT.", "threads", "1");
+    parser.addOption(threadsOption);
+    QCommandLineOption retentionOption(QStringList() << "log-retention",
+            "Days of logs kept in the database, 0 keeps them all.", "days",
+            QString::number(DCPCENTRALSCHEMA_LOGRETENTION));
+    parser.addOption(retentionOption);
+    QCommandLineOption pingIntervalOption(QStringList() << "ping-interval",
+            "Milliseconds between two pings of a silent station.", "msec",
+            QString::number(DCPLIVENESS_INTERVAL));
+    parser.addOption(pingIntervalOption);
+    QCommandLineOption phiSuspectOption(QStringList() << "phi-suspect",
+            "Suspicion level from which a silent station is probed.", "phi",
+            QString::number(DCPFAILUREDETECTOR_PHISUSPECT));
+    parser.addOption(phiSuspectOption);
+    QCommandLineOption phiDeadOption(QStringList() << "phi-dead",
+            "Suspicion level from which a silent station is dead.", "phi",
+            QString::number(DCPFAILUREDETECTOR_PHIDEAD));
+    parser.addOption(phiDeadOption);
+    QCommandLineOption storageOption(QStringList() << "storage",
+            "Where stations, sessions and logs are kept: postgres, sqlite "
+            "or memory.", "type", "postgres");
+    parser.addOption(storageOption);
+    QCommandLineOption dbFileOption(QStringList() << "db-file",
+            "SQLite database file, created if needed.", "path",
+            "drones.sqlite");
+    parser.addOption(dbFileOption);
+    QCommandLineOption dbHostOption(QStringList() << "db-host",
+            "PostgreSQL host.", "host", "127.0.0.1");
+    parser.addOption(dbHostOption);
+    QCommandLineOption dbPortOption(QStringList() << "db-port",
+            "PostgreSQL port.", "port", "5432");
+    parser.addOption(dbPortOption);
+    QCommandLineOption dbNameOption(QStringList() << "db-name",
+            "PostgreSQL database.", "name", "drones");
+    parser.addOption(dbNameOption);
+    QCommandLineOption dbUserOption(QStringList() << "db-user",
+            "PostgreSQL user.", "user", "dronedbmanager");
+    parser.addOption(dbUserOption);
+    QCommandLineOption dbPasswordOption(QStringList() << "db-password",
+            "PostgreSQL password, DCP_DBPASSWORD by default.", "password");
+    parser.addOption(dbPasswordOption);
+    QCommandLineOption clockOffsetOption(QStringList() << "clock-offset",
+            "Milliseconds the DCP timestamps start ahead, to test their "
+            "wraparound.", "msec", "0");
+    parser.addOption(clockOffsetOption);
+    QCommandLineOption ackDelayOption(QStringList() << "ack-delay",
+            "Milliseconds v2 acks wait to be bundled, 0 to send each at "
+            "once.", "msec", QString::number(DCP_ACKDELAY));
+    parser.addOption(ackDelayOption);
+    parser.process(a);
 
-    QSqlDatabase db = QSqlDatabase::addDatabase("QPSQL");
-    db.setHostName("127.0.0.1");
-    db.setPort(5432);
-    db.setDatabaseName("drones");
-    db.setUserName("dronedbmanager");
-    db.setPassword("Ch3v41");
+    if(parser.positionalArguments().size() < 2)
+        parser.showHelp(1);
+    QString strAddr = parser.positionalArguments().at(0);
+    QString strPort = parser.positionalArguments().at(1);
+    int nbThreads   = qMax(1, parser.value(threadsOption).toInt());
+    int retention   = qMax(0, parser.value(retentionOption).toInt());
+    int pingInterval= qMax(DCPLIVENESS_NBSLOTS,
+                           parser.value(pingIntervalOption).toInt());
+    double phiSuspect   = qMax(0.1, parser.value(phiSuspectOption).toDouble());
+    double phiDead      = qMax(phiSuspect,
+                               parser.value(phiDeadOption).toDouble());
+    qint64 clockOffset  = parser.value(clockOffsetOption).toLongLong();
+    int ackDelay        = qMax(0, parser.value(ackDelayOption).toInt());
 
-    if(db.open())
-    {
-        DCPServerCentral *central = new DCPServerCentral(sock, db);
+    DCPCentralRegistry::remote_t central;
+    central.id      = DCP_IDCENTRAL;
+    central.type    = "central";
+    central.addr    = QHostAddress(strAddr);
+    central.port    = strPort.toUShort();
+    central.info    = "Central station in charge of this NET";
+    central.protocol = DCP_VERSION;
 
-        QSqlQuery query(db);
-        query.prepare("INSERT INTO " DCP_DBSTATIONS " (type, ip, port, info)"
-                      " VALUES (?, ?, ?, ?)");
-        query.bindValue(0, "central");
-        query.bindValue(1, strAddr);
-        query.bindValue(2, strPort.toInt());
-        query.bindValue(3, "Central station in charge of this NET");
-        if(!query.exec())
+    DCPCentralStorage *storage;
+    QString storageType = parser.value(storageOption);
+    if(storageType == "memory")
+    {
+        storage = new DCPCentralMemoryStorage();
+    }
+    else if(storageType == "sqlite" || storageType == "postgres")
+    {
+        QSqlDatabase db;
+        if(storageType == "sqlite")
+        {
+            db = QSqlDatabase::addDatabase("QSQLITE");
+            db.setDatabaseName(parser.value(dbFileOption));
+        }
+        else
         {
-            qWarning() << query.lastError().driverText() << endl;
-            qWarning() << query.lastError().databaseText() << endl;
-            qWarning() << query.lastQuery();
-            qFatal("Central station: BYE cruel world !");
+            // Not shown by --help
+            QString dbPassword = parser.isSet(dbPasswordOption) ?
+                        parser.value(dbPasswordOption) :
+                        QString::fromLocal8Bit(qgetenv("DCP_DBPASSWORD"));
+            if(dbPassword.isEmpty())
+                qFatal("Central station: no PostgreSQL password, give"
+                       " --db-password or set DCP_DBPASSWORD");
+
+            db = QSqlDatabase::addDatabase("QPSQL");
+            db.setHostName(parser.value(dbHostOption));
+            db.setPort(parser.value(dbPortOption).toInt());
+            db.setDatabaseName(parser.value(dbNameOption));
+            db.setUserName(parser.value(dbUserOption));
+            db.setPassword(dbPassword);
         }
+        DCPCentralDatabase *database = new DCPCentralDatabase(db,
+                                                    "central-database");
+        database->setLogRetention(retention);
+        storage = database;
+    }
+    else
+    {
+        qFatal("Central station: unknown storage %s",
+               qPrintable(storageType));
+    }
+
+    if(!storage->init(central))
+        qFatal("Central station: could not initialise the storage");
+
+    // Stations and sessions are served from memory from now on, and
+    // written back by the storage
+    DCPCentralRegistry *registry = new DCPCentralRegistry();
+    if(!storage->load(registry))
+        qFatal("Central station: could not load the registry");
+    storage->start();
+    DCPLiveness *liveness = new DCPLiveness(pingInterval, phiSuspect,
+                                            phiDead);
+
+    QList<CentralWorker*> workers;
+    for(int i=0 ; i<nbThreads ; ++i)
+    {
+        QThread *thread = new QThread();
+        CentralWorker *worker = new CentralWorker(i, QHostAddress(strAddr),
+                                                  strPort.toUShort(),
+                                                  registry, storage,
+                                                  liveness);
+        worker->setClockOffset(clockOffset);
+        worker->setAckDelay(ackDelay);
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(started()), worker, SLOT(start()));
+        workers.append(worker);
+    }
+    foreach (CentralWorker *worker, workers) {
+        worker->setSiblings(workers);
+        worker->thread()->start();
     }
 
     return a.exec();
@@ -39,7 +39,7 @@ public:
     QString         dbUserName;
     QString         dbUserPassword;
 
-    qint8           droneId;
+    qint16          droneId;
     QHostAddress    droneHost;
     quint16         dronePort;
     QString         droneInfo;
@@ -1,7 +1,7 @@
 ﻿CREATE SEQUENCE stations_id_seq
 	INCREMENT BY 1
 	MINVALUE 0
-	MAXVALUE 15
+	MAXVALUE 32767
 	START WITH 0
 	NO CYCLE;
 
@@ -17,13 +17,14 @@ CREATE TABLE stations (
 	ip		inet					NOT NULL,
 	port	integer				CHECK (port>0) CHECK (port<65536),
 	date	timestamp			with time zone NOT NULL default current_timestamp,
-	info	varchar(1024)	
+	info	varchar(1024),
+	protocol	smallint	NOT NULL DEFAULT 1	-- DCP version spoken
 );
 
 
 
 CREATE TABLE videos (
-	id			smallint 			REFERENCES stations (id) PRIMARY KEY,
+	id			smallint 			REFERENCES stations (id) ON DELETE CASCADE PRIMARY KEY,
 	videos	varchar(4096)	NOT NULL
 );
 
@@ -32,7 +33,7 @@ CREATE TABLE videos (
 CREATE SEQUENCE sessions_id_seq 
 	INCREMENT BY 1
 	MINVALUE 1
-	MAXVALUE 15
+	MAXVALUE 32767
 	START WITH 1
 	NO CYCLE;
 
@@ -43,6 +44,9 @@ CREATE TABLE sessions (
 	date			timestamp	with time zone NOT NULL default current_timestamp
 );
 
+CREATE INDEX sessions_station1_idx ON sessions (station1, station2, id);
+CREATE INDEX sessions_station2_idx ON sessions (station2, station1, id);
+
 
 
 CREATE TYPE log_level AS ENUM (
@@ -52,14 +56,30 @@ CREATE TYPE log_level AS ENUM (
 	'fatal'
 );
 
+-- Partitioned by day, the central station creates the daily partitions
+-- and drops the ones past the retention
 CREATE TABLE logs (
-	id				smallint	REFERENCES stations (id),
+	seq				bigserial,
+	id				smallint	REFERENCES stations (id) ON DELETE SET NULL,
 	level			log_level	NOT NULL,
 	date			timestamp	with time zone NOT NULL default current_timestamp,
 	msg				varchar(2048),
-	PRIMARY KEY (id, date)
+	PRIMARY KEY (date, seq)
+) PARTITION BY RANGE (date);
+
+CREATE TABLE logs_default PARTITION OF logs DEFAULT;
+CREATE INDEX logs_id_date_idx ON logs (id, date);
+
+
+
+-- Migrations applied by the central station at startup
+CREATE TABLE schema_version (
+	version		integer		PRIMARY KEY,
+	date			timestamp	with time zone NOT NULL default current_timestamp
 );
 
+INSERT INTO schema_version (version) VALUES (4);
+
 
 
 GRANT SELECT ON ALL TABLES IN SCHEMA public TO dronedbreader;
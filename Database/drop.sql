@@ -1,4 +1,4 @@
-DROP TABLE IF EXISTS stations, sessions, logs, videos CASCADE;
+DROP TABLE IF EXISTS stations, sessions, logs, videos, schema_version CASCADE;
 DROP SEQUENCE IF EXISTS stations_id_seq;
 DROP SEQUENCE IF EXISTS sessions_id_seq;
 DROP TYPE IF EXISTS station_type;
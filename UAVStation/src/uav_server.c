@@ -55,6 +55,7 @@
 /* Defines */
 #define PDATAMAX    (256)   ///< Max packet data len
 #define MAX_RETRIES (5)     ///< Max numbers of retries before aborting
+#define NBPEERS     (4)     ///< Peers whose RTT is kept
 
 #define UNUSED(x)  x __attribute__((unused))    ///< Get rid of warnings on unused variables (temporary)
 
@@ -72,12 +73,35 @@
 struct dcp_packet_s {
     struct sockaddr_storage dstaddr;        ///< Host from which the packet has been received.
     socklen_t               dstaddrlen;     ///< Length of the dstaddr field.
+    uint8_t                 version;        ///< DCP version of the packet.
     uint8_t                 cmd;            ///< DCP command ID.
-    uint8_t                 sessid;         ///< DCP packet session ID.
+    uint16_t                sessid;         ///< DCP packet session ID.
     uint32_t                timestamp;      ///< DCP packet timestmap.
     char                    data[PDATAMAX]; ///< DCP packet payload.
     int                     datalen;        ///< DCP packet payload length.
     struct dcp_packet_s*    next;           ///< For ackqueue, next packet in the queue.
+    uint64_t                sent_at;        ///< For ackqueue, clock of the first send (msec).
+    uint64_t                resend_at;      ///< For ackqueue, clock of the next resend (msec).
+    int                     nbresend;       ///< For ackqueue, times the packet was resent.
+};
+
+
+
+/*!
+ *  \brief  Round trip time of a peer.
+ *
+ *  Gives the retransmission timeout of the packets sent to the peer, see
+ *  DCP_TIMEOUT. srtt and rttvar are kept in 1/8 and 1/4 msec, as in
+ *  libdcp's DCPRtt.
+ */
+struct dcp_rtt_s {
+    struct sockaddr_storage addr;           ///< Peer.
+    socklen_t               addrlen;        ///< Length of addr, 0 for a free slot.
+    int                     srtt;           ///< Smoothed RTT (msec << 3).
+    int                     rttvar;         ///< RTT variation (msec << 2).
+    int                     rto;            ///< Retransmission timeout before backoff (msec).
+    int                     backoff;        ///< The timeouts are doubled this many times.
+    int                     nbsamples;      ///< RTTs measured.
 };
 
 
@@ -120,12 +144,17 @@ struct uavsrv_s {
     uint64_t                start_time;     ///< UAV start time (used for timestamps).
     struct uavsrv_params_s  params;         ///< User given configuration structure.
     int                     sock;           ///< Server socket.
-    dcp_handler_f           handlers[16];   ///< DCP packets handlers.
+    dcp_handler_f           handlers[DCP_NBCOMMANDS];   ///< DCP packets handlers.
     struct dcp_packet_s*    ackqueue;       ///< List of sent packet, waiting for ack.
     struct dcp_packet_s**   ackqueue_tail;  ///< Pointer to next packet pointer; used to insert new packet at the tail of the queue.
     int                     myid;           ///< UAV ID.
     int                     central_sessid; ///< SessID to speak with central station.
     int                     command_sessid; ///< SessID to speak with command station.
+    int                     central_version;///< DCP version spoken by the central station.
+    int                     last_ailerons;  ///< Timestamp of the last ailerons command, -1 for none in this session.
+    int                     last_throttle;  ///< Timestamp of the last throttle command, -1 for none in this session.
+    struct dcp_rtt_s        rtts[NBPEERS];  ///< RTT of the peers packets are sent to.
+    int                     rtt_next;       ///< Slot of rtts to reuse when they are all taken.
 };
 
 
@@ -145,7 +174,12 @@ static struct uavsrv_s  uavsrv = {
     NULL,
     DCP_IDNULL,
     DCP_IDNULL,
-    DCP_IDNULL
+    DCP_IDNULL,
+    DCP_VERSION1,
+    -1,
+    -1,
+    {},
+    0
 };
 
 
@@ -158,6 +192,11 @@ static struct uavsrv_s  uavsrv = {
 int uavsrv_err=UAVSRV_ERR_NOERR;
 
 
+uint64_t uavsrv_clock_monotonic();
+
+uint64_t (*uavsrv_clock)() = uavsrv_clock_monotonic;
+
+
 /*!
  *  \brief  Table of error strings. Internal use only.
  *
@@ -196,9 +235,18 @@ int                     ackqueue_init               ();
 int                     ackqueue_add                (struct dcp_packet_s*);
 int                     ackqueue_delete             (struct dcp_packet_s*);
 struct dcp_packet_s*    ackqueue_findbytimestamp    (uint32_t);
+int                     ackqueue_acked              (struct dcp_packet_s*);
+int                     ackqueue_resend             ();
+int                     ackqueue_nextresend         ();
+
+struct dcp_rtt_s*       rtt_find        (struct sockaddr_storage*, socklen_t);
+void                    rtt_sample      (struct dcp_rtt_s*, int);
+void                    rtt_timedout    (struct dcp_rtt_s*, int);
+int                     rtt_timeout     (struct dcp_rtt_s*, int);
 
 int handler_null                (struct dcp_packet_s*);
 int handler_ack                 (struct dcp_packet_s*);
+int handler_ackbundle           (struct dcp_packet_s*);
 int handler_isalive             (struct dcp_packet_s*);
 int handler_setsessid           (struct dcp_packet_s*);
 int handler_ailerons            (struct dcp_packet_s*);
@@ -255,13 +303,24 @@ int ackqueue_init()
 /*!
  *  \brief  Add new packet to ackqueue.
  *  
- *  \param  packet  Packet to add to ackqueue.
+ *  Latest commands (see DCP_DELIVERY) are not acked: they are not kept,
+ *  the packet is freed.
+ *
+ *  \param  packet  Packet to add to ackqueue, once sent.
  *  \return -1 is returned in case of failure. On Success 0 is
  *          returned.
  */
 int ackqueue_add(struct dcp_packet_s* packet)
 {
-    packet->next=NULL;
+    if(DCP_DELIVERY(packet->cmd) == DCP_DELIVERYLATEST) {
+        dcp_packetfree(packet);
+        return 0;
+    }
+
+    packet->next        = NULL;
+    packet->sent_at     = uavsrv_clock();
+    packet->nbresend    = 0;
+    packet->resend_at   = packet->sent_at + rtt_timeout(rtt_find(&(packet->dstaddr), packet->dstaddrlen), 0);
     *(uavsrv.ackqueue_tail) = packet; 
     uavsrv.ackqueue_tail = &(packet->next);
     return 0;
@@ -309,6 +368,234 @@ struct dcp_packet_s* ackqueue_findbytimestamp(uint32_t timestamp)
     return NULL;
 }
 
+
+/*!
+ *  \brief  Remove an acked packet from the ackqueue and free it.
+ *
+ *  The RTT of its peer is measured, unless the packet was resent: the ack
+ *  may be that of any copy (Karn's rule).
+ *  
+ *  \param  packet  Packet of the ackqueue which got acked.
+ *  \return -1 is returned in case of failure. On Success 0 is
+ *          returned.
+ */
+int ackqueue_acked(struct dcp_packet_s* packet)
+{
+    if(packet->nbresend == 0)
+        rtt_sample(rtt_find(&(packet->dstaddr), packet->dstaddrlen), (int)(uavsrv_clock() - packet->sent_at));
+
+    if(ackqueue_delete(packet) < 0)
+        return -1;
+    dcp_packetfree(packet);
+    return 0;
+}
+
+
+/*!
+ *  \brief  Resend the packets of the ackqueue whose timeout expired.
+ *
+ *  Each resend doubles the timeout of the packet, see DCP_TIMEOUT. Packets
+ *  resent DCP_MAXRESEND times are dropped.
+ *  
+ *  \return Number of packets resent or dropped.
+ */
+int ackqueue_resend()
+{
+    struct dcp_packet_s *p, *next;
+    struct dcp_rtt_s *rtt;
+    uint64_t now = uavsrv_clock();
+    int nb = 0;
+
+    for(p=uavsrv.ackqueue ; p!=NULL ; p=next) {
+        next = p->next;
+        if(now < p->resend_at)
+            continue;
+        nb++;
+        if(p->nbresend >= DCP_MAXRESEND) {
+            syslog(LOG_INFO, "Max resends done (Aborting resends): timestamp=%u", p->timestamp);
+            ackqueue_delete(p);
+            dcp_packetfree(p);
+            continue;
+        }
+        rtt = rtt_find(&(p->dstaddr), p->dstaddrlen);
+        p->nbresend++;
+        rtt_timedout(rtt, p->nbresend);
+        p->resend_at = now + rtt_timeout(rtt, p->nbresend);
+        if(dcp_send(p) < 0)
+            syslog(LOG_WARNING, "RE-send failure: timestamp=%u", p->timestamp);
+    }
+    return nb;
+}
+
+
+/*!
+ *  \brief  Time until the next resend.
+ *  
+ *  \return Msec until the next packet of the ackqueue has to be resent, 0 if
+ *          it is late, -1 if the ackqueue is empty.
+ */
+int ackqueue_nextresend()
+{
+    struct dcp_packet_s *p;
+    uint64_t now = uavsrv_clock();
+    int64_t next = -1;
+
+    for(p=uavsrv.ackqueue ; p!=NULL ; p=p->next) {
+        if(p->resend_at <= now)
+            return 0;
+        if(next < 0 || (int64_t)(p->resend_at - now) < next)
+            next = p->resend_at - now;
+    }
+    return (int)next;
+}
+
+//-----------------------------------------------------------------------------
+//  PEERS ROUND TRIP TIME
+//-----------------------------------------------------------------------------
+/*!
+ *  \brief  Compare the address and port of two peers.
+ *  
+ *  \return 1 if they are the same peer, 0 otherwise.
+ */
+static int sockaddr_equal(const struct sockaddr_storage* a, const struct sockaddr_storage* b)
+{
+    const struct sockaddr_in *a4 = (const struct sockaddr_in*)a, *b4 = (const struct sockaddr_in*)b;
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6*)a, *b6 = (const struct sockaddr_in6*)b;
+
+    if(a->ss_family != b->ss_family)
+        return 0;
+    if(a->ss_family == AF_INET)
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    if(a->ss_family == AF_INET6)
+        return a6->sin6_port == b6->sin6_port &&
+               memcmp(&(a6->sin6_addr), &(b6->sin6_addr), sizeof(a6->sin6_addr)) == 0;
+    return 0;
+}
+
+
+/*!
+ *  \brief  RTT of a peer.
+ *  
+ *  A peer not known yet takes a free slot, or the oldest one taken when
+ *  there are none, and starts with the timeout DCP_TIMEOUT.
+ *
+ *  \param  addr    Peer address.
+ *  \param  addrlen Length of addr.
+ *  \return A pointer to the RTT of the peer, never NULL.
+ */
+struct dcp_rtt_s* rtt_find(struct sockaddr_storage* addr, socklen_t addrlen)
+{
+    struct dcp_rtt_s *rtt;
+    int i;
+
+    for(i=0 ; i<NBPEERS ; ++i) {
+        if(uavsrv.rtts[i].addrlen > 0 && sockaddr_equal(&(uavsrv.rtts[i].addr), addr))
+            return &(uavsrv.rtts[i]);
+    }
+    for(i=0 ; i<NBPEERS && uavsrv.rtts[i].addrlen > 0 ; ++i)
+        ;
+    if(i == NBPEERS) {
+        i = uavsrv.rtt_next;
+        uavsrv.rtt_next = (uavsrv.rtt_next + 1) % NBPEERS;
+    }
+
+    rtt = &(uavsrv.rtts[i]);
+    memset(rtt, 0, sizeof(struct dcp_rtt_s));
+    memcpy(&(rtt->addr), addr, addrlen);
+    rtt->addrlen    = addrlen;
+    rtt->rto        = DCP_TIMEOUT;
+    return rtt;
+}
+
+
+int uavsrv_getrtt(const struct sockaddr_storage* addr, int* srtt, int* rttvar, int* rto)
+{
+    int i;
+
+    for(i=0 ; i<NBPEERS ; ++i) {
+        if(uavsrv.rtts[i].addrlen > 0 && sockaddr_equal(&(uavsrv.rtts[i].addr), addr)) {
+            *srtt   = uavsrv.rtts[i].srtt >> 3;
+            *rttvar = uavsrv.rtts[i].rttvar >> 2;
+            *rto    = rtt_timeout(&(uavsrv.rtts[i]), 0);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*!
+ *  \brief  Measure the RTT of a peer (Jacobson/Karels).
+ *  
+ *  SRTT += (R-SRTT)/8, RTTVAR += (|R-SRTT|-RTTVAR)/4 and
+ *  RTO = SRTT + 4*RTTVAR, within [DCP_RTOMIN, DCP_RTOMAX].
+ *
+ *  \param  rtt     RTT of the peer.
+ *  \param  msec    Time the packet took to be acked.
+ *  \return Void.
+ */
+void rtt_sample(struct dcp_rtt_s* rtt, int msec)
+{
+    int delta;
+
+    if(msec < 0)
+        msec = 0;
+
+    if(rtt->nbsamples == 0) {
+        rtt->srtt   = msec << 3;
+        rtt->rttvar = msec << 1;
+    }
+    else {
+        delta = msec - (rtt->srtt >> 3);
+        rtt->srtt += delta;
+        if(delta < 0)
+            delta = -delta;
+        rtt->rttvar += delta - (rtt->rttvar >> 2);
+    }
+    rtt->nbsamples++;
+    rtt->backoff = 0;
+
+    rtt->rto = (rtt->srtt >> 3) + rtt->rttvar;
+    if(rtt->rto < DCP_RTOMIN)
+        rtt->rto = DCP_RTOMIN;
+    if(rtt->rto > DCP_RTOMAX)
+        rtt->rto = DCP_RTOMAX;
+}
+
+
+/*!
+ *  \brief  Back the timeout of a peer off.
+ *
+ *  A packet was resent for the nbresend-th time: the next packets wait as
+ *  long, until an RTT is measured again.
+ *  
+ *  \param  rtt         RTT of the peer.
+ *  \param  nbresend    Times the packet was resent.
+ *  \return Void.
+ */
+void rtt_timedout(struct dcp_rtt_s* rtt, int nbresend)
+{
+    if(nbresend > rtt->backoff)
+        rtt->backoff = (nbresend < DCP_MAXRESEND) ? nbresend : DCP_MAXRESEND;
+}
+
+
+/*!
+ *  \brief  Retransmission timeout of a packet.
+ *  
+ *  \param  rtt         RTT of the peer the packet is sent to.
+ *  \param  nbresend    Times the packet was already resent.
+ *  \return Msec to wait for the ack before resending.
+ */
+int rtt_timeout(struct dcp_rtt_s* rtt, int nbresend)
+{
+    int shift = (nbresend > rtt->backoff) ? nbresend : rtt->backoff;
+
+    if(shift > DCP_MAXRESEND)
+        shift = DCP_MAXRESEND;
+    return ((rtt->rto << shift) < DCP_RTOMAX) ? (rtt->rto << shift) : DCP_RTOMAX;
+}
+
 //-----------------------------------------------------------------------------
 //  CALLBACKS
 //-----------------------------------------------------------------------------
@@ -346,8 +633,45 @@ int handler_ack(struct dcp_packet_s* packet)
         syslog(LOG_NOTICE, "Got ack but no corresponding packet");
         return 0;
     }
-    ackqueue_delete(p);
-    dcp_packetfree(p);
+    ackqueue_acked(p);
+    return 0;
+}
+
+
+
+/*!
+ *  \brief  Handle bundled Acks.
+ *
+ *  The header timestamp and the data[0] following ones are acked, then
+ *  bit i of the bitmap in data[1..] acks the timestamp data[0]+1+i after
+ *  it (see DCP_ACKDELAY). Each acked packet is removed from the ack queue.
+ *  
+ *  \param  packet  Ack bundle packet.
+ *  \return -1 is returned in case of failure and uavsrv_err is set
+ *          with the corresponding error code. On Success 0 is
+ *          returned.
+ */
+int handler_ackbundle(struct dcp_packet_s* packet)
+{
+    struct dcp_packet_s* p;
+    int offset, run, nbbits;
+
+    if(packet->datalen < 1 || packet->datalen > 1 + DCP_ACKBUNDLEMAX) {
+        uavsrv_err = UAVSRV_ERR_BADDATALEN;
+        syslog(LOG_ERR, "ackBundle: %s (datalen=%d)", uavsrv_errstr(), packet->datalen);
+        return -1;
+    }
+
+    run     = (uint8_t)packet->data[0];
+    nbbits  = (packet->datalen - 1) * 8;
+    for(offset=0 ; offset<=run+nbbits ; ++offset) {
+        if(offset > run && !(packet->data[1 + (offset-run-1)/8] & (1 << ((offset-run-1)%8))))
+            continue;
+        p = ackqueue_findbytimestamp(DCP_TIMESTAMP(packet->timestamp + offset));
+        if(p==NULL)
+            continue;
+        ackqueue_acked(p);
+    }
     return 0;
 }
 
@@ -391,17 +715,24 @@ int handler_hellofromcentral(struct dcp_packet_s* packet)
        uavsrv_err = UAVSRV_ERR_NOACKPACKET;
        return -1;
     }
-    ackqueue_delete(ack_p);
-    dcp_packetfree(ack_p);
+    ackqueue_acked(ack_p);
     
-    if(packet->datalen < 1) {
+    if(packet->datalen < ((packet->version >= DCP_VERSION2) ? 4 : 1)) {
         uavsrv_err = UAVSRV_ERR_BADDATALEN;
         syslog(LOG_ERR, "helloFromCentral: %s (datalen=%d)", uavsrv_errstr(), packet->datalen);
         return -1;
     }
-    uavsrv.myid             = (char)((packet->data[0]   ) & 0x0F);
-    uavsrv.central_sessid   = (char)((packet->data[0]>>4) & 0x0F);
-    syslog(LOG_INFO, "Registered: myid=%d, central_sessid=%d", uavsrv.myid, uavsrv.central_sessid);
+    if(packet->version >= DCP_VERSION2) {
+        uavsrv.central_sessid   = ((uint8_t)packet->data[0]<<8) | (uint8_t)packet->data[1];
+        uavsrv.myid             = ((uint8_t)packet->data[2]<<8) | (uint8_t)packet->data[3];
+    }
+    else {
+        uavsrv.myid             = (char)((packet->data[0]   ) & 0x0F);
+        uavsrv.central_sessid   = (char)((packet->data[0]>>4) & 0x0F);
+    }
+    /* The central station answers in the version it speaks */
+    uavsrv.central_version = packet->version;
+    syslog(LOG_INFO, "Registered: myid=%d, central_sessid=%d, DCP v%d", uavsrv.myid, uavsrv.central_sessid, uavsrv.central_version);
 
     uavsrv_setstate(REGISTERED);
 
@@ -433,12 +764,18 @@ int handler_setsessid(struct dcp_packet_s* packet)
         return -1;
     }
 
-    if(packet->datalen < 1) {
+    if(packet->datalen < ((packet->version >= DCP_VERSION2) ? 2 : 1)) {
         uavsrv_err = UAVSRV_ERR_BADDATALEN;
         syslog(LOG_ERR, "setSessId: %s (datalen=%d)", uavsrv_errstr(), packet->datalen);
         return -1;
     }
-    uavsrv.command_sessid = packet->data[0];
+    if(packet->version >= DCP_VERSION2)
+        uavsrv.command_sessid = ((uint8_t)packet->data[0]<<8) | (uint8_t)packet->data[1];
+    else
+        uavsrv.command_sessid = packet->data[0];
+    /* A new command station: its clock is not the previous one's */
+    uavsrv.last_ailerons = -1;
+    uavsrv.last_throttle = -1;
     syslog(LOG_INFO, "Connected: command_sessid=%d", uavsrv.command_sessid);
     if(uavsrv_save() < 0)
         syslog(LOG_ERR, "uavsrv_save(): %s\n\terrno: %m", uavsrv_errstr());
@@ -461,7 +798,6 @@ int handler_setsessid(struct dcp_packet_s* packet)
 int handler_ailerons(struct dcp_packet_s* packet) 
 {
     int UNUSED(aileronR), UNUSED(aileronL), UNUSED(rudder);
-    static uint32_t last_timestamp=0;
 
     if(packet->sessid != uavsrv.command_sessid) {
         uavsrv_err = UAVSRV_ERR_BADSESSID;
@@ -469,12 +805,12 @@ int handler_ailerons(struct dcp_packet_s* packet)
         return -1;
     }
 
-    if(packet->timestamp < last_timestamp) {
+    if(uavsrv.last_ailerons >= 0 && DCP_TIMESTAMPLT(packet->timestamp, (uint32_t)uavsrv.last_ailerons)) {
        uavsrv_err = UAVSRV_ERR_BADTIMESTAMP;
        syslog(LOG_INFO, "Ailreons: %s", uavsrv_errstr());
        return -1;
     }
-    last_timestamp = packet->timestamp;
+    uavsrv.last_ailerons = packet->timestamp;
 
     if(packet->datalen < 3) {
         uavsrv_err = UAVSRV_ERR_BADDATALEN;
@@ -503,7 +839,6 @@ int handler_ailerons(struct dcp_packet_s* packet)
 int handler_throttle(struct dcp_packet_s* packet) 
 {
     int UNUSED(motorId), UNUSED(throttle);
-    static uint32_t last_timestamp=0;
 
     if(packet->sessid != uavsrv.command_sessid) {
         uavsrv_err = UAVSRV_ERR_BADSESSID;
@@ -511,12 +846,12 @@ int handler_throttle(struct dcp_packet_s* packet)
         return -1;
     }
 
-    if(packet->timestamp < last_timestamp) {
+    if(uavsrv.last_throttle >= 0 && DCP_TIMESTAMPLT(packet->timestamp, (uint32_t)uavsrv.last_throttle)) {
        uavsrv_err = UAVSRV_ERR_BADTIMESTAMP;
        syslog(LOG_INFO, "Throttle: %s", uavsrv_errstr());
        return -1;
     }
-    last_timestamp = packet->timestamp;
+    uavsrv.last_throttle = packet->timestamp;
 
     if(packet->datalen < 2) {
         uavsrv_err = UAVSRV_ERR_BADDATALEN;
@@ -551,6 +886,8 @@ int handler_disconnect(struct dcp_packet_s* packet)
         return -1;
     }
     uavsrv.command_sessid = DCP_IDNULL;
+    uavsrv.last_ailerons = -1;
+    uavsrv.last_throttle = -1;
     syslog(LOG_INFO, "Disconnected");
     if(uavsrv_save() < 0)
         syslog(LOG_ERR, "uavsrv_save(): %s\n\terrno: %m", uavsrv_errstr());
@@ -581,6 +918,7 @@ struct dcp_packet_s* dcp_packetnew()
     memset(&(packet->dstaddrlen), 0, sizeof(struct sockaddr_storage));
     packet->dstaddrlen = sizeof(struct sockaddr_storage);
     packet->datalen     = 0;
+    packet->version     = DCP_VERSION1;
     packet->cmd         = 0;
     packet->next        = NULL;
 
@@ -606,7 +944,8 @@ void dcp_packetfree(struct dcp_packet_s* packet)
 /*!
  *  \brief  Send given DCP packet.
  *  
- *  Translate the given packet into a buffer and send it.
+ *  Translate the given packet into a buffer and send it, with the
+ *  header of its DCP version.
  *
  *  \param  packet  Packet to send
  *  \return -1 is returned in case of failure and uavsrv_err is set
@@ -615,16 +954,28 @@ void dcp_packetfree(struct dcp_packet_s* packet)
  */
 int dcp_send(struct dcp_packet_s* packet) 
 {
-    char buff[PDATAMAX+4];
-    int bsent;
-
-    buff[0] = (packet->cmd & 0x0F)<<4 | (packet->sessid & 0x0F);
-    buff[1] = (char)((packet->timestamp>>16) & (uint32_t)0x000000FF);
-    buff[2] = (char)((packet->timestamp>> 8) & (uint32_t)0x000000FF);
-    buff[3] = (char)((packet->timestamp    ) & (uint32_t)0x000000FF);
-    memcpy(buff+4, packet->data, packet->datalen);
+    char buff[PDATAMAX+DCP_HEADERSIZEV2];
+    char *header = buff;
+    int bsent, hlen=DCP_HEADERSIZE;
+
+    if(packet->version >= DCP_VERSION2) {
+        buff[0] = DCP_MAGICV2;
+        buff[1] = packet->cmd;
+        buff[2] = (char)((packet->sessid>>8) & 0xFF);
+        buff[3] = (char)((packet->sessid   ) & 0xFF);
+        buff[4] = 0;
+        header  = buff+4;
+        hlen    = DCP_HEADERSIZEV2;
+    }
+    else {
+        buff[0] = (packet->cmd & 0x0F)<<4 | (packet->sessid & 0x0F);
+    }
+    header[1] = (char)((packet->timestamp>>16) & (uint32_t)0x000000FF);
+    header[2] = (char)((packet->timestamp>> 8) & (uint32_t)0x000000FF);
+    header[3] = (char)((packet->timestamp    ) & (uint32_t)0x000000FF);
+    memcpy(buff+hlen, packet->data, packet->datalen);
 
-    bsent=sendto(uavsrv.sock, buff, 4+packet->datalen, 0, (struct sockaddr*)&(packet->dstaddr), packet->dstaddrlen);
+    bsent=sendto(uavsrv.sock, buff, hlen+packet->datalen, 0, (struct sockaddr*)&(packet->dstaddr), packet->dstaddrlen);
 
     return ((bsent>0) ? 0 : -1);
 }
@@ -634,7 +985,7 @@ int dcp_send(struct dcp_packet_s* packet)
 /*!
  *  \brief  Send Hello to central server.
  *  
- *  Sen hello to the central station. This function builds the DCP packet to send
+ *  Sen hello to the central station, in the highest DCP version. This function builds the DCP packet to send
  *  and call the sendto() function.
  *
  *  \param  dst Central station sockaddr structure.
@@ -648,6 +999,7 @@ int dcp_hello(struct sockaddr_storage* dst, const char *str, int len)
 {
     struct dcp_packet_s* packet = dcp_packetnew();
 
+    packet->version     = DCP_VERSION;
     packet->dstaddr     = uavsrv.params.central_addr;
     packet->dstaddrlen  = uavsrv.params.central_addrlen;
     packet->cmd         = DCP_CMDHELLOFROMREMOTE;
@@ -684,6 +1036,7 @@ int dcp_videos(const char* urls)
 
     packet->dstaddr     = uavsrv.params.central_addr;
     packet->dstaddrlen  = uavsrv.params.central_addrlen;
+    packet->version     = uavsrv.central_version;
     packet->cmd         = DCP_CMDVIDEOSERVERS;
     packet->sessid      = uavsrv.central_sessid;
     packet->timestamp   = uavsrv_msec_sincestart();
@@ -718,6 +1071,7 @@ int dcp_log(char* str)
 
     packet->dstaddr     = uavsrv.params.central_addr;
     packet->dstaddrlen  = uavsrv.params.central_addrlen;
+    packet->version     = uavsrv.central_version;
     packet->cmd         = DCP_CMDLOG;
     packet->sessid      = uavsrv.central_sessid;
     packet->timestamp   = uavsrv_msec_sincestart();
@@ -737,7 +1091,9 @@ int dcp_log(char* str)
  *  \brief  Send Ack for given packet.
  *  
  *  Send and Ack for the given packet. The packet already contains the struct sockaddr 
- *  of the sender. For performances purposes, it reusses the same struct to build the Ack.
+ *  of the sender. For performances purposes, it reusses the same struct to build the Ack,
+ *  which keeps the DCP version of the packet. Latest commands (see DCP_DELIVERY) are
+ *  not acked.
  *
  *  \param  packet  The packet to send an Ack for.
  *  \return -1 is returned in case of failure and uavsrv_err is set
@@ -746,6 +1102,9 @@ int dcp_log(char* str)
  */
 int dcp_packetack(struct dcp_packet_s* packet)
 {
+    if(DCP_DELIVERY(packet->cmd) == DCP_DELIVERYLATEST)
+        return 0;
+
     packet->cmd = DCP_CMDACK;
     packet->datalen = 0;
     dcp_send(packet);
@@ -804,7 +1163,7 @@ int uavsrv_setstate(enum uavsrv_state_e state)
 int uavsrv_dcphandlers_set(enum uavsrv_state_e state) 
 {    
     int i;
-    for(i=0 ; i<16 ; ++i) {
+    for(i=0 ; i<DCP_NBCOMMANDS ; ++i) {
         uavsrv.handlers[i] = handler_null;
     }
 
@@ -817,15 +1176,18 @@ int uavsrv_dcphandlers_set(enum uavsrv_state_e state)
             break;
         case SOCKREADY:
             uavsrv.handlers[DCP_CMDACK]                 = handler_ack;
+            uavsrv.handlers[DCP_CMDACKBUNDLE]           = handler_ackbundle;
             uavsrv.handlers[DCP_CMDHELLOFROMCENTRAL]    = handler_hellofromcentral;
             break;
         case REGISTERED:
             uavsrv.handlers[DCP_CMDACK]                 = handler_ack;
+            uavsrv.handlers[DCP_CMDACKBUNDLE]           = handler_ackbundle;
             uavsrv.handlers[DCP_CMDISALIVE]             = handler_isalive;
             uavsrv.handlers[DCP_CMDSETSESSID]           = handler_setsessid;
             break;
         case CONNECTED:
             uavsrv.handlers[DCP_CMDACK]                 = handler_ack;
+            uavsrv.handlers[DCP_CMDACKBUNDLE]           = handler_ackbundle;
             uavsrv.handlers[DCP_CMDISALIVE]             = handler_isalive;
             uavsrv.handlers[DCP_CMDAILERON]             = handler_ailerons;
             uavsrv.handlers[DCP_CMDTHROTTLE]            = handler_throttle;
@@ -931,18 +1293,33 @@ int uavsrv_save()
 
 
 
+/*!
+ *  \brief  Default uavsrv_clock: monotonic time in msec.
+ *  
+ *  Unlike the time of day, it never goes backward when the system time is set.
+ *
+ *  \return Time in milliseconds since an unspecified point.
+ */
+uint64_t uavsrv_clock_monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+
 /*!
  *  \brief  Returns the time in msec since drone start.
  *  
  *  This function is used to get the value for the timestamp field in the DCP packets.
+ *  The value wraps to the 24 bits of the field, compare it with DCP_TIMESTAMPLT().
  *
- *  \return Time in millseconds since drone start.
+ *  \return Time in millseconds since drone start, modulo 2^24.
  */
 uint32_t uavsrv_msec_sincestart() 
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint32_t)((uint64_t)(tv.tv_sec*1000 + tv.tv_usec/1000) - uavsrv.start_time);
+    return DCP_TIMESTAMP((uint32_t)(uavsrv_clock() - uavsrv.start_time));
 }
 
 
@@ -955,20 +1332,30 @@ uint32_t uavsrv_msec_sincestart()
  *  in the uavsrv structure.
  *  
  *  \return A pointer to the new DCP packet or NULL if error. If select() has
- *          been timed out, uavsrv_err is set to UAVSRV_ERR_TIMED_OUT.
+ *          been timed out, uavsrv_err is set to UAVSRV_ERR_TIMED_OUT. If the
+ *          datagram is shorter than its DCP header, it is dropped and
+ *          uavsrv_err is set to UAVSRV_ERR_BADDATALEN.
  */
 struct dcp_packet_s* uavsrv_dcp_waitone()
 {
     fd_set readset;
     struct timeval timeout;
     struct dcp_packet_s *packet = NULL;
-    int fdnb, bufflen=64, bread;
-    char buff[64];
+    int fdnb, bufflen=64, bread, hlen, next;
+    char buff[64], *header;
 
     FD_ZERO(&readset);
     FD_SET(uavsrv.sock, &readset);
     memcpy(&timeout, &(uavsrv.params.timeout), sizeof(struct timeval));
 
+    /* Wake up for the next resend; the hello has its own fallback in uavsrv_start() */
+    next = ackqueue_nextresend();
+    if(uavsrv.state >= REGISTERED && next >= 0 &&
+       (int64_t)timeout.tv_sec*1000 + timeout.tv_usec/1000 > next) {
+        timeout.tv_sec  = next / 1000;
+        timeout.tv_usec = (next % 1000) * 1000;
+    }
+
     fdnb = select(uavsrv.sock+1, &readset, NULL, NULL, &timeout);
     switch(fdnb) {
         case 0:
@@ -984,13 +1371,33 @@ struct dcp_packet_s* uavsrv_dcp_waitone()
                 break;
             }
             bread = recvfrom(uavsrv.sock, buff, bufflen, 0, (struct sockaddr*)&(packet->dstaddr), &(packet->dstaddrlen));
-            packet->cmd     = (buff[0]>>4) & (char)0x0F;
-            packet->sessid  = buff[0] & (char)0x0F;
-            packet->timestamp = (uint32_t)((uint32_t)(buff[1]<<16) & (uint32_t)0xFF0000) |
-                                (uint32_t)((uint32_t)(buff[2]<< 8) & (uint32_t)0x00FF00) |
-                                (uint32_t)((uint32_t)(buff[3]    ) & (uint32_t)0x0000FF) ;
-            packet->datalen = bread-4;
-            memcpy(&(packet->data), buff+4, bread-4);
+            header = buff;
+            hlen = DCP_HEADERSIZE;
+            if(bread >= 1 && (unsigned char)buff[0] == DCP_MAGICV2)
+                hlen = DCP_HEADERSIZEV2;
+            /* Shorter than its header: drop it */
+            if(bread < hlen) {
+                dcp_packetfree(packet);
+                packet = NULL;
+                uavsrv_err = UAVSRV_ERR_BADDATALEN;
+                break;
+            }
+            if(hlen == DCP_HEADERSIZEV2) {
+                /* v2: the timestamp and payload follow 4 more bytes */
+                packet->version = DCP_VERSION2;
+                packet->cmd     = buff[1];
+                packet->sessid  = ((uint8_t)buff[2]<<8) | (uint8_t)buff[3];
+                header = buff+4;
+            }
+            else {
+                packet->cmd     = (buff[0]>>4) & (char)0x0F;
+                packet->sessid  = buff[0] & (char)0x0F;
+            }
+            packet->timestamp = (uint32_t)((uint32_t)(header[1]<<16) & (uint32_t)0xFF0000) |
+                                (uint32_t)((uint32_t)(header[2]<< 8) & (uint32_t)0x00FF00) |
+                                (uint32_t)((uint32_t)(header[3]    ) & (uint32_t)0x0000FF) ;
+            packet->datalen = bread-hlen;
+            memcpy(&(packet->data), buff+hlen, packet->datalen);
             break;
     }
 
@@ -1095,7 +1502,7 @@ int uavsrv_connect()
  */
 int uavsrv_start()
 {
-    struct dcp_packet_s *packet;
+    struct dcp_packet_s *packet, *hello;
 
     /* Check that the socket is ready */
     if( uavsrv.state != SOCKREADY ) {
@@ -1104,16 +1511,34 @@ int uavsrv_start()
     }
 
     /* Set start time */
-    uavsrv.start_time = 0;
-    uavsrv.start_time = uavsrv_msec_sincestart();
+    uavsrv.start_time = uavsrv_clock();
 
-    /* Say hello */
+    /*
+     * Say hello, and say it again while it is not answered. A lost hello
+     * or answer must not lock the UAV into v1: only the last resend is in
+     * v1, in case the central station does not speak v2.
+     * */
     dcp_hello(&(uavsrv.params.central_addr), uavsrv.params.info, strnlen(uavsrv.params.info, PDATAMAX));
-    do {
+    hello = uavsrv.ackqueue;
+    while(1) {
         packet = uavsrv_dcp_waitone();
-    } while(packet!=NULL && packet->cmd!=DCP_CMDHELLOFROMCENTRAL);
-    if(!packet) {
-        return -1;
+        if(packet && packet->cmd == DCP_CMDHELLOFROMCENTRAL)
+            break;
+        if(packet) {
+            dcp_packetfree(packet);
+            continue;
+        }
+        if(uavsrv_err == UAVSRV_ERR_BADDATALEN)
+            continue;
+        if(uavsrv_err != UAVSRV_ERR_TIMEDOUT || !hello || hello->nbresend >= DCP_MAXRESEND)
+            return -1;
+
+        hello->nbresend++;
+        if(hello->nbresend == DCP_MAXRESEND && hello->version > DCP_VERSION1) {
+            syslog(LOG_NOTICE, "Hello in DCP v%d not answered, trying v%d", hello->version, DCP_VERSION1);
+            hello->version = DCP_VERSION1;
+        }
+        dcp_send(hello);
     }
     uavsrv.handlers[packet->cmd](packet);
     dcp_packetfree(packet);
@@ -1232,6 +1657,7 @@ int uavsrv_run(struct uavsrv_params_s *params)
 
     /* -- MAIN LOOP -- */
     while(1) {
+        ackqueue_resend();
         packet = uavsrv_dcp_waitone();
         if(!packet) {
             switch(uavsrv_err) {
@@ -1241,6 +1667,9 @@ int uavsrv_run(struct uavsrv_params_s *params)
                 case UAVSRV_ERR_SELECT:
                     syslog(LOG_ERR, uavsrv_errstr());
                     break;
+                case UAVSRV_ERR_BADDATALEN:
+                    syslog(LOG_DEBUG, uavsrv_errstr());
+                    break;
                 default:
                     syslog(LOG_NOTICE, "Unkwnon error code from uavsrv_waitone(): %d", uavsrv_err);
                     break;
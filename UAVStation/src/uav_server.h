@@ -31,6 +31,7 @@
 #ifndef __UAV_SERVER_H__
 #define __UAV_SERVER_H__
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -78,6 +79,25 @@ struct uavsrv_params_s {
 extern int          uavsrv_err;
 extern const char*  uavsrv_errstr   ();
 
+/*!
+ *  \brief  Clock the DCP timestamps are taken from, in msec.
+ *
+ *  Monotonic by default. Can be replaced before uavsrv_run(), e.g. by a
+ *  test fast-forwarding through the timestamps wraparound.
+ */
+extern uint64_t     (*uavsrv_clock) ();
+
+/*!
+ *  \brief  RTT of a peer packets were sent to, for monitoring.
+ *
+ *  \param  addr    Peer address.
+ *  \param  srtt    Smoothed RTT (msec).
+ *  \param  rttvar  RTT variation (msec).
+ *  \param  rto     Current retransmission timeout, backoff included (msec).
+ *  \return -1 if nothing was sent to the peer, 0 otherwise.
+ */
+extern int          uavsrv_getrtt   (const struct sockaddr_storage* addr, int* srtt, int* rttvar, int* rto);
+
 extern int          uavsrv_create   ();
 extern int          uavsrv_run      (struct uavsrv_params_s *params);
 extern void         uavsrv_destroy  ();
@@ -24,10 +24,67 @@
 
 /* --- DCP Header length --- */
 #define DCP_HEADERSIZE      (4)
+#define DCP_HEADERSIZEV2    (8)
+
+/* --- DCP Versions --- */
+/*
+ * v1 header: cmd (4 bits), sessID (4 bits), timestamp (24 bits).
+ * v2 header: DCP_MAGICV2, cmd (8 bits), sessID (16 bits), reserved (8 bits),
+ * timestamp (24 bits). The first byte of a v2 header reads as command 0xF,
+ * which v1 does not have: v1 peers drop v2 packets.
+ * A remote says hello in v2 and sends only the last resend of an
+ * unanswered hello (see DCP_MAXRESEND) in v1; the central station answers
+ * in the version of the hello and tells the version of the other end in
+ * SetSessID.
+ * */
+#define DCP_VERSION1        (1)
+#define DCP_VERSION2        (2)
+#define DCP_VERSION         DCP_VERSION2    // Highest version spoken
+#define DCP_MAGICV2         ((unsigned char)0xF2)
+#define DCP_NBCOMMANDS      (256)
 
 /* --- DCP Resend --- */
-#define DCP_TIMEOUT         (2000)
-#define DCP_MAXRESEND       (2)
+/*
+ * The retransmission timeout (RTO) of a peer follows the RTT measured on
+ * its acks (Jacobson/Karels, RFC 6298): RTO = SRTT + 4*RTTVAR, within
+ * [DCP_RTOMIN, DCP_RTOMAX], DCP_TIMEOUT before the first measure. Resent
+ * packets are not measured (Karn). Each resend doubles the timeout, and
+ * the peer keeps the doubled one until the next measure.
+ * */
+#define DCP_TIMEOUT         (1000)  // msec, initial RTO
+#define DCP_RTOMIN          (100)   // msec
+#define DCP_RTOMAX          (8000)  // msec
+#define DCP_MAXRESEND       (5)
+
+/* --- DCP Timestamps --- */
+/*
+ * 24-bit msec counters on a monotonic clock, they wrap every 4.6 hours.
+ * They are compared as serial numbers (RFC 1982): a is before b when b is
+ * less than half the counter ahead of a. Timestamps exactly half the
+ * counter apart are not ordered.
+ * */
+#define DCP_TIMESTAMPMASK   (0x00FFFFFF)
+#define DCP_TIMESTAMPHALF   (0x00800000)
+#define DCP_TIMESTAMP(msec) ((msec) & DCP_TIMESTAMPMASK)
+// a-b in [-DCP_TIMESTAMPHALF, DCP_TIMESTAMPHALF[
+#define DCP_TIMESTAMPDIFF(a, b) \
+    ((int)((((a) - (b)) + DCP_TIMESTAMPHALF) & DCP_TIMESTAMPMASK) \
+     - DCP_TIMESTAMPHALF)
+#define DCP_TIMESTAMPLT(a, b) \
+    (DCP_TIMESTAMPDIFF(a, b) < 0 && \
+     DCP_TIMESTAMPDIFF(a, b) != -DCP_TIMESTAMPHALF)
+
+/* --- DCP Ack bundles --- */
+/*
+ * v2 acks wait DCP_ACKDELAY for the next ones of the same session and
+ * leave together. The header timestamp is the first one acked; the payload
+ * is a run length, the number of consecutive timestamps acked after the
+ * first, then a bitmap of the following ones: bit i%8 of byte i/8 acks
+ * first+run+1+i.
+ * */
+#define DCP_ACKDELAY        (10)                    // msec
+#define DCP_ACKBUNDLEMAX    (32)                    // bitmap bytes
+#define DCP_ACKBUNDLESPAN   (8*DCP_ACKBUNDLEMAX)    // msec a bundle covers
 
 /* --- Commands --- */
 #define DCP_CMDACK                  ((char)0x00)
@@ -42,6 +99,20 @@
 #define DCP_CMDCONNECTTODRONE       ((char)0x09)
 #define DCP_CMDDISCONNECT           ((char)0x0A)
 #define DCP_CMDVIDEOSERVERS         ((char)0x0B)
+#define DCP_CMDACKBUNDLE            ((char)0x0C)    // v2 only
+
+/* --- Delivery classes --- */
+/*
+ * Reliable commands wait for their ack and are resent, see DCP_TIMEOUT.
+ * Latest commands are sent once and never acked: their sender repeats
+ * the last values at a steady rate, so a newer one is on its way. Their
+ * receiver drops those older than the last it got.
+ * */
+#define DCP_DELIVERYRELIABLE        (0)
+#define DCP_DELIVERYLATEST          (1)
+#define DCP_DELIVERY(cmd)                                                   \
+    (((cmd) == DCP_CMDAILERON || (cmd) == DCP_CMDTHROTTLE) ?                \
+     DCP_DELIVERYLATEST : DCP_DELIVERYRELIABLE)
 
 
 /* --- VIDEO SERVERS --- */
@@ -51,6 +122,8 @@
 #define DCP_IDNULL                  ((char)0x00)
 #define DCP_IDCENTRAL               ((char)0x00)
 #define DCP_SESSIDCENTRAL           ((char)0x00)
+#define DCP_IDMAX                   ((char)0x0F)     // v1
+#define DCP_IDMAXV2                 ((short)0x7FFF)  // v2, smallint in the DB
 
 /* --- Motors Defaults IDs --- */
 /* Those Motors IDs are reserved */
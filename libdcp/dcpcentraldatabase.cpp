@@ -0,0 +1,558 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentraldatabase.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpcentraldatabase.h"
+#include "dcp.h"
+#include "dcplog.h"
+#include "dcpcentralschema.h"
+
+#include <QMetaObject>
+#include <QDateTime>
+#include <QSqlError>
+
+#include <string.h>
+
+DCPCentralDatabase::DCPCentralDatabase(QSqlDatabase model,
+                                       QString connectionName) :
+    QObject(),
+    model(model),
+    connectionName(connectionName),
+    processPending(false),
+    maxQueueDepth(0),
+    nbExecuted(0),
+    nbFailed(0),
+    logTimer(NULL),
+    maintainTimer(NULL),
+    logRetention(DCPCENTRALSCHEMA_LOGRETENTION),
+    logFlushPending(false),
+    lastLogUsec(0),
+    nbLogsWritten(0),
+    nbLogsDropped(0),
+    nbLogsFailed(0),
+    nbLogBatches(0)
+{
+    memset(this->histograms, 0, sizeof(this->histograms));
+    this->clock.start();
+
+    this->moveToThread(&(this->thread));
+    connect(&(this->thread), SIGNAL(started()), this, SLOT(open()));
+}
+
+DCPCentralDatabase::~DCPCentralDatabase()
+{
+    this->stop();
+}
+
+/*
+ * SQL of the statements, prepared once per connection.
+ * */
+QString DCPCentralDatabase::statementQuery(int statement)
+{
+    switch(statement)
+    {
+    case InsertStation:
+        return "INSERT INTO " DCP_DBSTATIONS " (id, type, ip, port, date, info,"
+               " protocol) VALUES (?, ?, ?, ?, ?, ?, ?)";
+    case InsertSession:
+        return "INSERT INTO " DCP_DBSESSIONS " (id, station1, station2, date)"
+               " VALUES (?, ?, ?, ?)";
+    case InsertVideoServers:
+        return "INSERT INTO " DCP_DBVIDEOSERVERS " (id, videos) VALUES (?, ?)";
+    case DeleteVideoServers:
+        return "DELETE FROM " DCP_DBVIDEOSERVERS " WHERE id=?";
+    case DeleteSession:
+        return "DELETE FROM " DCP_DBSESSIONS " WHERE id=?";
+    case DeleteStation:
+        return "DELETE FROM " DCP_DBSTATIONS " WHERE id=?";
+    default:
+        return QString();
+    }
+}
+
+QString DCPCentralDatabase::logBatchQuery(int nbRows)
+{
+    QString query("INSERT INTO " DCP_DBLOGS " (id, level, date, msg) VALUES ");
+
+    for(int i=0 ; i<nbRows ; ++i)
+        query += (i==0) ? "(?, ?, ?, ?)" : ", (?, ?, ?, ?)";
+    return query;
+}
+
+/*
+ * Runs on the caller's thread, with the model connection.
+ * */
+bool DCPCentralDatabase::init(const DCPCentralRegistry::remote_t &central)
+{
+    QSqlQuery query;
+
+    if(!this->model.isOpen() && !this->model.open())
+    {
+        DCPLOG_CRITICAL("Database: could not open database: "
+                        << this->model.lastError().databaseText());
+        return false;
+    }
+    DCPCentralSchema::configure(this->model);
+    if(!DCPCentralSchema::migrate(this->model))
+        return false;
+    DCPCentralSchema::maintainLogs(this->model, this->logRetention);
+
+    // The central station is always DCP_IDCENTRAL
+    query = QSqlQuery(this->model);
+    query.prepare("UPDATE " DCP_DBSTATIONS " SET type=?, ip=?, port=?,"
+                  " info=?, protocol=?, date=current_timestamp WHERE id=?");
+    query.bindValue(0, central.type);
+    query.bindValue(1, central.addr.toString());
+    query.bindValue(2, central.port);
+    query.bindValue(3, central.info);
+    query.bindValue(4, central.protocol);
+    query.bindValue(5, DCP_IDCENTRAL);
+    if(query.exec() && query.numRowsAffected() == 0)
+    {
+        query.prepare("INSERT INTO " DCP_DBSTATIONS
+                      " (id, type, ip, port, info, protocol)"
+                      " VALUES (?, ?, ?, ?, ?, ?)");
+        query.bindValue(0, DCP_IDCENTRAL);
+        query.bindValue(1, central.type);
+        query.bindValue(2, central.addr.toString());
+        query.bindValue(3, central.port);
+        query.bindValue(4, central.info);
+        query.bindValue(5, central.protocol);
+        query.exec();
+    }
+    if(query.lastError().isValid())
+    {
+        DCPLOG_CRITICAL("Database: could not record the central station: "
+                        << query.lastError().databaseText());
+        return false;
+    }
+
+    return true;
+}
+
+bool DCPCentralDatabase::load(DCPCentralRegistry *registry)
+{
+    return registry->load(this->model);
+}
+
+void DCPCentralDatabase::start()
+{
+    this->thread.start();
+}
+
+/*
+ * Run what is still queued, then stop the thread.
+ * */
+void DCPCentralDatabase::stop()
+{
+    if(!this->thread.isRunning())
+        return;
+
+    if(QThread::currentThread() != &(this->thread))
+        QMetaObject::invokeMethod(this, "flushLogs",
+                                  Qt::BlockingQueuedConnection);
+    this->thread.quit();
+    this->thread.wait();
+}
+
+/*
+ * Thread safe.
+ * */
+void DCPCentralDatabase::submit(int statement, const QVariantList &values,
+                                QObject *receiver, const char *member)
+{
+    job_t job;
+    bool schedule;
+
+    job.statement   = statement;
+    job.values      = values;
+    job.receiver    = receiver;
+    job.member      = member;
+    job.submitted   = this->clock.nsecsElapsed();
+
+    this->mutex.lock();
+    this->queue.append(job);
+    this->maxQueueDepth = qMax(this->maxQueueDepth, this->queue.size());
+    schedule = !this->processPending;
+    this->processPending = true;
+    this->mutex.unlock();
+
+    if(schedule)
+        QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+}
+
+/*
+ * Thread safe. Returns false, and the log is dropped, when the buffer is
+ * full: the database does not keep up.
+ * */
+bool DCPCentralDatabase::submitLog(qint16 id, const QString &level,
+                                   const QString &msg,
+                                   QObject *receiver, const char *member)
+{
+    log_t log;
+    qint64 usec;
+    bool schedule;
+
+    log.id      = id;
+    log.level   = level;
+    log.msg     = msg;
+    log.receiver= receiver;
+    log.member  = member;
+
+    this->mutex.lock();
+    if(this->logs.size() >= DCPCENTRALDB_LOGQUEUEMAX)
+    {
+        this->nbLogsDropped++;
+        this->mutex.unlock();
+        return false;
+    }
+
+    // Dates strictly increase: the logs keep their arrival order
+    usec = qMax(QDateTime::currentMSecsSinceEpoch() * 1000,
+                this->lastLogUsec + 1);
+    this->lastLogUsec = usec;
+    log.date = QDateTime::fromMSecsSinceEpoch(usec / 1000).toUTC()
+                   .toString("yyyy-MM-dd hh:mm:ss.zzz")
+               + QString("%1+00").arg(usec % 1000, 3, 10, QChar('0'));
+
+    this->logs.append(log);
+    schedule = this->logs.size() >= DCPCENTRALDB_LOGBATCH &&
+               !this->logFlushPending;
+    if(schedule)
+        this->logFlushPending = true;
+    this->mutex.unlock();
+
+    if(schedule)
+        QMetaObject::invokeMethod(this, "flushLogs", Qt::QueuedConnection);
+    return true;
+}
+
+int DCPCentralDatabase::getQueueDepth()
+{
+    int depth;
+
+    this->mutex.lock();
+    depth = this->queue.size();
+    this->mutex.unlock();
+
+    return depth;
+}
+
+int DCPCentralDatabase::getMaxQueueDepth()
+{
+    int depth;
+
+    this->mutex.lock();
+    depth = this->maxQueueDepth;
+    this->mutex.unlock();
+
+    return depth;
+}
+
+quint64 DCPCentralDatabase::getNbExecuted()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbExecuted;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+quint64 DCPCentralDatabase::getNbFailed()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbFailed;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+QVector<quint64> DCPCentralDatabase::getLatencyHistogram(int statement)
+{
+    QVector<quint64> histogram(DCPCENTRALDB_HISTBUCKETS, 0);
+
+    if(statement < 0 || statement >= NbStatements)
+        return histogram;
+
+    this->mutex.lock();
+    for(int i=0 ; i<DCPCENTRALDB_HISTBUCKETS ; ++i)
+        histogram[i] = this->histograms[statement][i];
+    this->mutex.unlock();
+
+    return histogram;
+}
+
+int DCPCentralDatabase::getLogQueueDepth()
+{
+    int depth;
+
+    this->mutex.lock();
+    depth = this->logs.size();
+    this->mutex.unlock();
+
+    return depth;
+}
+
+quint64 DCPCentralDatabase::getNbLogsWritten()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbLogsWritten;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+quint64 DCPCentralDatabase::getNbLogsDropped()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbLogsDropped;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+quint64 DCPCentralDatabase::getNbLogsFailed()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbLogsFailed;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+quint64 DCPCentralDatabase::getNbLogBatches()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbLogBatches;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+/*
+ * Runs in the worker thread: the connection can only be used from the
+ * thread which opened it.
+ * */
+void DCPCentralDatabase::open()
+{
+    QSqlQuery *query;
+
+    this->db = QSqlDatabase::cloneDatabase(this->model, this->connectionName);
+    if(!this->db.open())
+    {
+        DCPLOG_CRITICAL("Database worker: could not open database: "
+                        << this->db.lastError().databaseText());
+        return;
+    }
+    DCPCentralSchema::configure(this->db);
+
+    this->statements.clear();
+    for(int i=0 ; i<NbStatements ; ++i)
+    {
+        this->statements.append(QSqlQuery(this->db));
+        query = &(this->statements.last());
+        if(!query->prepare(DCPCentralDatabase::statementQuery(i)))
+            DCPLOG_WARNING("Database worker: could not prepare "
+                           << DCPCentralDatabase::statementQuery(i) << ": "
+                           << query->lastError().databaseText());
+    }
+
+    this->logBatchStatement = QSqlQuery(this->db);
+    if(!this->logBatchStatement.prepare(
+                DCPCentralDatabase::logBatchQuery(DCPCENTRALDB_LOGBATCH)))
+        DCPLOG_WARNING("Database worker: could not prepare the log batch: "
+                       << this->logBatchStatement.lastError().databaseText());
+
+    this->logTimer = new QTimer(this);
+    connect(this->logTimer, SIGNAL(timeout()), this, SLOT(flushLogs()));
+    this->logTimer->start(DCPCENTRALDB_LOGFLUSH);
+
+    this->maintainTimer = new QTimer(this);
+    connect(this->maintainTimer, SIGNAL(timeout()),
+            this, SLOT(maintainLogs()));
+    this->maintainTimer->start(DCPCENTRALDB_LOGMAINTAIN);
+}
+
+/*
+ * Create the coming days' log partitions before the logs get there.
+ * */
+void DCPCentralDatabase::maintainLogs()
+{
+    DCPCentralSchema::maintainLogs(this->db, this->logRetention);
+}
+
+/*
+ * Write the buffered logs, a batch per INSERT.
+ * */
+void DCPCentralDatabase::flushLogs()
+{
+    // Logs may refer to stations whose insert is still queued
+    this->process();
+    this->writeBufferedLogs();
+}
+
+void DCPCentralDatabase::writeBufferedLogs()
+{
+    QList<log_t> batch;
+    bool ok;
+
+    this->mutex.lock();
+    while(!this->logs.isEmpty())
+    {
+        batch = this->logs.mid(0, DCPCENTRALDB_LOGBATCH);
+        this->logs = this->logs.mid(batch.size());
+        this->mutex.unlock();
+
+        ok = this->writeLogs(batch);
+        DCPCentralDatabase::completeLogs(batch, ok);
+
+        this->mutex.lock();
+        this->nbLogBatches++;
+        if(ok)
+            this->nbLogsWritten += batch.size();
+        else
+            this->nbLogsFailed += batch.size();
+    }
+    this->logFlushPending = false;
+    this->mutex.unlock();
+}
+
+/*
+ * One completion per submitter of the batch, with the number of its logs.
+ * A batch holds the logs of a few workers at most.
+ * */
+void DCPCentralDatabase::completeLogs(const QList<log_t> &batch, bool ok)
+{
+    QList<QObject*> receivers;
+    QList<const char*> members;
+    QList<int> counts;
+    int i;
+
+    foreach (const log_t &log, batch) {
+        if(!log.receiver)
+            continue;
+        i = receivers.indexOf(log.receiver.data());
+        if(i < 0)
+        {
+            receivers.append(log.receiver.data());
+            members.append(log.member);
+            counts.append(0);
+            i = receivers.size() - 1;
+        }
+        counts[i]++;
+    }
+
+    for(i=0 ; i<receivers.size() ; ++i)
+        QMetaObject::invokeMethod(receivers.at(i), members.at(i),
+                                  Qt::QueuedConnection,
+                                  Q_ARG(int, counts.at(i)), Q_ARG(bool, ok));
+}
+
+bool DCPCentralDatabase::writeLogs(const QList<log_t> &batch)
+{
+    QSqlQuery partial;
+    QSqlQuery *query = &(this->logBatchStatement);
+    int i = 0;
+
+    // Only full batches use the prepared statement
+    if(batch.size() != DCPCENTRALDB_LOGBATCH)
+    {
+        partial = QSqlQuery(this->db);
+        partial.prepare(DCPCentralDatabase::logBatchQuery(batch.size()));
+        query = &partial;
+    }
+
+    foreach (const log_t &log, batch) {
+        query->bindValue(i++, log.id);
+        query->bindValue(i++, log.level);
+        query->bindValue(i++, log.date);
+        query->bindValue(i++, log.msg);
+    }
+
+    if(!query->exec())
+    {
+        DCPLOG_WARNING("Database worker: could not write " << batch.size()
+                       << " log(s): " << query->lastError().databaseText());
+        return false;
+    }
+    return true;
+}
+
+void DCPCentralDatabase::process()
+{
+    job_t job;
+    bool ok;
+    qint64 usec;
+    int bucket;
+
+    this->mutex.lock();
+    while(!this->queue.isEmpty())
+    {
+        job = this->queue.takeFirst();
+        this->mutex.unlock();
+
+        // Logs may refer to the station, which has to outlive them
+        if(job.statement == DeleteStation)
+            this->writeBufferedLogs();
+
+        ok = job.statement >= 0 && job.statement < this->statements.size();
+        if(ok)
+        {
+            QSqlQuery &query = this->statements[job.statement];
+            for(int i=0 ; i<job.values.size() ; ++i)
+                query.bindValue(i, job.values.at(i));
+            ok = query.exec();
+            if(!ok)
+                DCPLOG_WARNING("Database worker: " << query.lastQuery()
+                               << ": " << query.lastError().databaseText());
+        }
+
+        if(job.receiver)
+            QMetaObject::invokeMethod(job.receiver, job.member.constData(),
+                                      Qt::QueuedConnection,
+                                      Q_ARG(int, job.statement),
+                                      Q_ARG(QVariantList, job.values),
+                                      Q_ARG(bool, ok));
+
+        usec = (this->clock.nsecsElapsed() - job.submitted) / 1000;
+        for(bucket=0 ; bucket<DCPCENTRALDB_HISTBUCKETS-1 &&
+                       (usec >> (bucket+1)) ; ++bucket);
+
+        this->mutex.lock();
+        this->nbExecuted++;
+        if(!ok)
+            this->nbFailed++;
+        if(job.statement >= 0 && job.statement < NbStatements)
+            this->histograms[job.statement][bucket]++;
+    }
+    this->processPending = false;
+    this->mutex.unlock();
+}
@@ -0,0 +1,156 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentraldatabase.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPCENTRALDATABASE_H
+#define DCPCENTRALDATABASE_H
+
+#include <QtGlobal>
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QVector>
+#include <QVariant>
+#include <QByteArray>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+#include <dcpcentralstorage.h>
+
+/* --- Latency histograms --- */
+#define DCPCENTRALDB_HISTBUCKETS    (24)    // bucket i: [2^i, 2^(i+1)[ usec
+
+/* --- Log ingestion --- */
+#define DCPCENTRALDB_LOGBATCH       (128)   // rows per INSERT
+#define DCPCENTRALDB_LOGQUEUEMAX    (8192)  // rows, more are shed
+#define DCPCENTRALDB_LOGFLUSH       (100)   // msec
+#define DCPCENTRALDB_LOGMAINTAIN    (3600000)   // msec, see DCPCentralSchema
+
+
+
+/*
+ * DCP -- Central station database worker.
+ * Storage in a SQL database, PostgreSQL (QPSQL) or SQLite (QSQLITE) in
+ * WAL mode, the model connection telling which.
+ * Runs the central station statements on its own thread and connection,
+ * in the order they were submitted, so that packet handling never waits
+ * for the database. Statements are prepared once when the connection is
+ * opened.
+ * Logs take a separate path. They are buffered, then written with
+ * multi-row INSERTs when a batch is full or every DCPCENTRALDB_LOGFLUSH
+ * msec, each submitter being told once the batch is committed. While the
+ * buffer is full, new logs are refused and counted.
+ * */
+class DCPCentralDatabase : public QObject, public DCPCentralStorage
+{
+    Q_OBJECT
+
+public:
+    DCPCentralDatabase(QSqlDatabase model, QString connectionName);
+    ~DCPCentralDatabase();
+
+    static QString  statementQuery(int statement);
+
+    // Before start()
+    inline void setLogRetention(int days)   { this->logRetention = days; }
+    bool        init(const DCPCentralRegistry::remote_t &central);
+    bool        load(DCPCentralRegistry *registry);
+
+    void        start();
+    void        stop();
+    void        submit(int statement, const QVariantList &values,
+                       QObject *receiver=NULL, const char *member=NULL);
+    bool        submitLog(qint16 id, const QString &level, const QString &msg,
+                          QObject *receiver=NULL, const char *member=NULL);
+
+    // Statistics
+    int         getQueueDepth();
+    int         getMaxQueueDepth();
+    quint64     getNbExecuted();
+    quint64     getNbFailed();
+    // Submission to completion latency of a statement
+    QVector<quint64>    getLatencyHistogram(int statement);
+    // Logs
+    int         getLogQueueDepth();
+    quint64     getNbLogsWritten();
+    quint64     getNbLogsDropped();     // refused, the buffer being full
+    quint64     getNbLogsFailed();      // lost with a failed batch
+    quint64     getNbLogBatches();
+
+private slots:
+    void        open();
+    void        process();
+    void        flushLogs();
+    void        maintainLogs();
+
+private:
+    typedef struct job_s {
+        int                 statement;
+        QVariantList        values;
+        QPointer<QObject>   receiver;
+        QByteArray          member;
+        qint64              submitted;      // nsec on clock
+    } job_t;
+    typedef struct log_s {
+        qint16              id;
+        QString             level;
+        QString             date;           // UTC, usec precision
+        QString             msg;
+        QPointer<QObject>   receiver;
+        const char          *member;
+    } log_t;
+
+    static QString  logBatchQuery(int nbRows);
+    void        writeBufferedLogs();
+    bool        writeLogs(const QList<log_t> &batch);
+    static void completeLogs(const QList<log_t> &batch, bool ok);
+
+    QSqlDatabase        model;
+    QString             connectionName;
+    QSqlDatabase        db;
+    QList<QSqlQuery>    statements;         // by statement_e
+    QThread             thread;
+    QElapsedTimer       clock;
+
+    QMutex              mutex;
+    QList<job_t>        queue;
+    bool                processPending;
+    int                 maxQueueDepth;
+    quint64             nbExecuted;
+    quint64             nbFailed;
+    quint64             histograms[NbStatements][DCPCENTRALDB_HISTBUCKETS];
+
+    QSqlQuery           logBatchStatement;  // DCPCENTRALDB_LOGBATCH rows
+    QTimer              *logTimer;
+    QTimer              *maintainTimer;
+    int                 logRetention;       // days
+    QList<log_t>        logs;
+    bool                logFlushPending;
+    qint64              lastLogUsec;        // keeps the arrival order
+    quint64             nbLogsWritten;
+    quint64             nbLogsDropped;
+    quint64             nbLogsFailed;
+    quint64             nbLogBatches;
+};
+
+#endif // DCPCENTRALDATABASE_H
@@ -0,0 +1,104 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralmemorystorage.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpcentralmemorystorage.h"
+#include "dcplog.h"
+
+#include <QMetaObject>
+
+DCPCentralMemoryStorage::DCPCentralMemoryStorage() :
+    nbExecuted(0),
+    nbLogs(0)
+{}
+
+bool DCPCentralMemoryStorage::init(const DCPCentralRegistry::remote_t &central)
+{
+    this->central = central;
+    return true;
+}
+
+bool DCPCentralMemoryStorage::load(DCPCentralRegistry *registry)
+{
+    registry->insertStation(this->central);
+    return true;
+}
+
+void DCPCentralMemoryStorage::start()
+{}
+
+void DCPCentralMemoryStorage::stop()
+{}
+
+/*
+ * Thread safe.
+ * */
+void DCPCentralMemoryStorage::submit(int statement, const QVariantList &values,
+                                     QObject *receiver, const char *member)
+{
+    this->mutex.lock();
+    this->nbExecuted++;
+    this->mutex.unlock();
+
+    if(receiver)
+        QMetaObject::invokeMethod(receiver, member, Qt::QueuedConnection,
+                                  Q_ARG(int, statement),
+                                  Q_ARG(QVariantList, values),
+                                  Q_ARG(bool, true));
+}
+
+/*
+ * Thread safe.
+ * */
+bool DCPCentralMemoryStorage::submitLog(qint16 id, const QString &level,
+                                        const QString &msg,
+                                        QObject *receiver, const char *member)
+{
+    this->mutex.lock();
+    this->nbLogs++;
+    this->mutex.unlock();
+
+    DCPLOG_INFO("Station " << id << " [" << level << "]: " << msg);
+    if(receiver)
+        QMetaObject::invokeMethod(receiver, member, Qt::QueuedConnection,
+                                  Q_ARG(int, 1), Q_ARG(bool, true));
+    return true;
+}
+
+quint64 DCPCentralMemoryStorage::getNbExecuted()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbExecuted;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+quint64 DCPCentralMemoryStorage::getNbLogs()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbLogs;
+    this->mutex.unlock();
+
+    return nb;
+}
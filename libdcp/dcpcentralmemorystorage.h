@@ -0,0 +1,66 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralmemorystorage.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPCENTRALMEMORYSTORAGE_H
+#define DCPCENTRALMEMORYSTORAGE_H
+
+#include <QtGlobal>
+#include <QObject>
+#include <QMutex>
+
+#include <dcpcentralstorage.h>
+
+
+
+/*
+ * DCP -- Central station storage without persistence.
+ * The registry starts with the central station alone and every write
+ * succeeds at once. Station logs go to the central station's own log.
+ * For tests and small deployments: nothing to set up, nothing survives a
+ * restart.
+ * */
+class DCPCentralMemoryStorage : public DCPCentralStorage
+{
+public:
+    DCPCentralMemoryStorage();
+
+    bool    init(const DCPCentralRegistry::remote_t &central);
+    bool    load(DCPCentralRegistry *registry);
+
+    void    start();
+    void    stop();
+    void    submit(int statement, const QVariantList &values,
+                   QObject *receiver=NULL, const char *member=NULL);
+    bool    submitLog(qint16 id, const QString &level, const QString &msg,
+                      QObject *receiver=NULL, const char *member=NULL);
+
+    // Statistics
+    quint64 getNbExecuted();
+    quint64 getNbLogs();
+
+private:
+    DCPCentralRegistry::remote_t    central;
+
+    QMutex      mutex;
+    quint64     nbExecuted;
+    quint64     nbLogs;
+};
+
+#endif // DCPCENTRALMEMORYSTORAGE_H
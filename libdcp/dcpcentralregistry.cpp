@@ -0,0 +1,431 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralregistry.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpcentralregistry.h"
+#include "dcp.h"
+#include "dcplog.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+
+DCPCentralRegistry::DCPCentralRegistry()
+{
+    DCPCentralRegistry::resetPools(this->stationIds);
+    DCPCentralRegistry::resetPools(this->sessionIds);
+}
+
+/*
+ * Replace the registry content with the database one.
+ * */
+bool DCPCentralRegistry::load(QSqlDatabase db)
+{
+    QHash<qint16, remote_t> stations;
+    QHash<qint16, session_t> sessions;
+    QHash<qint16, QString> videos;
+    QHash<qint16, session_t>::const_iterator it;
+    QHash<qint16, remote_t>::const_iterator st;
+    remote_t remote;
+    session_t session;
+
+    QSqlQuery query(db);
+    if(!query.exec("SELECT id, type, ip, port, date, info, protocol FROM "
+                   DCP_DBSTATIONS))
+        goto error;
+    while(query.next())
+    {
+        remote.id      = query.value(0).toInt();
+        remote.type    = query.value(1).toString();
+        remote.addr    = QHostAddress(query.value(2).toString());
+        remote.port    = query.value(3).toInt();
+        remote.date    = query.value(4).toDateTime();
+        remote.info    = query.value(5).toString();
+        remote.protocol= query.value(6).toInt();
+        stations.insert(remote.id, remote);
+    }
+
+    if(!query.exec("SELECT id, station1, station2, date FROM "
+                   DCP_DBSESSIONS))
+        goto error;
+    while(query.next())
+    {
+        session.id          = query.value(0).toInt();
+        session.station1    = query.value(1).toInt();
+        session.station2    = query.value(2).toInt();
+        session.date        = query.value(3).toDateTime();
+        sessions.insert(session.id, session);
+    }
+
+    if(!query.exec("SELECT id, videos FROM " DCP_DBVIDEOSERVERS))
+        goto error;
+    while(query.next())
+        videos.insert(query.value(0).toInt(), query.value(1).toString());
+
+    this->lock.lockForWrite();
+    this->stations  = stations;
+    this->sessions  = sessions;
+    this->videos    = videos;
+    this->centralSessions.clear();
+    this->droneSessions.clear();
+    for(it=sessions.constBegin() ; it!=sessions.constEnd() ; ++it)
+        this->indexSession(it.value());
+    for(int i=0 ; i<DCPLIVENESS_NBSLOTS ; ++i)
+        this->remotes[i].clear();
+    for(st=stations.constBegin() ; st!=stations.constEnd() ; ++st)
+        this->indexStation(st.value());
+    this->removedStations.clear();
+    DCPCentralRegistry::resetPools(this->stationIds);
+    DCPCentralRegistry::resetPools(this->sessionIds);
+    this->lock.unlock();
+
+    return true;
+
+error:
+    DCPLOG_CRITICAL("Registry: could not load " << query.lastQuery() << ": "
+                    << query.lastError().driverText() << " "
+                    << query.lastError().databaseText());
+    return false;
+}
+
+bool DCPCentralRegistry::getStation(qint16 id, remote_t *remote)
+{
+    QHash<qint16, remote_t>::const_iterator it;
+    bool found;
+
+    this->lock.lockForRead();
+    it = this->stations.constFind(id);
+    found = (it != this->stations.constEnd());
+    if(found)
+        *remote = it.value();
+    this->lock.unlock();
+
+    return found;
+}
+
+bool DCPCentralRegistry::getStationOfType(qint16 id, const QString &type,
+                                          remote_t *remote)
+{
+    remote_t station;
+
+    if(!this->getStation(id, &station) || station.type != type)
+        return false;
+
+    *remote = station;
+    return true;
+}
+
+bool DCPCentralRegistry::getSession(qint16 id, session_t *session)
+{
+    QHash<qint16, session_t>::const_iterator it;
+    bool found;
+
+    this->lock.lockForRead();
+    it = this->sessions.constFind(id);
+    found = (it != this->sessions.constEnd());
+    if(found)
+        *session = it.value();
+    this->lock.unlock();
+
+    return found;
+}
+
+bool DCPCentralRegistry::getCentralSessionForStation(qint16 id,
+                                                     session_t *session)
+{
+    bool found = false;
+
+    this->lock.lockForRead();
+    if(this->centralSessions.contains(id))
+    {
+        *session = this->sessions.value(this->centralSessions.value(id));
+        found = true;
+    }
+    this->lock.unlock();
+
+    return found;
+}
+
+bool DCPCentralRegistry::getDroneSessionForStation(qint16 id,
+                                                   session_t *session)
+{
+    bool found = false;
+
+    this->lock.lockForRead();
+    if(this->droneSessions.contains(id))
+    {
+        *session = this->sessions.value(this->droneSessions.value(id));
+        found = true;
+    }
+    this->lock.unlock();
+
+    return found;
+}
+
+/*
+ * The stations but the central ones whose id falls in slot, see
+ * DCPLiveness::isTurn().
+ * */
+void DCPCentralRegistry::getRemoteStationsOfSlot(qint8 slot,
+                                                 QVector<remote_t> *remotes)
+{
+    QSet<qint16>::const_iterator it;
+
+    remotes->resize(0);
+    this->lock.lockForRead();
+    const QSet<qint16> &ids = this->remotes[slot];
+    for(it=ids.constBegin() ; it!=ids.constEnd() ; ++it)
+        remotes->append(this->stations.value(*it));
+    this->lock.unlock();
+}
+
+/*
+ * Give remote a free station id its protocol can carry and add it, in one
+ * step so that two workers never get the same id. Returns false when all
+ * the ids are taken.
+ * */
+bool DCPCentralRegistry::addStation(remote_t *remote)
+{
+    this->lock.lockForWrite();
+    remote->id = DCPCentralRegistry::freeId(this->stationIds, this->stations,
+                                            remote->protocol);
+    if(remote->id != DCP_DBNOAVALIABLEIDS)
+    {
+        this->stations.insert(remote->id, *remote);
+        this->indexStation(*remote);
+    }
+    this->lock.unlock();
+
+    return remote->id != DCP_DBNOAVALIABLEIDS;
+}
+
+/*
+ * The session id must fit in the headers of both stations.
+ * */
+bool DCPCentralRegistry::addSession(session_t *session)
+{
+    this->lock.lockForWrite();
+    session->id = DCPCentralRegistry::freeId(this->sessionIds, this->sessions,
+                        qMin(this->protocolOf(session->station1),
+                             this->protocolOf(session->station2)));
+    if(session->id != DCP_DBNOAVALIABLEIDS)
+    {
+        this->sessions.insert(session->id, *session);
+        this->indexSession(*session);
+    }
+    this->lock.unlock();
+
+    return session->id != DCP_DBNOAVALIABLEIDS;
+}
+
+void DCPCentralRegistry::insertStation(const remote_t &remote)
+{
+    this->lock.lockForWrite();
+    this->stations.insert(remote.id, remote);
+    this->indexStation(remote);
+    this->lock.unlock();
+}
+
+/*
+ * The id stays reserved until releaseStationId(): given out again before
+ * the database row is gone, it would collide with it.
+ * */
+bool DCPCentralRegistry::removeStation(qint16 id)
+{
+    bool removed;
+
+    this->lock.lockForWrite();
+    removed = this->stations.remove(id) > 0;
+    if(removed)
+    {
+        if(id >= 0)
+            this->remotes[DCPLiveness::slotOf(id)].remove(id);
+        this->removedStations.insert(id);
+    }
+    this->lock.unlock();
+
+    return removed;
+}
+
+void DCPCentralRegistry::releaseStationId(qint16 id)
+{
+    this->lock.lockForWrite();
+    if(this->removedStations.remove(id))
+        DCPCentralRegistry::releaseId(this->stationIds, id);
+    this->lock.unlock();
+}
+
+void DCPCentralRegistry::insertSession(const session_t &session)
+{
+    this->lock.lockForWrite();
+    if(this->sessions.contains(session.id))
+        this->unindexSession(this->sessions.value(session.id));
+    this->sessions.insert(session.id, session);
+    this->indexSession(session);
+    this->lock.unlock();
+}
+
+bool DCPCentralRegistry::removeSession(qint16 id)
+{
+    bool removed = false;
+
+    this->lock.lockForWrite();
+    if(this->sessions.contains(id))
+    {
+        this->unindexSession(this->sessions.take(id));
+        DCPCentralRegistry::releaseId(this->sessionIds, id);
+        removed = true;
+    }
+    this->lock.unlock();
+
+    return removed;
+}
+
+void DCPCentralRegistry::setVideoServers(qint16 id, const QString &videos)
+{
+    this->lock.lockForWrite();
+    this->videos.insert(id, videos);
+    this->lock.unlock();
+}
+
+bool DCPCentralRegistry::removeVideoServers(qint16 id)
+{
+    bool removed;
+
+    this->lock.lockForWrite();
+    removed = this->videos.remove(id) > 0;
+    this->lock.unlock();
+
+    return removed;
+}
+
+/*
+ * Ids go up to DCP_IDMAX in v1, the session id field of the header being 4
+ * bits wide, and up to DCP_IDMAXV2 in v2. DCP_IDCENTRAL is never given out.
+ * Lock held.
+ * */
+template<class T>
+qint16 DCPCentralRegistry::freeId(idpool_t *pools,
+                                  const QHash<qint16, T> &used,
+                                  qint8 protocol)
+{
+    qint16 id = DCP_DBNOAVALIABLEIDS;
+
+    if(protocol >= DCP_VERSION2)
+        id = DCPCentralRegistry::takeId(&(pools[PoolV2]), used);
+    if(id == DCP_DBNOAVALIABLEIDS)
+        id = DCPCentralRegistry::takeId(&(pools[PoolV1]), used);
+    return id;
+}
+
+/*
+ * Each id is skipped at most once from next and popped once from released
+ * per release: amortised constant time.
+ * */
+template<class T>
+qint16 DCPCentralRegistry::takeId(idpool_t *pool,
+                                  const QHash<qint16, T> &used)
+{
+    qint16 id;
+
+    while(!pool->released.isEmpty())
+    {
+        id = pool->released.takeLast();
+        if(!used.contains(id))
+            return id;
+    }
+
+    while(pool->next <= pool->last)
+    {
+        id = pool->next++;
+        if(!used.contains(id))
+            return id;
+    }
+    return DCP_DBNOAVALIABLEIDS;
+}
+
+void DCPCentralRegistry::releaseId(idpool_t *pools, qint16 id)
+{
+    for(int i=0 ; i<NbPools ; ++i)
+    {
+        if(id >= pools[i].first && id < pools[i].next)
+            pools[i].released.append(id);
+    }
+}
+
+void DCPCentralRegistry::resetPools(idpool_t *pools)
+{
+    pools[PoolV1].first = DCP_IDCENTRAL+1;
+    pools[PoolV1].last  = DCP_IDMAX;
+    pools[PoolV2].first = DCP_IDMAX+1;
+    pools[PoolV2].last  = DCP_IDMAXV2;
+    for(int i=0 ; i<NbPools ; ++i)
+    {
+        pools[i].next = pools[i].first;
+        pools[i].released.clear();
+    }
+}
+
+/*
+ * Lock held. Unknown stations are taken as v1.
+ * */
+qint8 DCPCentralRegistry::protocolOf(qint16 id)
+{
+    QHash<qint16, remote_t>::const_iterator it = this->stations.constFind(id);
+
+    if(it == this->stations.constEnd())
+        return DCP_VERSION1;
+    return it.value().protocol;
+}
+
+bool DCPCentralRegistry::isCentralSession(const session_t &session)
+{
+    return session.station1 == DCP_IDCENTRAL ||
+           session.station2 == DCP_IDCENTRAL;
+}
+
+void DCPCentralRegistry::indexSession(const session_t &session)
+{
+    QHash<qint16, qint16> &index = DCPCentralRegistry::isCentralSession(session)
+            ? this->centralSessions : this->droneSessions;
+
+    index.insert(session.station1, session.id);
+    index.insert(session.station2, session.id);
+}
+
+void DCPCentralRegistry::unindexSession(const session_t &session)
+{
+    QHash<qint16, qint16> &index = DCPCentralRegistry::isCentralSession(session)
+            ? this->centralSessions : this->droneSessions;
+
+    if(index.value(session.station1, -1) == session.id)
+        index.remove(session.station1);
+    if(index.value(session.station2, -1) == session.id)
+        index.remove(session.station2);
+}
+
+/*
+ * Lock held.
+ * */
+void DCPCentralRegistry::indexStation(const remote_t &remote)
+{
+    if(remote.id < 0 || remote.type == "central")
+        return;
+
+    this->remotes[DCPLiveness::slotOf(remote.id)].insert(remote.id);
+}
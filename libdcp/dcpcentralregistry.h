@@ -0,0 +1,137 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralregistry.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPCENTRALREGISTRY_H
+#define DCPCENTRALREGISTRY_H
+
+#include <QtGlobal>
+#include <QtSql/QSqlDatabase>
+#include <QHostAddress>
+#include <QString>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QVector>
+#include <QReadWriteLock>
+
+#include <dcpliveness.h>
+
+
+
+/*
+ * DCP -- Central station registry.
+ * In memory copy of the stations, sessions and video servers of the
+ * database: every lookup of the central station is answered from here.
+ * It is loaded from the database at startup and is then authoritative:
+ * it hands out the station and session ids, and the changes are written
+ * behind by the caller (see DCPCentralDatabase).
+ * Ids up to DCP_IDMAX are kept for the stations and sessions a v1 station
+ * takes part in, v1 headers having no room for more; v2 ones are given the
+ * ids above first. Ids are handed out in amortised constant time, the ones
+ * given back being reused first. The id of a removed station is only given
+ * back by releaseStationId(), once its row is deleted from the database.
+ * A single registry is shared by every central station worker. The remote
+ * stations are also indexed by liveness slot (see DCPLiveness), so that a
+ * ping tick only goes through its share of them.
+ * */
+class DCPCentralRegistry
+{
+public:
+    typedef struct remote_s {
+        qint16 id;
+        QString type;
+        QHostAddress addr;
+        quint16 port;
+        QDateTime date;
+        QString info;
+        qint8 protocol;     // DCP version spoken
+    } remote_t;
+    typedef struct session_s {
+        qint16 id;
+        qint16 station1;
+        qint16 station2;
+        QDateTime date;
+    } session_t;
+
+    DCPCentralRegistry();
+
+    bool        load(QSqlDatabase db);
+
+    // Lookups, return false if nothing matches
+    bool        getStation(qint16 id, remote_t *remote);
+    bool        getStationOfType(qint16 id, const QString &type,
+                                 remote_t *remote);
+    bool        getSession(qint16 id, session_t *session);
+    bool        getCentralSessionForStation(qint16 id, session_t *session);
+    bool        getDroneSessionForStation(qint16 id, session_t *session);
+    // Copied into remotes, which keeps its capacity
+    void        getRemoteStationsOfSlot(qint8 slot, QVector<remote_t> *remotes);
+
+    // Changes of the in memory state only
+    bool        addStation(remote_t *remote);
+    bool        addSession(session_t *session);
+    void        insertStation(const remote_t &remote);
+    bool        removeStation(qint16 id);
+    void        releaseStationId(qint16 id);
+    void        insertSession(const session_t &session);
+    bool        removeSession(qint16 id);
+    void        setVideoServers(qint16 id, const QString &videos);
+    bool        removeVideoServers(qint16 id);
+
+private:
+    /*
+     * Ids of [first, last]: the ones given back, then the ones from next
+     * on. The ids found taken (e.g. loaded from the database) are skipped.
+     * */
+    typedef struct idpool_s {
+        int             first;
+        int             last;
+        int             next;       // Lowest id never handed out
+        QList<qint16>   released;   // Given back, below next
+    } idpool_t;
+    enum { PoolV1, PoolV2, NbPools };
+
+    template<class T>
+    static qint16 freeId(idpool_t *pools, const QHash<qint16, T> &used,
+                         qint8 protocol);
+    template<class T>
+    static qint16 takeId(idpool_t *pool, const QHash<qint16, T> &used);
+    static void releaseId(idpool_t *pools, qint16 id);
+    static void resetPools(idpool_t *pools);
+    qint8       protocolOf(qint16 id);
+    static bool isCentralSession(const session_t &session);
+    void        indexSession(const session_t &session);
+    void        unindexSession(const session_t &session);
+    void        indexStation(const remote_t &remote);
+
+    QReadWriteLock              lock;
+    QHash<qint16, remote_t>     stations;
+    QHash<qint16, session_t>    sessions;
+    QHash<qint16, QString>      videos;
+    QHash<qint16, qint16>       centralSessions;    // station -> session
+    QHash<qint16, qint16>       droneSessions;      // station -> session
+    QSet<qint16>                remotes[DCPLIVENESS_NBSLOTS];   // by slot
+    QSet<qint16>                removedStations;    // id not released yet
+    idpool_t                    stationIds[NbPools];
+    idpool_t                    sessionIds[NbPools];
+};
+
+#endif // DCPCENTRALREGISTRY_H
@@ -0,0 +1,398 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralschema.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpcentralschema.h"
+#include "dcp.h"
+#include "dcplog.h"
+
+#include <QDate>
+#include <QDateTime>
+#include <QStringList>
+#include <QSqlError>
+
+/*
+ * Version 2: indexes for the session lookups, logs partitioned by day with
+ * a surrogate key instead of (id, date).
+ * */
+static const char* const migrationV2[] = {
+    "CREATE TABLE IF NOT EXISTS " DCPCENTRALSCHEMA_TABLE " ("
+    "   version integer PRIMARY KEY,"
+    "   date    timestamp with time zone NOT NULL default current_timestamp)",
+
+    "CREATE INDEX sessions_station1_idx ON " DCP_DBSESSIONS
+    "   (station1, station2, id)",
+    "CREATE INDEX sessions_station2_idx ON " DCP_DBSESSIONS
+    "   (station2, station1, id)",
+
+    "ALTER TABLE " DCP_DBLOGS " RENAME TO logs_v1",
+    "ALTER TABLE logs_v1 RENAME CONSTRAINT logs_pkey TO logs_v1_pkey",
+    "CREATE TABLE " DCP_DBLOGS " ("
+    "   seq     bigserial,"
+    "   id      smallint    REFERENCES stations (id),"
+    "   level   log_level   NOT NULL,"
+    "   date    timestamp   with time zone NOT NULL default current_timestamp,"
+    "   msg     varchar(2048),"
+    "   PRIMARY KEY (date, seq)"
+    ") PARTITION BY RANGE (date)",
+    "CREATE TABLE logs_default PARTITION OF " DCP_DBLOGS " DEFAULT",
+    "CREATE INDEX logs_id_date_idx ON " DCP_DBLOGS " (id, date)",
+    // The day partitions of the copied logs and of the days maintainLogs()
+    // creates: it could not, today's logs being in the default partition
+    "DO $$ DECLARE"
+    "   d       date;"
+    "   last    date := (now() AT TIME ZONE 'UTC')::date + "
+    DCPCENTRALSCHEMA_STR(DCPCENTRALSCHEMA_LOGDAYSAHEAD) ";"
+    "BEGIN"
+    "   SELECT coalesce(min(date AT TIME ZONE 'UTC')::date,"
+    "                   (now() AT TIME ZONE 'UTC')::date)"
+    "       INTO d FROM logs_v1;"
+    "   WHILE d <= last LOOP"
+    "       EXECUTE format('CREATE TABLE logs_%s PARTITION OF " DCP_DBLOGS
+    "           FOR VALUES FROM (%L) TO (%L)', to_char(d, 'YYYYMMDD'),"
+    "           d || ' 00:00+00', d + 1 || ' 00:00+00');"
+    "       d := d + 1;"
+    "   END LOOP;"
+    "END $$",
+    "INSERT INTO " DCP_DBLOGS " (id, level, date, msg)"
+    "   SELECT id, level, date, msg FROM logs_v1 ORDER BY date",
+    "DROP TABLE logs_v1",
+    "DO $$ BEGIN"
+    "   IF EXISTS (SELECT 1 FROM pg_roles WHERE rolname='dronedbreader') THEN"
+    "       GRANT SELECT ON " DCP_DBLOGS ", " DCPCENTRALSCHEMA_TABLE
+    "           TO dronedbreader;"
+    "   END IF;"
+    "END $$",
+    NULL
+};
+
+/*
+ * Version 3: 16-bit ids for the DCP v2 stations and sessions, the version
+ * each station speaks.
+ * */
+static const char* const migrationV3[] = {
+    "ALTER SEQUENCE stations_id_seq MAXVALUE 32767",
+    "ALTER SEQUENCE sessions_id_seq MAXVALUE 32767",
+    "ALTER TABLE " DCP_DBSTATIONS
+    "   ADD COLUMN protocol smallint NOT NULL DEFAULT 1",
+    NULL
+};
+
+/*
+ * Version 4: a station can be deleted with its video servers, its logs
+ * being kept without it.
+ * */
+static const char* const migrationV4[] = {
+    "ALTER TABLE " DCP_DBVIDEOSERVERS " DROP CONSTRAINT videos_id_fkey,"
+    "   ADD CONSTRAINT videos_id_fkey FOREIGN KEY (id)"
+    "   REFERENCES stations (id) ON DELETE CASCADE",
+    "ALTER TABLE " DCP_DBLOGS " DROP CONSTRAINT logs_id_fkey,"
+    "   ADD CONSTRAINT logs_id_fkey FOREIGN KEY (id)"
+    "   REFERENCES stations (id) ON DELETE SET NULL",
+    NULL
+};
+
+// Migration to version i, NULL for the versions create.sql makes
+static const char* const* const migrations[DCPCENTRALSCHEMA_VERSION+1] = {
+    NULL, NULL, migrationV2, migrationV3, migrationV4
+};
+
+static const char* const sqliteMigrationV3[] = {
+    "CREATE TABLE stations_v3 ("
+    "   id      INTEGER PRIMARY KEY CHECK (id>=0 AND id<=32767),"
+    "   type    TEXT    NOT NULL"
+    "           CHECK (type IN ('central', 'command', 'drone')),"
+    "   ip      TEXT    NOT NULL,"
+    "   port    INTEGER CHECK (port>0 AND port<65536),"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp,"
+    "   info    TEXT,"
+    "   protocol INTEGER NOT NULL DEFAULT 1)",
+    "INSERT INTO stations_v3 (id, type, ip, port, date, info)"
+    "   SELECT id, type, ip, port, date, info FROM " DCP_DBSTATIONS,
+    "DROP TABLE " DCP_DBSTATIONS,
+    "ALTER TABLE stations_v3 RENAME TO " DCP_DBSTATIONS,
+    "CREATE TABLE sessions_v3 ("
+    "   id      INTEGER PRIMARY KEY CHECK (id>=1 AND id<=32767),"
+    "   station1 INTEGER NOT NULL REFERENCES stations (id),"
+    "   station2 INTEGER NOT NULL REFERENCES stations (id),"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp)",
+    "INSERT INTO sessions_v3 SELECT id, station1, station2, date FROM "
+    DCP_DBSESSIONS,
+    "DROP TABLE " DCP_DBSESSIONS,
+    "ALTER TABLE sessions_v3 RENAME TO " DCP_DBSESSIONS,
+    "CREATE INDEX sessions_station1_idx ON " DCP_DBSESSIONS
+    "   (station1, station2, id)",
+    "CREATE INDEX sessions_station2_idx ON " DCP_DBSESSIONS
+    "   (station2, station1, id)",
+    NULL
+};
+
+// SQLite databases start at DCPCENTRALSCHEMA_SQLITEFIRST. Foreign keys
+// are not enforced (PRAGMA foreign_keys is off): version 4 has no step
+static const char* const* const
+        sqliteMigrations[DCPCENTRALSCHEMA_VERSION+1] = {
+    NULL, NULL, NULL, sqliteMigrationV3, NULL
+};
+
+/*
+ * Latest version for SQLite, the counterpart of Database/create.sql.
+ * */
+static const char* const sqliteSchema[] = {
+    "PRAGMA journal_mode=WAL",
+    "CREATE TABLE " DCP_DBSTATIONS " ("
+    "   id      INTEGER PRIMARY KEY CHECK (id>=0 AND id<=32767),"
+    "   type    TEXT    NOT NULL"
+    "           CHECK (type IN ('central', 'command', 'drone')),"
+    "   ip      TEXT    NOT NULL,"
+    "   port    INTEGER CHECK (port>0 AND port<65536),"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp,"
+    "   info    TEXT,"
+    "   protocol INTEGER NOT NULL DEFAULT 1)",
+    "CREATE TABLE " DCP_DBVIDEOSERVERS " ("
+    "   id      INTEGER PRIMARY KEY"
+    "           REFERENCES stations (id) ON DELETE CASCADE,"
+    "   videos  TEXT    NOT NULL)",
+    "CREATE TABLE " DCP_DBSESSIONS " ("
+    "   id      INTEGER PRIMARY KEY CHECK (id>=1 AND id<=32767),"
+    "   station1 INTEGER NOT NULL REFERENCES stations (id),"
+    "   station2 INTEGER NOT NULL REFERENCES stations (id),"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp)",
+    "CREATE INDEX sessions_station1_idx ON " DCP_DBSESSIONS
+    "   (station1, station2, id)",
+    "CREATE INDEX sessions_station2_idx ON " DCP_DBSESSIONS
+    "   (station2, station1, id)",
+    "CREATE TABLE " DCP_DBLOGS " ("
+    "   seq     INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "   id      INTEGER REFERENCES stations (id) ON DELETE SET NULL,"
+    "   level   TEXT    NOT NULL"
+    "           CHECK (level IN ('info', 'warning', 'critical', 'fatal')),"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp,"
+    "   msg     TEXT)",
+    "CREATE INDEX logs_id_date_idx ON " DCP_DBLOGS " (id, date)",
+    "CREATE INDEX logs_date_idx ON " DCP_DBLOGS " (date)",
+    "CREATE TABLE " DCPCENTRALSCHEMA_TABLE " ("
+    "   version INTEGER PRIMARY KEY,"
+    "   date    TEXT    NOT NULL DEFAULT current_timestamp)",
+    NULL
+};
+
+bool DCPCentralSchema::exec(QSqlQuery &query, const QString &sql)
+{
+    if(query.exec(sql))
+        return true;
+
+    DCPLOG_CRITICAL("Schema: " << sql << ": "
+                    << query.lastError().databaseText());
+    return false;
+}
+
+bool DCPCentralSchema::isSQLite(QSqlDatabase db)
+{
+    return db.driverName() == "QSQLITE";
+}
+
+/*
+ * Settings of each connection. The registry is written behind, a commit
+ * lost to a power cut is acceptable: no fsync at every commit.
+ * */
+void DCPCentralSchema::configure(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+
+    if(!DCPCentralSchema::isSQLite(db))
+        return;
+
+    DCPCentralSchema::exec(query, "PRAGMA synchronous=NORMAL");
+    DCPCentralSchema::exec(query, "PRAGMA busy_timeout=5000");
+}
+
+bool DCPCentralSchema::execAll(QSqlDatabase db, const char* const *sql)
+{
+    QSqlQuery query(db);
+
+    for( ; *sql ; ++sql)
+    {
+        if(!DCPCentralSchema::exec(query, *sql))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * 0 for an empty database, 1 for the schema which predates versioning.
+ * */
+int DCPCentralSchema::version(QSqlDatabase db)
+{
+    QStringList tables = db.tables();
+    QSqlQuery query(db);
+
+    if(tables.contains(DCPCENTRALSCHEMA_TABLE))
+    {
+        if(query.exec("SELECT max(version) FROM " DCPCENTRALSCHEMA_TABLE) &&
+           query.next())
+            return query.value(0).toInt();
+        return -1;
+    }
+
+    return tables.contains(DCP_DBSTATIONS) ? 1 : 0;
+}
+
+bool DCPCentralSchema::migrate(QSqlDatabase db)
+{
+    int version = DCPCentralSchema::version(db);
+    const char* const* const *steps = migrations;
+    const char* const *step;
+
+    if(version < 0)
+        return false;
+    if(version == 0 && DCPCentralSchema::isSQLite(db))
+    {
+        QSqlQuery query(db);
+
+        // Outside of the transaction: the journal mode can not change in one
+        DCPLOG_INFO("Schema: creating version " << DCPCENTRALSCHEMA_VERSION);
+        if(!DCPCentralSchema::execAll(db, sqliteSchema))
+            return false;
+        query.prepare("INSERT INTO " DCPCENTRALSCHEMA_TABLE " (version)"
+                      " VALUES (?)");
+        query.bindValue(0, DCPCENTRALSCHEMA_VERSION);
+        return query.exec();
+    }
+    if(version == 0)
+    {
+        DCPLOG_CRITICAL("Schema: empty database, run Database/create.sql");
+        return false;
+    }
+    if(version > DCPCENTRALSCHEMA_VERSION)
+    {
+        DCPLOG_CRITICAL("Schema: database version " << version
+                        << " is newer than " << DCPCENTRALSCHEMA_VERSION);
+        return false;
+    }
+
+    if(DCPCentralSchema::isSQLite(db))
+    {
+        if(version < DCPCENTRALSCHEMA_SQLITEFIRST)
+        {
+            DCPLOG_CRITICAL("Schema: no migration for SQLite databases"
+                            " older than version "
+                            << DCPCENTRALSCHEMA_SQLITEFIRST);
+            return false;
+        }
+        steps = sqliteMigrations;
+    }
+
+    for(++version ; version<=DCPCENTRALSCHEMA_VERSION ; ++version)
+    {
+        QSqlQuery query(db);
+
+        DCPLOG_INFO("Schema: migrating to version " << version);
+        if(!db.transaction())
+            return false;
+        for(step=steps[version] ; step && *step ; ++step)
+        {
+            if(!DCPCentralSchema::exec(query, *step))
+            {
+                db.rollback();
+                return false;
+            }
+        }
+        query.prepare("INSERT INTO " DCPCENTRALSCHEMA_TABLE " (version)"
+                      " VALUES (?)");
+        query.bindValue(0, version);
+        if(!query.exec() || !db.commit())
+        {
+            DCPLOG_CRITICAL("Schema: could not record version " << version
+                            << ": " << query.lastError().databaseText());
+            db.rollback();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Create the partitions of today and of the next DCPCENTRALSCHEMA_LOGDAYSAHEAD
+ * days, drop the ones older than retentionDays and purge the default
+ * partition likewise. SQLite logs are only purged.
+ * */
+bool DCPCentralSchema::maintainLogs(QSqlDatabase db, int retentionDays)
+{
+    QSqlQuery query(db);
+    QDate today = QDateTime::currentDateTimeUtc().date();
+    QDate oldest = today.addDays(-retentionDays);
+    QDate day;
+    QString name;
+    QStringList partitions;
+    bool ok = true;
+
+    if(DCPCentralSchema::isSQLite(db))
+    {
+        if(retentionDays <= 0)
+            return true;
+        query.prepare("DELETE FROM " DCP_DBLOGS " WHERE date < ?");
+        query.bindValue(0, oldest.toString("yyyy-MM-dd"));
+        if(query.exec())
+            return true;
+        DCPLOG_WARNING("Schema: could not purge old logs: "
+                       << query.lastError().databaseText());
+        return false;
+    }
+
+    for(int i=0 ; i<=DCPCENTRALSCHEMA_LOGDAYSAHEAD ; ++i)
+    {
+        day = today.addDays(i);
+        ok &= DCPCentralSchema::exec(query,
+                QString("CREATE TABLE IF NOT EXISTS logs_%1 PARTITION OF "
+                        DCP_DBLOGS " FOR VALUES FROM ('%2 00:00+00')"
+                        " TO ('%3 00:00+00')")
+                .arg(day.toString("yyyyMMdd"))
+                .arg(day.toString("yyyy-MM-dd"))
+                .arg(day.addDays(1).toString("yyyy-MM-dd")));
+    }
+
+    if(retentionDays <= 0)
+        return ok;
+
+    if(!DCPCentralSchema::exec(query,
+            "SELECT c.relname FROM pg_inherits i"
+            " JOIN pg_class c ON c.oid=i.inhrelid"
+            " WHERE i.inhparent='" DCP_DBLOGS "'::regclass"))
+        return false;
+    while(query.next())
+        partitions.append(query.value(0).toString());
+
+    foreach (name, partitions) {
+        day = QDate::fromString(name.mid(5), "yyyyMMdd");
+        if(day.isValid() && day < oldest)
+            ok &= DCPCentralSchema::exec(query, "DROP TABLE " + name);
+    }
+
+    query.prepare("DELETE FROM logs_default WHERE date < ?");
+    query.bindValue(0, oldest.toString("yyyy-MM-dd") + " 00:00+00");
+    if(!query.exec())
+    {
+        DCPLOG_WARNING("Schema: could not purge old logs: "
+                       << query.lastError().databaseText());
+        ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,71 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralschema.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPCENTRALSCHEMA_H
+#define DCPCENTRALSCHEMA_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+/* --- Schema --- */
+#define DCPCENTRALSCHEMA_VERSION        (4)
+#define DCPCENTRALSCHEMA_SQLITEFIRST    (2)     // SQLite support added
+#define DCPCENTRALSCHEMA_TABLE          "schema_version"
+
+/* --- Logs partitions --- */
+#define DCPCENTRALSCHEMA_LOGDAYSAHEAD   (2)     // days created in advance
+#define DCPCENTRALSCHEMA_LOGRETENTION   (30)    // days
+
+// Value of a macro as a string literal, for the SQL
+#define DCPCENTRALSCHEMA_STR(x)         DCPCENTRALSCHEMA_STR_(x)
+#define DCPCENTRALSCHEMA_STR_(x)        #x
+
+
+
+/*
+ * DCP -- Central station database schema.
+ * PostgreSQL: brings the database to DCPCENTRALSCHEMA_VERSION at startup,
+ * one migration per version, each in its own transaction.
+ * Database/create.sql creates the latest version directly. Logs are
+ * partitioned by day: maintainLogs() creates the coming days' partitions
+ * and drops those past the retention.
+ * SQLite: an empty database is given the latest version, in WAL mode.
+ * Later versions have their own migrations, SQLite can not alter a
+ * constraint: the tables are rebuilt. Logs are a plain table,
+ * maintainLogs() deletes those past the retention.
+ * */
+class DCPCentralSchema
+{
+public:
+    static bool isSQLite(QSqlDatabase db);
+    static void configure(QSqlDatabase db);
+
+    static int  version(QSqlDatabase db);
+    static bool migrate(QSqlDatabase db);
+    static bool maintainLogs(QSqlDatabase db, int retentionDays);
+
+private:
+    static bool exec(QSqlQuery &query, const QString &sql);
+    static bool execAll(QSqlDatabase db, const char* const *sql);
+};
+
+#endif // DCPCENTRALSCHEMA_H
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpcentralstorage.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPCENTRALSTORAGE_H
+#define DCPCENTRALSTORAGE_H
+
+#include <QtGlobal>
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+#include <dcpcentralregistry.h>
+
+
+
+/*
+ * DCP -- Central station storage.
+ * Where the registry is loaded from at startup and written behind to.
+ * init() and load() are called once, before start(), from the thread
+ * which created the storage. submit() and submitLog() are thread safe and
+ * never wait for the storage.
+ * A completion is delivered to the submitter's thread by calling its slot
+ *      void member(int statement, const QVariantList &values, bool ok)
+ * with a queued connection, values being the submitted ones. Logs are
+ * completed once stored, by batch:
+ *      void member(int nbLogs, bool ok)
+ * for the submitter's next nbLogs logs, in the order they were submitted.
+ * A log member is kept as given: a string literal.
+ * See DCPCentralDatabase (PostgreSQL, SQLite) and DCPCentralMemoryStorage.
+ * */
+class DCPCentralStorage
+{
+public:
+    enum statement_e {
+        InsertStation, InsertSession, InsertVideoServers, DeleteVideoServers,
+        DeleteSession, DeleteStation, NbStatements
+    };
+
+    virtual ~DCPCentralStorage() {}
+
+    static QString  statementName(int statement);
+
+    // Schema up to date and the central station recorded
+    virtual bool    init(const DCPCentralRegistry::remote_t &central) = 0;
+    virtual bool    load(DCPCentralRegistry *registry) = 0;
+
+    virtual void    start() = 0;
+    virtual void    stop() = 0;
+    virtual void    submit(int statement, const QVariantList &values,
+                           QObject *receiver=NULL, const char *member=NULL) = 0;
+    virtual bool    submitLog(qint16 id, const QString &level,
+                              const QString &msg, QObject *receiver=NULL,
+                              const char *member=NULL) = 0;
+};
+
+#endif // DCPCENTRALSTORAGE_H
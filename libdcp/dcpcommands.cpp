@@ -19,6 +19,9 @@
  * */
 
 #include "dcpcommands.h"
+#include "dcplog.h"
+
+#include <string.h>
 
 /* --- REMOTE TYPES --- */
 #define DCP_REMOTETYPECOMMANDSTATION    ((char)'C')
@@ -35,32 +38,32 @@
 /*
  * DCP -- Ailerons command.
  * */
-DCPCommandAilerons::DCPCommandAilerons(qint8 sessID, qint32 timestamp) :
-    DCPPacket(DCP_CMDAILERON, sessID, timestamp)
+DCPCommandAilerons::DCPCommandAilerons(qint16 sessID, qint32 timestamp) :
+    DCPPacket(DCP_CMDAILERON, sessID, timestamp),
+    aileronRight(0),
+    aileronLeft(0),
+    rudder(0)
 {}
 
-void DCPCommandAilerons::handle(DCPPacketHandlerInterface *handler)
+int DCPCommandAilerons::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandAilerons(this);
-}
+    if(size < 3) return -1;
 
-QByteArray DCPCommandAilerons::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append((char*)&(this->aileronLeft), 1);
-    this->payload.append((char*)&(this->aileronRight), 1);
-    this->payload.append((char*)&(this->rudder), 1);
-    return this->payload;
+    buffer[0] = this->aileronLeft;
+    buffer[1] = this->aileronRight;
+    buffer[2] = this->rudder;
+    return 3;
 }
 
-void DCPCommandAilerons::unbuildPayload()
+bool DCPCommandAilerons::unbuildPayload()
 {
-    if(this->payload.length() != 3) return;
+    if(this->payload.length() != 3) return false;
 
-    char* data          = this->payload.data();
+    const char* data    = this->payload.constData();
     this->aileronLeft   = data[0];
     this->aileronRight  = data[1];
     this->rudder        = data[2];
+    return true;
 }
 
 QString DCPCommandAilerons::toString()
@@ -81,15 +84,10 @@ QString DCPCommandAilerons::toString()
 /*
  * DCP -- Check if remote drone is alive.
  * */
-DCPCommandIsAlive::DCPCommandIsAlive(qint8 sessID, qint32 timestamp) :
+DCPCommandIsAlive::DCPCommandIsAlive(qint16 sessID, qint32 timestamp) :
   DCPPacket(DCP_CMDISALIVE, sessID, timestamp)
 {}
 
-void DCPCommandIsAlive::handle(DCPPacketHandlerInterface *handler)
-{
-    handler->handleCommandIsAlive(this);
-}
-
 QString DCPCommandIsAlive::toString()
 {
     QString str("--- DCPCommandIsAlive ---");
@@ -104,15 +102,10 @@ QString DCPCommandIsAlive::toString()
 /*
  * DCP -- Ack of command.
  * */
-DCPCommandAck::DCPCommandAck(qint8 sessID, qint32 timestamp) :
+DCPCommandAck::DCPCommandAck(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDACK, sessID, timestamp)
 {}
 
-void DCPCommandAck::handle(DCPPacketHandlerInterface *handler)
-{
-    handler->handleCommandAck(this);
-}
-
 QString DCPCommandAck::toString()
 {
     QString str("--- DCPCommandAck ---");
@@ -126,30 +119,29 @@ QString DCPCommandAck::toString()
 /*
  * DCP -- Throttle.
  * */
-DCPCommandThrottle::DCPCommandThrottle(qint8 sessID, qint32 timestamp) :
-    DCPPacket(DCP_CMDTHROTTLE, sessID, timestamp)
+DCPCommandThrottle::DCPCommandThrottle(qint16 sessID, qint32 timestamp) :
+    DCPPacket(DCP_CMDTHROTTLE, sessID, timestamp),
+    motor(0),
+    throttle(0)
 {}
 
-void DCPCommandThrottle::handle(DCPPacketHandlerInterface *handler)
+int DCPCommandThrottle::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandThrottle(this);
-}
+    if(size < 2) return -1;
 
-QByteArray DCPCommandThrottle::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append((char)this->motor);
-    this->payload.append((char)this->throttle);
-    return this->payload;
+    buffer[0] = this->motor;
+    buffer[1] = this->throttle;
+    return 2;
 }
 
-void DCPCommandThrottle::unbuildPayload()
+bool DCPCommandThrottle::unbuildPayload()
 {
-    if(this->payload.length() != 2) return;
+    if(this->payload.length() != 2) return false;
 
-    char* data      = this->payload.data();
+    const char* data = this->payload.constData();
     this->motor     = data[0];
     this->throttle  = data[1];
+    return true;
 }
 
 QString DCPCommandThrottle::toString()
@@ -169,27 +161,47 @@ QString DCPCommandThrottle::toString()
 /*
  * DCP -- Set session ID.
  * */
-DCPCommandSetSessID::DCPCommandSetSessID(qint8 sessID, qint32 timestamp) :
-    DCPPacket(DCP_CMDSETSESSID, sessID, timestamp)
+DCPCommandSetSessID::DCPCommandSetSessID(qint16 sessID, qint32 timestamp) :
+    DCPPacket(DCP_CMDSETSESSID, sessID, timestamp),
+    peerVersion(DCP_VERSION1)
 {}
 
-void DCPCommandSetSessID::handle(DCPPacketHandlerInterface *handler)
+int DCPCommandSetSessID::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandSetSessID(this);
-}
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(size < 3) return -1;
 
-QByteArray DCPCommandSetSessID::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append((char)this->droneSessId);
-    return this->payload;
+        buffer[0] = (char)((this->droneSessId>>8) & 0xFF);
+        buffer[1] = (char)(this->droneSessId & 0xFF);
+        buffer[2] = this->peerVersion;
+        return 3;
+    }
+
+    if(size < 1) return -1;
+
+    buffer[0] = this->droneSessId;
+    return 1;
 }
 
-void DCPCommandSetSessID::unbuildPayload()
+bool DCPCommandSetSessID::unbuildPayload()
 {
-    if(this->payload.length() != 1) return;
+    const char* data = this->payload.constData();
 
-    this->droneSessId   = this->payload.at(0);
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(this->payload.length() != 3) return false;
+
+        this->droneSessId   = (qint16)(((quint8)data[0]<<8) | (quint8)data[1]);
+        this->peerVersion   = data[2];
+        return true;
+    }
+
+    if(this->payload.length() != 1) return false;
+
+    this->droneSessId   = data[0];
+    this->peerVersion   = DCP_VERSION1;
+    return true;
 }
 
 QString DCPCommandSetSessID::toString()
@@ -199,6 +211,7 @@ QString DCPCommandSetSessID::toString()
     text << endl;
     text << DCPPacket::toString();
     text << "Drone Session Id: " << this->droneSessId << endl;
+    text << "Peer Version: " << (int)this->peerVersion << endl;
 
     return str;
 }
@@ -206,29 +219,29 @@ QString DCPCommandSetSessID::toString()
 /*
  * DCP -- Hello From Remote.
  * */
-DCPCommandHelloFromRemote::DCPCommandHelloFromRemote(qint8 sessID, qint32 timestamp) :
+DCPCommandHelloFromRemote::DCPCommandHelloFromRemote(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDHELLOFROMREMOTE, sessID, timestamp),
     type(DCP_REMOTETYPENOTSET)
 {}
 
-void DCPCommandHelloFromRemote::handle(
-        DCPPacketHandlerInterface *handler)
+int DCPCommandHelloFromRemote::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandHelloFromRemote(this);
-}
+    int len = this->descriptionUtf8.length();
+    if(size < 1+len) return -1;
 
-QByteArray DCPCommandHelloFromRemote::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append(this->type);
-    this->payload.append(this->description.toUtf8());
-    return this->payload;
+    buffer[0] = this->type;
+    memcpy(buffer+1, this->descriptionUtf8.constData(), len);
+    return 1+len;
 }
 
-void DCPCommandHelloFromRemote::unbuildPayload()
+bool DCPCommandHelloFromRemote::unbuildPayload()
 {
+    if(this->payload.length() < 1) return false;
+
     this->type          = this->payload.at(0);
-    this->description   = QString::fromUtf8(this->payload.data()+1);
+    this->description   = QString::fromUtf8(this->payload.constData()+1,
+                                            this->payload.length()-1);
+    return true;
 }
 
 QString DCPCommandHelloFromRemote::toString()
@@ -292,30 +305,48 @@ DCPCommandHelloFromRemote::remoteType DCPCommandHelloFromRemote::getRemoteType()
  * DCP -- Hello From CommandStation.
  * */
 DCPCommandHelloFromCentralStation::DCPCommandHelloFromCentralStation(
-        qint8 sessID, qint32 timestamp) :
+        qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDHELLOFROMCENTRAL, sessID, timestamp)
 {}
 
-void DCPCommandHelloFromCentralStation::handle(
-        DCPPacketHandlerInterface *handler)
+int DCPCommandHelloFromCentralStation::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandHelloFromCentral(this);
-}
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(size < 4) return -1;
 
-QByteArray DCPCommandHelloFromCentralStation::buildPayload()
-{
-    this->payload.clear();
-    quint8 data = (quint8)((this->sessIdCentralStation & 0x0F)<<4 |
-                 (this->IdRemote & 0x0F));
-    this->payload.append((char)data);
+        buffer[0] = (char)((this->sessIdCentralStation>>8) & 0xFF);
+        buffer[1] = (char)(this->sessIdCentralStation & 0xFF);
+        buffer[2] = (char)((this->IdRemote>>8) & 0xFF);
+        buffer[3] = (char)(this->IdRemote & 0xFF);
+        return 4;
+    }
 
-    return this->payload;
+    if(size < 1) return -1;
+
+    buffer[0] = (char)((this->sessIdCentralStation & 0x0F)<<4 |
+                       (this->IdRemote & 0x0F));
+    return 1;
 }
 
-void DCPCommandHelloFromCentralStation::unbuildPayload()
+bool DCPCommandHelloFromCentralStation::unbuildPayload()
 {
-    this->sessIdCentralStation  = (qint8)((this->payload.at(0)>>4) & 0x0F);
-    this->IdRemote              = (qint8)(this->payload.at(0) & 0x0F);
+    const quint8* data = (const quint8*)this->payload.constData();
+
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(this->payload.length() != 4) return false;
+
+        this->sessIdCentralStation  = (qint16)((data[0]<<8) | data[1]);
+        this->IdRemote              = (qint16)((data[2]<<8) | data[3]);
+        return true;
+    }
+
+    if(this->payload.length() != 1) return false;
+
+    this->sessIdCentralStation  = (qint16)((data[0]>>4) & 0x0F);
+    this->IdRemote              = (qint16)(data[0] & 0x0F);
+    return true;
 }
 
 QString DCPCommandHelloFromCentralStation::toString()
@@ -337,29 +368,29 @@ QString DCPCommandHelloFromCentralStation::toString()
 /*
  * DCP -- Log
  * */
-DCPCommandLog::DCPCommandLog(qint8 sessID, qint32 timestamp) :
+DCPCommandLog::DCPCommandLog(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDLOG, sessID, timestamp),
     level(DCP_LOGLEVELINFO)
 {}
 
-void DCPCommandLog::handle(
-        DCPPacketHandlerInterface *handler)
+int DCPCommandLog::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandLog(this);
-}
+    int len = this->msgUtf8.length();
+    if(size < 1+len) return -1;
 
-QByteArray DCPCommandLog::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append(this->level);
-    this->payload.append(this->msg.toUtf8());
-    return this->payload;
+    buffer[0] = this->level;
+    memcpy(buffer+1, this->msgUtf8.constData(), len);
+    return 1+len;
 }
 
-void DCPCommandLog::unbuildPayload()
+bool DCPCommandLog::unbuildPayload()
 {
+    if(this->payload.length() < 1) return false;
+
     this->level = this->payload.at(0);
-    this->msg   = QString::fromUtf8(this->payload.data()+1);
+    this->msg   = QString::fromUtf8(this->payload.constData()+1,
+                                    this->payload.length()-1);
+    return true;
 }
 
 QString DCPCommandLog::toString()
@@ -435,15 +466,10 @@ DCPCommandLog::logLevel DCPCommandLog::getLogLevel()
 /*
  * DCP -- Bye.
  * */
-DCPCommandBye::DCPCommandBye(qint8 sessID, qint32 timestamp) :
+DCPCommandBye::DCPCommandBye(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDBYE, sessID, timestamp)
 {}
 
-void DCPCommandBye::handle(DCPPacketHandlerInterface *handler)
-{
-    handler->handleCommandBye(this);
-}
-
 QString DCPCommandBye::toString()
 {
     QString str("--- DCPCommandBye ---");
@@ -457,27 +483,43 @@ QString DCPCommandBye::toString()
 /*
  * DCP -- Connect to Drone.
  * */
-DCPCommandConnectToDrone::DCPCommandConnectToDrone(qint8 sessID, qint32 timestamp) :
+DCPCommandConnectToDrone::DCPCommandConnectToDrone(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDCONNECTTODRONE, sessID, timestamp)
 {}
 
-void DCPCommandConnectToDrone::handle(DCPPacketHandlerInterface *handler)
+int DCPCommandConnectToDrone::encodePayload(char *buffer, int size)
 {
-    handler->handleCommandConnectToDrone(this);
-}
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(size < 2) return -1;
 
-QByteArray DCPCommandConnectToDrone::buildPayload()
-{
-    this->payload.clear();
-    this->payload.append((char)this->droneId);
-    return this->payload;
+        buffer[0] = (char)((this->droneId>>8) & 0xFF);
+        buffer[1] = (char)(this->droneId & 0xFF);
+        return 2;
+    }
+
+    if(size < 1) return -1;
+
+    buffer[0] = this->droneId;
+    return 1;
 }
 
-void DCPCommandConnectToDrone::unbuildPayload()
+bool DCPCommandConnectToDrone::unbuildPayload()
 {
-    if(this->payload.length() != 1) return;
+    const quint8* data = (const quint8*)this->payload.constData();
+
+    if(this->getVersion() >= DCP_VERSION2)
+    {
+        if(this->payload.length() != 2) return false;
+
+        this->droneId = (qint16)((data[0]<<8) | data[1]);
+        return true;
+    }
+
+    if(this->payload.length() != 1) return false;
 
     this->droneId = this->payload.at(0);
+    return true;
 }
 
 QString DCPCommandConnectToDrone::toString()
@@ -496,15 +538,10 @@ QString DCPCommandConnectToDrone::toString()
 /*
  * DCP -- Discconnect / Kill session.
  * */
-DCPCommandDisconnect::DCPCommandDisconnect(qint8 sessID, qint32 timestamp) :
+DCPCommandDisconnect::DCPCommandDisconnect(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDDISCONNECT, sessID, timestamp)
 {}
 
-void DCPCommandDisconnect::handle(DCPPacketHandlerInterface *handler)
-{
-    handler->handleCommandDisconnect(this);
-}
-
 QString DCPCommandDisconnect::toString()
 {
     QString str("--- DCPCommandDisconnect ---");
@@ -518,27 +555,35 @@ QString DCPCommandDisconnect::toString()
 /*
  * DCP -- Declare video servers.
  * */
-DCPCommandVideoServers::DCPCommandVideoServers(qint8 sessID, qint32 timestamp) :
+DCPCommandVideoServers::DCPCommandVideoServers(qint16 sessID, qint32 timestamp) :
     DCPPacket(DCP_CMDVIDEOSERVERS, sessID, timestamp)
 {}
 
-void DCPCommandVideoServers::handle(DCPPacketHandlerInterface *handler)
+bool DCPCommandVideoServers::addVideoUrl(QUrl url)
 {
-    handler->handleCommandVideoServers(this);
+    if(!url.isValid()) return false;
+
+    this->urls.append(url.toString());
+    this->urlsUtf8 = this->getRawUrlList().toUtf8();
+    return true;
 }
 
-QByteArray DCPCommandVideoServers::buildPayload()
+int DCPCommandVideoServers::encodePayload(char *buffer, int size)
 {
-    this->payload.clear();
-    this->payload.append(
-                this->urls.join(QChar(DCP_VIDEOSERVERSSEPARATOR)).toUtf8());
-    return this->payload;
+    int len = this->urlsUtf8.length();
+    if(size < len) return -1;
+
+    memcpy(buffer, this->urlsUtf8.constData(), len);
+    return len;
 }
 
-void DCPCommandVideoServers::unbuildPayload()
+bool DCPCommandVideoServers::unbuildPayload()
 {
-    this->urls = QString::fromUtf8(this->payload).
+    this->urlsUtf8 = QByteArray(this->payload.constData(),
+                                this->payload.length());
+    this->urls = QString::fromUtf8(this->urlsUtf8).
             split(QChar(DCP_VIDEOSERVERSSEPARATOR));
+    return true;
 }
 
 QString DCPCommandVideoServers::toString()
@@ -553,68 +598,173 @@ QString DCPCommandVideoServers::toString()
 }
 
 
+/*
+ * DCP -- Acks bundle.
+ * */
+DCPCommandAckBundle::DCPCommandAckBundle(qint16 sessID, qint32 timestamp) :
+    DCPPacket(DCP_CMDACKBUNDLE, sessID, timestamp)
+{
+    this->reset(timestamp);
+}
+
+void DCPCommandAckBundle::reset(qint32 first)
+{
+    this->setTimestamp(first);
+    memset(this->acked, 0, sizeof(this->acked));
+    this->span      = 0;
+    this->nbAcked   = 0;
+    this->setAcked(0);
+}
+
+void DCPCommandAckBundle::setAcked(int offset)
+{
+    if(this->isAcked(offset))
+        return;
+
+    this->acked[offset/8] |= (1 << (offset%8));
+    this->nbAcked++;
+    if(offset >= this->span)
+        this->span = offset + 1;
+}
+
+/*
+ * False when the timestamp is before the first one or too far after it:
+ * the bundle has to be sent and a new one started.
+ * */
+bool DCPCommandAckBundle::add(qint32 timestamp)
+{
+    int offset = DCP_TIMESTAMPDIFF(timestamp, this->getTimestamp());
+
+    if(offset < 0 || offset >= DCP_ACKBUNDLESPAN)
+        return false;
+
+    this->setAcked(offset);
+    return true;
+}
+
+int DCPCommandAckBundle::encodePayload(char *buffer, int size)
+{
+    int run = 0, nbBits, nbBytes, bit;
+
+    while(run < 255 && run+1 < this->span && this->isAcked(run+1))
+        run++;
+
+    nbBits  = this->span - (run+1);
+    nbBytes = (nbBits + 7) / 8;
+    if(nbBytes > DCP_ACKBUNDLEMAX || size < 1 + nbBytes) return -1;
+
+    buffer[0] = (char)run;
+    memset(buffer+1, 0, nbBytes);
+    for(bit=0 ; bit<nbBits ; ++bit)
+    {
+        if(this->isAcked(run+1 + bit))
+            buffer[1 + bit/8] |= (char)(1 << (bit%8));
+    }
+    return 1 + nbBytes;
+}
+
+bool DCPCommandAckBundle::unbuildPayload()
+{
+    const quint8* data = (const quint8*)this->payload.constData();
+    int len = this->payload.length(), run, bit;
+
+    this->reset(this->getTimestamp());
+    if(len < 1 || len > 1 + DCP_ACKBUNDLEMAX) return false;
+
+    run = data[0];
+    for(int i=1 ; i<=run ; ++i)
+        this->setAcked(i);
+    for(bit=0 ; bit<(len-1)*8 ; ++bit)
+    {
+        if(data[1 + bit/8] & (1 << (bit%8)))
+            this->setAcked(run+1 + bit);
+    }
+    return true;
+}
+
+QString DCPCommandAckBundle::toString()
+{
+    QString str("--- DCPCommandAckBundle ---");
+    QTextStream text(&str);
+    text << endl;
+    text << DCPPacket::toString();
+    text << "Acked: " << this->nbAcked << " over " << this->span
+         << " msec" << endl;
+
+    return str;
+}
+
+
 /*
  * DCP -- Packet Factory.
  * */
+template<int CMD>
+static void dispatchCommand(DCPPacketHandlerInterface *handler,
+                            DCPPacket *packet)
+{
+    DCPCommandType<CMD>::handle(handler, packet);
+}
+
+static void dispatchNull(DCPPacketHandlerInterface *handler, DCPPacket *packet)
+{
+    handler->handleNull(packet);
+}
+
+template<int CMD>
+void DCPPacketFactory::registerCommand()
+{
+    this->packets[CMD]      = new typename DCPCommandType<CMD>::Type();
+    this->dispatchers[CMD]  = &dispatchCommand<CMD>;
+}
+
+DCPPacketFactory::DCPPacketFactory()
+{
+    for(int i=0 ; i<DCP_NBCOMMANDS ; ++i)
+    {
+        this->packets[i]        = NULL;
+        this->dispatchers[i]    = &dispatchNull;
+    }
+
+    this->registerCommand<DCP_CMDACK>();
+    this->registerCommand<DCP_CMDISALIVE>();
+    this->registerCommand<DCP_CMDAILERON>();
+    this->registerCommand<DCP_CMDTHROTTLE>();
+    this->registerCommand<DCP_CMDSETSESSID>();
+    this->registerCommand<DCP_CMDLOG>();
+    this->registerCommand<DCP_CMDHELLOFROMCENTRAL>();
+    this->registerCommand<DCP_CMDHELLOFROMREMOTE>();
+    this->registerCommand<DCP_CMDBYE>();
+    this->registerCommand<DCP_CMDCONNECTTODRONE>();
+    this->registerCommand<DCP_CMDDISCONNECT>();
+    this->registerCommand<DCP_CMDVIDEOSERVERS>();
+    this->registerCommand<DCP_CMDACKBUNDLE>();
+}
+
+DCPPacketFactory::~DCPPacketFactory()
+{
+    for(int i=0 ; i<DCP_NBCOMMANDS ; ++i)
+        delete this->packets[i];
+}
+
 DCPPacket* DCPPacketFactory::commandPacketFromData(char *data, qint64 len)
 {
-    qint8 cmdID     = (data[0]>>4) & (qint8)0x0F;
+    int cmdID = DCPPacket::commandFromData(data, len);
+
+    if(cmdID < 0)
+        return NULL;
 
-    DCPPacket* packet;
-    switch(cmdID)
+    DCPPacket* packet = this->packets[cmdID];
+    if(!packet)
     {
-    case DCP_CMDAILERON:
-        packet = new DCPCommandAilerons();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDISALIVE:
-        packet = new DCPCommandIsAlive();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDACK:
-        packet = new DCPCommandAck();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDTHROTTLE:
-        packet = new DCPCommandThrottle();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDSETSESSID:
-        packet = new DCPCommandSetSessID();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDHELLOFROMREMOTE:
-        packet = new DCPCommandHelloFromRemote();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDHELLOFROMCENTRAL:
-        packet = new DCPCommandHelloFromCentralStation();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDLOG:
-        packet = new DCPCommandLog();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDBYE:
-        packet = new DCPCommandBye();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDCONNECTTODRONE:
-        packet = new DCPCommandConnectToDrone();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDDISCONNECT:
-        packet = new DCPCommandDisconnect();
-        packet->buildFromData(data, len);
-        break;
-    case DCP_CMDVIDEOSERVERS:
-        packet = new DCPCommandVideoServers();
-        packet->buildFromData(data, len);
-        break;
-    default:
-        qDebug("Bad Packet cmdID.");
+        DCPLOG_DEBUG("Bad Packet cmdID: " << cmdID);
         return NULL;
     }
 
+    // The pooled packet may keep fields of the previous datagram: drop it
+    if(!packet->buildFromData(data, len))
+    {
+        DCPLOG_DEBUG("Bad Packet payload: cmdID=" << cmdID << " len=" << len);
+        return NULL;
+    }
     return packet;
 }
@@ -24,8 +24,11 @@
 #include <QByteArray>
 #include <QList>
 #include <QString>
+#include <QStringList>
+#include <QUrl>
 
 #include <dcppacket.h>
+#include <dcppackethandlerinterface.h>
 
 class DCPPacket;
 class DCPPacketHandlerInterface;
@@ -39,8 +42,7 @@ class DCPCommandAilerons : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandAilerons(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandAilerons(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
     inline void setAileronRight (qint8 value)
             { this->aileronRight = value; }
@@ -52,8 +54,8 @@ public:
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
     qint8   aileronRight, aileronLeft, rudder;
@@ -68,8 +70,7 @@ class DCPCommandIsAlive : public DCPPacket
   friend class DCPPacketFactory;
 
 public:
-    DCPCommandIsAlive(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandIsAlive(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
     QString toString();
 };
@@ -82,8 +83,7 @@ class DCPCommandAck : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandAck(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandAck(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
     QString toString();
 };
@@ -96,14 +96,18 @@ class DCPCommandThrottle : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandThrottle(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandThrottle(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
+
+    inline void setMotor        (qint8 value)
+            { this->motor = value; }
+    inline void setThrottle     (qint8 value)
+            { this->throttle = value; }
 
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
     qint8 motor, throttle;
@@ -117,22 +121,27 @@ class DCPCommandSetSessID : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandSetSessID(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandSetSessID(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
-    inline void setDroneSessId(qint8 id)
+    inline void setDroneSessId(qint16 id)
         { this->droneSessId = id; }
-    inline qint8 getDroneSessId()
+    inline qint16 getDroneSessId()
         { return this->droneSessId; }
+    // Version spoken by the other end of the drone session, v2 only
+    inline void setPeerVersion(qint8 version)
+        { this->peerVersion = version; }
+    inline qint8 getPeerVersion()
+        { return this->peerVersion; }
 
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
-    qint8   droneSessId;
+    qint16  droneSessId;
+    qint8   peerVersion;
 };
 
 
@@ -149,12 +158,12 @@ public:
         remoteTypeDrone, remoteTypeCommandStation, remoteTypeNotSet
     };
 
-    DCPCommandHelloFromRemote(qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPCommandHelloFromRemote(qint16 sessID=DCP_SESSIDCENTRAL,
                               qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
 
     inline void setDescription(QString description)
-        { this->description = description; }
+        { this->description = description;
+          this->descriptionUtf8 = description.toUtf8(); }
     inline QString getDescription()
         { return this->description; }
     void setRemoteType(enum remoteType type);
@@ -163,12 +172,13 @@ public:
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
     char        type;
     QString     description;
+    QByteArray  descriptionUtf8;
 };
 
 /*
@@ -180,28 +190,27 @@ class DCPCommandHelloFromCentralStation : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandHelloFromCentralStation(qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPCommandHelloFromCentralStation(qint16 sessID=DCP_SESSIDCENTRAL,
                                       qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
 
-    inline void setSessIdCentralStation(qint8 sessId)
+    inline void setSessIdCentralStation(qint16 sessId)
         { this->sessIdCentralStation = sessId; }
-    inline void setIdRemote(qint8 id)
+    inline void setIdRemote(qint16 id)
         { this->IdRemote = id; }
-    inline qint8 getSessIdCentralStation()
+    inline qint16 getSessIdCentralStation()
         { return this->sessIdCentralStation; }
-    inline qint8 getIdRemote()
+    inline qint16 getIdRemote()
         { return this->IdRemote; }
 
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
-    qint8       sessIdCentralStation;
-    qint8       IdRemote;
+    qint16      sessIdCentralStation;
+    qint16      IdRemote;
 };
 
 
@@ -218,12 +227,11 @@ public:
         Info, Warning, Critical, Fatal
     };
 
-    DCPCommandLog(qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPCommandLog(qint16 sessID=DCP_SESSIDCENTRAL,
                               qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
 
     inline void setMsg(QString msg)
-        { this->msg = msg; }
+        { this->msg = msg; this->msgUtf8 = msg.toUtf8(); }
     inline QString getMsg()
         { return this->msg; }
     void setLogLevel(enum logLevel level);
@@ -232,12 +240,13 @@ public:
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
     char        level;
     QString     msg;
+    QByteArray  msgUtf8;
 };
 
 
@@ -250,8 +259,7 @@ class DCPCommandBye : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandBye(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandBye(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
     QString toString();
 };
@@ -264,23 +272,22 @@ class DCPCommandConnectToDrone : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandConnectToDrone(qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPCommandConnectToDrone(qint16 sessID=DCP_SESSIDCENTRAL,
                              qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
 
-    inline void setDroneId(qint8 id)
+    inline void setDroneId(qint16 id)
         { this->droneId = id; }
-    inline qint8 getDroneId()
+    inline qint16 getDroneId()
         { return this->droneId; }
 
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
-    qint8 droneId;
+    qint16 droneId;
 };
 
 /*
@@ -291,9 +298,8 @@ class DCPCommandDisconnect : public DCPPacket
     friend class DCPPacketFactory;
 
 public:
-    DCPCommandDisconnect(qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPCommandDisconnect(qint16 sessID=DCP_SESSIDCENTRAL,
                                  qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
 
     QString toString();
 };
@@ -306,8 +312,7 @@ class DCPCommandVideoServers : public DCPPacket
         friend class DCPPacketFactory;
 
 public:
-    DCPCommandVideoServers(qint8 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
-    void handle(DCPPacketHandlerInterface *handler);
+    DCPCommandVideoServers(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
 
     bool addVideoUrl(QUrl url);
     inline QStringList getUrls()
@@ -315,27 +320,134 @@ public:
     inline QString getRawUrlList()
         { return this->urls.join(QChar(DCP_VIDEOSERVERSSEPARATOR)); }
     inline void clearUrls()
-        { this->urls.clear(); }
+        { this->urls.clear(); this->urlsUtf8.clear(); }
 
     QString toString();
 
 protected:
-    QByteArray  buildPayload();
-    void        unbuildPayload();
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
 
 private:
     QStringList urls;
+    QByteArray  urlsUtf8;   // Joined when the list changes, not at encode
+};
+
+/*
+ * DCP -- Acks of several timestamps of a session, see DCP_ACKDELAY.
+ * The packet timestamp is the first one acked, the others are given by
+ * their offset from it. Only DCP_ACKBUNDLESPAN offsets can be added, a
+ * decoded bundle can hold up to maxSpan.
+ * */
+class DCPCommandAckBundle : public DCPPacket
+{
+    friend class DCPPacketFactory;
+
+public:
+    DCPCommandAckBundle(qint16 sessID=DCP_SESSIDCENTRAL, qint32 timestamp=0);
+
+    void        reset(qint32 first);
+    bool        add(qint32 timestamp);
+    inline int  getNbAcked()    { return this->nbAcked; }
+    inline int  getSpan()       { return this->span;    }
+    inline bool isAcked(int offset)
+        { return this->acked[offset/8] & (1 << (offset%8)); }
+
+    QString toString();
+
+protected:
+    int         encodePayload(char *buffer, int size);
+    bool        unbuildPayload();
+
+private:
+    static const int maxSpan = 256 + DCP_ACKBUNDLESPAN;
+
+    void        setAcked(int offset);
+
+    quint8      acked[maxSpan/8];
+    int         span;       // Last offset acked + 1
+    int         nbAcked;
 };
 
 
+/*
+ * DCP -- Command registry.
+ * Maps a DCP_CMD* id to its packet class and to the handler method taking
+ * it, and the class back to its id, at compile time. Unregistered ids have
+ * no Type.
+ * */
+template<int CMD> struct DCPCommandType;
+template<class TYPE> struct DCPCommandID;
+
+#define DCP_REGISTERCOMMAND(CMD, TYPE, HANDLER)                             \
+    template<> struct DCPCommandType<CMD>                                   \
+    {                                                                       \
+        typedef TYPE Type;                                                  \
+        static inline void handle(DCPPacketHandlerInterface *handler,       \
+                                  DCPPacket *packet)                        \
+            { handler->HANDLER(static_cast<TYPE*>(packet)); }               \
+    };                                                                      \
+    template<> struct DCPCommandID<TYPE>                                    \
+    {                                                                       \
+        enum { ID = (quint8)CMD };                                          \
+    };
+
+DCP_REGISTERCOMMAND(DCP_CMDACK,              DCPCommandAck,
+                    handleCommandAck)
+DCP_REGISTERCOMMAND(DCP_CMDISALIVE,          DCPCommandIsAlive,
+                    handleCommandIsAlive)
+DCP_REGISTERCOMMAND(DCP_CMDAILERON,          DCPCommandAilerons,
+                    handleCommandAilerons)
+DCP_REGISTERCOMMAND(DCP_CMDTHROTTLE,         DCPCommandThrottle,
+                    handleCommandThrottle)
+DCP_REGISTERCOMMAND(DCP_CMDSETSESSID,        DCPCommandSetSessID,
+                    handleCommandSetSessID)
+DCP_REGISTERCOMMAND(DCP_CMDLOG,              DCPCommandLog,
+                    handleCommandLog)
+DCP_REGISTERCOMMAND(DCP_CMDHELLOFROMCENTRAL, DCPCommandHelloFromCentralStation,
+                    handleCommandHelloFromCentral)
+DCP_REGISTERCOMMAND(DCP_CMDHELLOFROMREMOTE,  DCPCommandHelloFromRemote,
+                    handleCommandHelloFromRemote)
+DCP_REGISTERCOMMAND(DCP_CMDBYE,              DCPCommandBye,
+                    handleCommandBye)
+DCP_REGISTERCOMMAND(DCP_CMDCONNECTTODRONE,   DCPCommandConnectToDrone,
+                    handleCommandConnectToDrone)
+DCP_REGISTERCOMMAND(DCP_CMDDISCONNECT,       DCPCommandDisconnect,
+                    handleCommandDisconnect)
+DCP_REGISTERCOMMAND(DCP_CMDVIDEOSERVERS,     DCPCommandVideoServers,
+                    handleCommandVideoServers)
+// Expanded into DCPCommandAck by DCPServer before the handlers see them
+DCP_REGISTERCOMMAND(DCP_CMDACKBUNDLE,        DCPCommandAckBundle,
+                    handleNull)
+
+
 /*
  * DCP -- Packet Factory.
+ * Holds one packet per command ID, decoded packets are reused for every
+ * datagram: the returned packet is only valid until the next call. NULL
+ * is returned for datagrams too short for their header or with a
+ * malformed payload.
+ * dispatch() hands a decoded packet to the handler method of its command
+ * through a flat table, without virtual calls on the packet nor RTTI.
  * */
 class DCPPacketFactory
 {
 public:
-    static DCPPacket* commandPacketFromData(char *data, qint64 len);
+    typedef void (*dispatch_f)(DCPPacketHandlerInterface *handler,
+                               DCPPacket *packet);
+
+    DCPPacketFactory();
+    ~DCPPacketFactory();
+
+    DCPPacket*  commandPacketFromData(char *data, qint64 len);
+    inline void dispatch(DCPPacket *packet, DCPPacketHandlerInterface *handler)
+        { this->dispatchers[(int)packet->getCommandID()](handler, packet); }
+
+private:
+    template<int CMD> void registerCommand();
 
+    DCPPacket*  packets[DCP_NBCOMMANDS];
+    dispatch_f  dispatchers[DCP_NBCOMMANDS];
 };
 
 
@@ -0,0 +1,100 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpfailuredetector.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpfailuredetector.h"
+
+#include <math.h>
+
+DCPFailureDetector::DCPFailureDetector(double priorMean, double priorStdDev,
+                                       double acceptablePause) :
+    priorMean(priorMean),
+    priorStdDev(priorStdDev),
+    acceptablePause(acceptablePause)
+{
+    this->reset();
+}
+
+void DCPFailureDetector::reset()
+{
+    this->next          = 0;
+    this->nbSamples     = 0;
+    this->sum           = 0.0;
+    this->sumSquares    = 0.0;
+}
+
+void DCPFailureDetector::arrival(qint64 intervalMsec)
+{
+    if(this->nbSamples == DCPFAILUREDETECTOR_WINDOW)
+    {
+        qint64 oldest = this->samples[this->next];
+        this->sum           -= oldest;
+        this->sumSquares    -= (double)oldest * oldest;
+    }
+    else
+    {
+        this->nbSamples++;
+    }
+
+    this->samples[this->next] = intervalMsec;
+    this->sum           += intervalMsec;
+    this->sumSquares    += (double)intervalMsec * intervalMsec;
+    this->next = (this->next + 1) % DCPFAILUREDETECTOR_WINDOW;
+}
+
+double DCPFailureDetector::getMean() const
+{
+    if(this->nbSamples < DCPFAILUREDETECTOR_MINSAMPLES)
+        return this->priorMean;
+
+    return this->sum / this->nbSamples;
+}
+
+/*
+ * Never below the prior nor a quarter of the mean: a peer which has been
+ * perfectly regular so far must not be suspected at the first late arrival.
+ * */
+double DCPFailureDetector::getStdDev() const
+{
+    double mean, variance;
+
+    if(this->nbSamples < DCPFAILUREDETECTOR_MINSAMPLES)
+        return this->priorStdDev;
+
+    mean = this->sum / this->nbSamples;
+    variance = this->sumSquares / this->nbSamples - mean * mean;
+    return qMax(sqrt(qMax(variance, 0.0)),
+                qMax(mean / 4, this->priorStdDev));
+}
+
+/*
+ * Logistic approximation of the normal CDF, as in Akka and Cassandra:
+ * accurate to 1e-4 and cheap enough to be computed at every tick.
+ * */
+double DCPFailureDetector::phi(qint64 silenceMsec) const
+{
+    double mean = this->getMean() + this->acceptablePause;
+    double stdDev = qMax(this->getStdDev(), 1.0);
+    double y = (silenceMsec - mean) / stdDev;
+    double e = exp(-y * (1.5976 + 0.070566 * y * y));
+
+    if(silenceMsec > mean)
+        return -log10(e / (1.0 + e));
+    return -log10(1.0 - 1.0 / (1.0 + e));
+}
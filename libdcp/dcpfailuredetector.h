@@ -0,0 +1,72 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpfailuredetector.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPFAILUREDETECTOR_H
+#define DCPFAILUREDETECTOR_H
+
+#include <QtGlobal>
+
+/* --- Phi accrual --- */
+#define DCPFAILUREDETECTOR_WINDOW       (64)    // inter-arrivals learnt
+#define DCPFAILUREDETECTOR_MINSAMPLES   (4)     // before, the prior is used
+#define DCPFAILUREDETECTOR_PHISUSPECT   (3.0)   // ~1 chance in 1000 to be wrong
+#define DCPFAILUREDETECTOR_PHIDEAD      (8.0)
+
+
+
+/*
+ * DCP -- Phi accrual failure detector (Hayashibara et al.).
+ * Learns the distribution of the inter-arrival times of one peer over its
+ * last DCPFAILUREDETECTOR_WINDOW arrivals, and gives the suspicion phi of a
+ * silence: -log10 of the probability that the peer is still alive and the
+ * next arrival merely late, with a normal approximation of the distribution.
+ * A jittery or lossy peer has a wide distribution and is suspected later
+ * than a regular one. The acceptable pause is added to the mean, so that a
+ * chatty peer falling quiet is not suspected at once.
+ * Until DCPFAILUREDETECTOR_MINSAMPLES arrivals are known, the prior mean
+ * and standard deviation are used.
+ * */
+class DCPFailureDetector
+{
+public:
+    DCPFailureDetector(double priorMean=1000.0, double priorStdDev=250.0,
+                       double acceptablePause=0.0);
+
+    void        reset();
+    void        arrival(qint64 intervalMsec);
+    double      phi(qint64 silenceMsec) const;
+
+    double      getMean() const;
+    double      getStdDev() const;
+    inline int  getNbSamples() const    { return this->nbSamples;   }
+
+private:
+    double      priorMean;
+    double      priorStdDev;
+    double      acceptablePause;
+
+    qint64      samples[DCPFAILUREDETECTOR_WINDOW];
+    int         next;
+    int         nbSamples;
+    double      sum;
+    double      sumSquares;
+};
+
+#endif // DCPFAILUREDETECTOR_H
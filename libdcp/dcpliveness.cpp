@@ -0,0 +1,264 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpliveness.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcpliveness.h"
+
+/*
+ * Until a station's distribution is learnt, it is expected to answer the
+ * ping of every interval. Half an interval of silence is acceptable.
+ * */
+DCPLiveness::DCPLiveness(int intervalMsec, double phiSuspect, double phiDead) :
+    interval(qMax(1, intervalMsec)),
+    phiSuspect(phiSuspect),
+    phiDead(qMax(phiSuspect, phiDead)),
+    lastSeen(new QAtomicInteger<qint64>[DCPLIVENESS_NBIDS]),
+    owners(new QAtomicInt[DCPLIVENESS_NBIDS]),
+    slot(0),
+    tick(0),
+    nbPings(0),
+    nbSkipped(0),
+    nbSuspicions(0),
+    nbFalseSuspicions(0),
+    nbDeaths(0),
+    nbRevivals(0),
+    sumDetection(0),
+    maxDetection(0)
+{
+    this->clock.start();
+    for(int i=0 ; i<DCPLIVENESS_NBIDS ; ++i)
+    {
+        this->lastSeen[i].store(0);
+        this->owners[i].store(-1);
+    }
+}
+
+DCPLiveness::~DCPLiveness()
+{
+    delete[] this->lastSeen;
+    delete[] this->owners;
+}
+
+/*
+ * Record traffic from station id.
+ * */
+void DCPLiveness::seen(qint16 id, int owner)
+{
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return;
+
+    this->lastSeen[(int)id].store(this->clock.elapsed());
+    // Seldom changes: not written, the cache line stays shared
+    if(this->owners[(int)id].load() != owner)
+        this->owners[(int)id].store(owner);
+}
+
+int DCPLiveness::getOwner(qint16 id)
+{
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return -1;
+
+    return this->owners[(int)id].load();
+}
+
+qint64 DCPLiveness::msecSinceSeen(qint16 id)
+{
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return -1;
+
+    return this->clock.elapsed() - this->lastSeen[(int)id].load();
+}
+
+/*
+ * Slot whose turn it is, one per tick of getTickMsec(), see isTurn().
+ * */
+qint8 DCPLiveness::nextSlot()
+{
+    qint8 slot = this->slot;
+
+    this->slot = (this->slot + 1) % DCPLIVENESS_NBSLOTS;
+    this->tick++;
+    return slot;
+}
+
+/*
+ * turn tells whether it is the station's turn. Sets ping when the station
+ * is to be pinged. Stations are tracked from the first tick they are
+ * updated at.
+ * */
+DCPLiveness::event_e DCPLiveness::update(qint16 id, bool turn, bool *ping)
+{
+    QHash<qint16, station_t>::iterator it;
+    event_e event = None;
+    qint64 now, last, silence;
+    double phi;
+
+    *ping = false;
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return None;
+
+    now     = this->clock.elapsed();
+    last    = this->lastSeen[(int)id].load();
+    silence = now - last;
+
+    QHash<qint16, station_t> &stations = this->stations[DCPLiveness::slotOf(id)];
+    it = stations.find(id);
+    if(it == stations.end())
+    {
+        station_t station;
+        station.detector    = DCPFailureDetector(this->interval,
+                                                 this->interval / 4.0,
+                                                 this->interval / 2.0);
+        station.lastArrival = last;
+        station.lastPing    = now;
+        station.state       = Alive;
+        it = stations.insert(id, station);
+    }
+    else if(last != it->lastArrival)
+    {
+        it->detector.arrival(last - it->lastArrival);
+        it->lastArrival = last;
+        if(it->state == Suspect)
+            this->nbFalseSuspicions++;
+        else if(it->state == Dead)
+            this->nbRevivals++;
+        if(it->state != Alive)
+            event = Revived;
+        it->state = Alive;
+        this->suspects.remove(id);
+    }
+    it->tick = this->tick;
+
+    phi = it->detector.phi(silence);
+    if(it->state == Alive && phi >= this->phiSuspect)
+    {
+        it->state = Suspect;
+        this->nbSuspicions++;
+        it->lastPing = now - this->interval;    // probe at once
+        this->suspects.insert(id);
+        event = Suspected;
+    }
+    if(it->state == Suspect && phi >= this->phiDead)
+    {
+        it->state = Dead;
+        this->suspects.remove(id);
+        this->nbDeaths++;
+        this->sumDetection += silence;
+        this->maxDetection = qMax(this->maxDetection, silence);
+        event = Died;
+    }
+    else if(it->state == Dead &&
+            silence >= (qint64)this->interval * DCPLIVENESS_FORGET)
+    {
+        stations.erase(it);
+        return Forgotten;
+    }
+
+    if(it->state == Suspect)
+        *ping = now - it->lastPing >= this->interval / DCPLIVENESS_PROBES;
+    else if(turn)
+        *ping = silence >= this->interval;
+
+    if(*ping)
+    {
+        it->lastPing = now;
+        this->nbPings++;
+    }
+    else if(turn && it->state == Alive)
+    {
+        this->nbSkipped++;
+    }
+
+    return event;
+}
+
+/*
+ * Stop tracking the stations of slot not updated at this tick, which no
+ * longer exist, so that the next station given one of their ids starts
+ * afresh.
+ * */
+void DCPLiveness::endSlot(qint8 slot)
+{
+    QHash<qint16, station_t> &stations = this->stations[slot];
+    QHash<qint16, station_t>::iterator it = stations.begin();
+
+    while(it != stations.end())
+    {
+        if(it->tick == this->tick)
+        {
+            ++it;
+        }
+        else
+        {
+            this->suspects.remove(it.key());
+            it = stations.erase(it);
+        }
+    }
+}
+
+/*
+ * Copied into ids, which keeps its capacity: update() changes the suspects.
+ * */
+void DCPLiveness::getSuspects(QVector<qint16> *ids)
+{
+    QSet<qint16>::const_iterator it;
+
+    ids->resize(0);
+    for(it=this->suspects.constBegin() ; it!=this->suspects.constEnd() ; ++it)
+        ids->append(*it);
+}
+
+int DCPLiveness::getNbTracked()
+{
+    int nb = 0;
+
+    for(int i=0 ; i<DCPLIVENESS_NBSLOTS ; ++i)
+        nb += this->stations[i].size();
+    return nb;
+}
+
+DCPLiveness::state_e DCPLiveness::getState(qint16 id)
+{
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return Dead;
+
+    const QHash<qint16, station_t> &stations =
+            this->stations[DCPLiveness::slotOf(id)];
+    QHash<qint16, station_t>::const_iterator it = stations.constFind(id);
+
+    if(it == stations.constEnd())
+        return Alive;
+
+    return it->state;
+}
+
+double DCPLiveness::getPhi(qint16 id)
+{
+    if(id < 0 || id >= DCPLIVENESS_NBIDS)
+        return 0.0;
+
+    const QHash<qint16, station_t> &stations =
+            this->stations[DCPLiveness::slotOf(id)];
+    QHash<qint16, station_t>::const_iterator it = stations.constFind(id);
+
+    if(it == stations.constEnd())
+        return 0.0;
+
+    return it->detector.phi(this->msecSinceSeen(id));
+}
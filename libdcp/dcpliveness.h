@@ -0,0 +1,152 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcpliveness.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPLIVENESS_H
+#define DCPLIVENESS_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+#include <dcp.h>
+#include <dcpfailuredetector.h>
+
+/* --- Liveness --- */
+#define DCPLIVENESS_INTERVAL    (3000)  // msec between two pings of a station
+#define DCPLIVENESS_PROBES      (4)     // pings per interval while suspected
+#define DCPLIVENESS_NBSLOTS     (16)    // ticks per interval
+#define DCPLIVENESS_FORGET      (100)   // intervals a dead station is kept
+#define DCPLIVENESS_NBIDS       (DCP_IDMAXV2+1)
+
+
+
+/*
+ * DCP -- Central station liveness tracker.
+ * The interval is split in DCPLIVENESS_NBSLOTS ticks and each tick is the
+ * turn of one slot, station id modulo DCPLIVENESS_NBSLOTS: a silent station
+ * is pinged once per interval, the pings being spread evenly over it
+ * instead of sent in one burst. A station heard from during the last
+ * interval is not pinged.
+ * A tick only updates the stations of its slot and the suspected ones:
+ * each station has a phi accrual failure detector, fed with the arrivals
+ * seen at its updates. It is suspected past phiSuspect, and then updated
+ * at every tick and probed DCPLIVENESS_PROBES times per interval, and dead
+ * past phiDead, until heard from again. A station dead for
+ * DCPLIVENESS_FORGET intervals is forgotten: its id can be given out again
+ * and it has to say hello anew.
+ * seen() also records the owner of the station, the worker its traffic
+ * arrives at (see DCPServerCentral::sendToStation()). seen() and getOwner()
+ * are lock free and may be called from any thread, the rest must be
+ * called from the pinging thread only. Only the stations which exist are
+ * tracked, see endSlot().
+ * */
+class DCPLiveness
+{
+public:
+    enum state_e {
+        Alive, Suspect, Dead
+    };
+    enum event_e {
+        None,
+        Suspected,  // Alive to Suspect
+        Died,       // to Dead
+        Revived,    // heard from while Suspect or Dead
+        Forgotten   // Dead for DCPLIVENESS_FORGET intervals, not tracked
+    };
+
+    DCPLiveness(int intervalMsec=DCPLIVENESS_INTERVAL,
+                double phiSuspect=DCPFAILUREDETECTOR_PHISUSPECT,
+                double phiDead=DCPFAILUREDETECTOR_PHIDEAD);
+    ~DCPLiveness();
+
+    void        seen(qint16 id, int owner=0);
+    int         getOwner(qint16 id);    // -1 until seen
+    qint64      msecSinceSeen(qint16 id);
+
+    /*
+     * Pinging thread, at every tick: nextSlot(), update() the stations of
+     * the slot and the suspects, then endSlot().
+     * */
+    static inline qint8 slotOf(qint16 id)
+        { return id % DCPLIVENESS_NBSLOTS; }
+    inline bool isTurn(qint16 id, qint8 slot)
+        { return DCPLiveness::slotOf(id) == slot; }
+    qint8       nextSlot();
+    event_e     update(qint16 id, bool turn, bool *ping);
+    void        endSlot(qint8 slot);
+    void        getSuspects(QVector<qint16> *ids);
+    state_e     getState(qint16 id);
+    double      getPhi(qint16 id);
+    inline bool isAlive(qint16 id)  { return this->getState(id) != Dead; }
+    int         getNbTracked();
+
+    inline int      getInterval()   { return this->interval;    }
+    inline int      getTickMsec()
+        { return qMax(1, this->interval / DCPLIVENESS_NBSLOTS); }
+
+    // Statistics
+    inline quint64  getNbPings()            { return this->nbPings;         }
+    inline quint64  getNbSkipped()          { return this->nbSkipped;       }
+    inline quint64  getNbSuspicions()       { return this->nbSuspicions;    }
+    inline quint64  getNbFalseSuspicions()  { return this->nbFalseSuspicions;}
+    inline quint64  getNbDeaths()           { return this->nbDeaths;        }
+    inline quint64  getNbRevivals()         { return this->nbRevivals;      }
+    // Silence of the stations when declared dead
+    inline qint64   getMaxDetectionMsec()   { return this->maxDetection;    }
+    inline qint64   getMeanDetectionMsec()
+        { return this->nbDeaths ? this->sumDetection / this->nbDeaths : 0; }
+
+private:
+    typedef struct station_s {
+        DCPFailureDetector  detector;
+        qint64              lastArrival;
+        qint64              lastPing;
+        state_e             state;
+        quint64             tick;       // Last updated at
+    } station_t;
+
+    Q_DISABLE_COPY(DCPLiveness)
+
+    int                     interval;
+    double                  phiSuspect;
+    double                  phiDead;
+    QElapsedTimer           clock;
+    QAtomicInteger<qint64>  *lastSeen;  // by id, msec on clock
+    QAtomicInt              *owners;    // by id
+
+    qint8                   slot;
+    quint64                 tick;
+    QHash<qint16, station_t>    stations[DCPLIVENESS_NBSLOTS];  // by slot
+    QSet<qint16>            suspects;
+
+    quint64                 nbPings;
+    quint64                 nbSkipped;
+    quint64                 nbSuspicions;
+    quint64                 nbFalseSuspicions;
+    quint64                 nbDeaths;
+    quint64                 nbRevivals;
+    qint64                  sumDetection;
+    qint64                  maxDetection;
+};
+
+#endif // DCPLIVENESS_H
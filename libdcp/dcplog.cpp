@@ -0,0 +1,178 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcplog.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcplog.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QCoreApplication>
+
+#include <stdio.h>
+
+static int levelFromEnv()
+{
+    QByteArray env = qgetenv("DCPLOG_LEVEL").toLower();
+
+    if(env == "debug")      return DCPLOG_LEVELDEBUG;
+    if(env == "warning")    return DCPLOG_LEVELWARNING;
+    if(env == "critical")   return DCPLOG_LEVELCRITICAL;
+    if(env == "none")       return DCPLOG_LEVELNONE;
+    return DCPLOG_LEVELINFO;
+}
+
+static const char* levelName(int level)
+{
+    switch(level)
+    {
+    case DCPLOG_LEVELDEBUG:     return "DEBUG";
+    case DCPLOG_LEVELINFO:      return "INFO";
+    case DCPLOG_LEVELWARNING:   return "WARNING";
+    case DCPLOG_LEVELCRITICAL:  return "CRITICAL";
+    default:                    return "?";
+    }
+}
+
+QAtomicInt  DCPLog::level(levelFromEnv());
+DCPLog*     DCPLog::log = NULL;
+static QMutex instanceMutex;
+
+DCPLog::DCPLog() :
+    QThread(),
+    stopping(false),
+    head(0),
+    count(0),
+    nbDropped(0),
+    nbDroppedReported(0)
+{}
+
+DCPLog::~DCPLog()
+{}
+
+DCPLog* DCPLog::instance()
+{
+    instanceMutex.lock();
+    if(!DCPLog::log)
+    {
+        DCPLog::log = new DCPLog();
+        DCPLog::log->start();
+        qAddPostRoutine(DCPLog::shutdown);
+    }
+    instanceMutex.unlock();
+
+    return DCPLog::log;
+}
+
+/*
+ * Write out the pending messages and stop the writer thread.
+ * */
+void DCPLog::shutdown()
+{
+    DCPLog *log;
+
+    instanceMutex.lock();
+    log = DCPLog::log;
+    DCPLog::log = NULL;
+    instanceMutex.unlock();
+
+    if(!log)
+        return;
+
+    log->mutex.lock();
+    log->stopping = true;
+    log->notEmpty.wakeOne();
+    log->mutex.unlock();
+
+    log->wait();
+    delete log;
+}
+
+void DCPLog::write(int level, const QString &msg)
+{
+    entry_s *entry;
+
+    this->mutex.lock();
+    if(this->stopping || this->count == DCPLOG_RINGSIZE)
+    {
+        this->nbDropped++;
+        this->mutex.unlock();
+        return;
+    }
+
+    entry = &(this->ring[(this->head + this->count) % DCPLOG_RINGSIZE]);
+    entry->level    = level;
+    entry->date     = QDateTime::currentMSecsSinceEpoch();
+    entry->msg      = msg;
+    this->count++;
+
+    this->notEmpty.wakeOne();
+    this->mutex.unlock();
+}
+
+quint64 DCPLog::getNbDropped()
+{
+    quint64 nb;
+
+    this->mutex.lock();
+    nb = this->nbDropped;
+    this->mutex.unlock();
+
+    return nb;
+}
+
+void DCPLog::run()
+{
+    QTextStream err(stderr);
+    QString msg;
+    qint64 date;
+    int level;
+    quint64 dropped;
+
+    this->mutex.lock();
+    for(;;)
+    {
+        while(this->count == 0 && !this->stopping)
+            this->notEmpty.wait(&(this->mutex));
+
+        // Stopping and everything written out
+        if(this->count == 0)
+            break;
+
+        level   = this->ring[this->head].level;
+        date    = this->ring[this->head].date;
+        msg.swap(this->ring[this->head].msg);
+        this->head = (this->head + 1) % DCPLOG_RINGSIZE;
+        this->count--;
+
+        dropped = this->nbDropped - this->nbDroppedReported;
+        this->nbDroppedReported = this->nbDropped;
+        this->mutex.unlock();
+
+        // Formatting and output are done without holding the ring
+        if(dropped)
+            err << "[dcp] " << dropped << " log message(s) dropped" << endl;
+        err << QDateTime::fromMSecsSinceEpoch(date).toString(
+                   "yyyy-MM-dd hh:mm:ss.zzz")
+            << " " << levelName(level) << " " << msg << endl;
+        msg.clear();
+
+        this->mutex.lock();
+    }
+    this->mutex.unlock();
+}
@@ -0,0 +1,122 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcplog.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPLOG_H
+#define DCPLOG_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QTextStream>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+/* --- Log levels --- */
+#define DCPLOG_LEVELDEBUG       (0)
+#define DCPLOG_LEVELINFO        (1)
+#define DCPLOG_LEVELWARNING     (2)
+#define DCPLOG_LEVELCRITICAL    (3)
+#define DCPLOG_LEVELNONE        (4)
+
+/* --- Compile time gate: lower levels are not compiled at all --- */
+#ifndef DCPLOG_MINLEVEL
+#define DCPLOG_MINLEVEL         DCPLOG_LEVELDEBUG
+#endif
+
+/* --- Ring buffer --- */
+#define DCPLOG_RINGSIZE         (1024)  // messages
+
+/*
+ * Log a message built with QTextStream operators, e.g.
+ *      DCPLOG_DEBUG("Got packet:" << endl << packet->toString());
+ * The arguments are only evaluated if the level is enabled, so a disabled
+ * level costs one integer comparison.
+ * */
+#define DCPLOG(level, args)                                                 \
+    do {                                                                    \
+        if((level) >= DCPLOG_MINLEVEL && DCPLog::isEnabled(level))          \
+        {                                                                   \
+            QString __dcplogmsg;                                            \
+            QTextStream __dcplogstream(&__dcplogmsg);                       \
+            __dcplogstream << args;                                         \
+            __dcplogstream.flush();                                         \
+            DCPLog::instance()->write((level), __dcplogmsg);                \
+        }                                                                   \
+    } while(0)
+
+#define DCPLOG_DEBUG(args)      DCPLOG(DCPLOG_LEVELDEBUG, args)
+#define DCPLOG_INFO(args)       DCPLOG(DCPLOG_LEVELINFO, args)
+#define DCPLOG_WARNING(args)    DCPLOG(DCPLOG_LEVELWARNING, args)
+#define DCPLOG_CRITICAL(args)   DCPLOG(DCPLOG_LEVELCRITICAL, args)
+
+
+
+/*
+ * DCP -- Asynchronous log writer.
+ * Messages are queued in a bounded ring buffer and written to stderr by a
+ * background thread. When the ring is full, messages are dropped and
+ * counted instead of blocking the caller.
+ * The runtime level defaults to info, or to the DCPLOG_LEVEL environment
+ * variable (debug, info, warning, critical or none).
+ * */
+class DCPLog : public QThread
+{
+public:
+    static DCPLog*      instance();
+    static void         shutdown();
+
+    static inline bool  isEnabled(int level)
+        { return level >= DCPLog::level.load(); }
+    static inline void  setLevel(int level)
+        { DCPLog::level.store(level); }
+    static inline int   getLevel()
+        { return DCPLog::level.load(); }
+
+    void                write(int level, const QString &msg);
+    quint64             getNbDropped();
+
+protected:
+    void run();
+
+private:
+    DCPLog();
+    ~DCPLog();
+
+    struct entry_s {
+        int     level;
+        qint64  date;       // msec since epoch
+        QString msg;
+    };
+
+    static QAtomicInt   level;
+    static DCPLog       *log;
+
+    QMutex              mutex;
+    QWaitCondition      notEmpty;
+    bool                stopping;
+    entry_s             ring[DCPLOG_RINGSIZE];
+    int                 head;       // next entry to write out
+    int                 count;      // entries in the ring
+    quint64             nbDropped;
+    quint64             nbDroppedReported;
+};
+
+#endif // DCPLOG_H
@@ -20,89 +20,122 @@
 
 #include "dcppacket.h"
 
-DCPPacket::DCPPacket(qint8 cmdID, qint8 sessID, qint32 timestamp) :
-    QTimer(),
-    nbResend(0),
+DCPPacket::DCPPacket(quint8 cmdID, qint16 sessID, qint32 timestamp) :
     __needResend(true),
     cmdID(cmdID),
     sessID(sessID),
-    timestamp(timestamp)
+    timestamp(DCP_TIMESTAMP(timestamp)),
+    version(DCP_VERSION1),
+    portDst(0)
+{}
+
+/*
+ * Command ID of the datagram, -1 if it is too short for its header.
+ * */
+int DCPPacket::commandFromData(const char *data, int len)
 {
-    this->setSingleShot(true);
-    this->setInterval(DCP_TIMEOUT);
+    if(len >= DCP_HEADERSIZEV2 && (quint8)data[0] == DCP_MAGICV2)
+        return (quint8)data[1];
+    if(len >= DCP_HEADERSIZE)
+        return (data[0]>>4) & 0x0F;
+    return -1;
 }
 
-void DCPPacket::buildFromData(char *data, int len)
+/*
+ * Decode header and payload, in whichever version they were sent. Returns
+ * false if the datagram is too short for its header or its payload is
+ * malformed.
+ * */
+bool DCPPacket::buildFromData(char *data, int len)
 {
-    this->cmdID = (data[0]>>4) & (qint8)0x0F;
-    this->sessID = (data[0] & (qint8)0x0F);
+    if(len >= DCP_HEADERSIZEV2 && (quint8)data[0] == DCP_MAGICV2)
+    {
+        this->version   = DCP_VERSION2;
+        this->cmdID     = (quint8)data[1];
+        this->sessID    = (qint16)(((quint8)data[2]<<8) | (quint8)data[3]);
+        // Same timestamp and payload layout as v1 from there
+        data   += DCP_HEADERSIZEV2 - DCP_HEADERSIZE;
+        len    -= DCP_HEADERSIZEV2 - DCP_HEADERSIZE;
+    }
+    else if(len >= DCP_HEADERSIZE)
+    {
+        this->version   = DCP_VERSION1;
+        this->cmdID     = (data[0]>>4) & (quint8)0x0F;
+        this->sessID    = (data[0] & (qint8)0x0F);
+    }
+    else
+    {
+        return false;
+    }
+
     this->timestamp =   (qint32) ((qint32)(data[1]<<16)   & (qint32)0xFF0000) |
                         (qint32) ((qint32)(data[2]<<8)    & (qint32)0x00FF00) |
                         (qint32) ((qint32)(data[3])       & (qint32)0x0000FF);
     this->payload = QByteArray::fromRawData(
                 data+DCP_HEADERSIZE, len-DCP_HEADERSIZE);
-    this->unbuildPayload();
-}
-
-QByteArray DCPPacket::buildHeader()
-{
-    char *h = new char[DCP_HEADERSIZE];
-    this->header.clear();
-
-    h[0] = (this->cmdID & 0x0F)<<4 | (this->sessID & 0x0F);
-    h[1] = (quint8)((this->timestamp>>16) & (quint32)0x000000FF);
-    h[2] = (quint8)((this->timestamp>>8) & (quint32)0x000000FF);
-    h[3] = (quint8)(this->timestamp & (quint32)0x000000FF);
-    this->header = QByteArray::fromRawData(h, DCP_HEADERSIZE);
-
-    return this->header;
+    return this->unbuildPayload();
 }
 
-QByteArray DCPPacket::buildPayload()
-{
-    this->payload.clear();
-    return this->payload;
-}
-
-QByteArray* DCPPacket::packetToData()
-{
-    QByteArray *data = new QByteArray();
-
-    this->buildHeader();
-    data->append(this->header.data(), DCP_HEADERSIZE);
-    this->buildPayload();
-    data->append(this->payload.data(), this->getPayloadLength());
-
-    return data;
-}
-
-void DCPPacket::unbuildPayload()
+/*
+ * Write header and payload to buffer. Returns the datagram length, or -1
+ * if it does not fit in size bytes.
+ * */
+int DCPPacket::encode(char *buffer, int size)
 {
-    return;
+    int headerSize, len;
+
+    if(this->version >= DCP_VERSION2)
+    {
+        headerSize = DCP_HEADERSIZEV2;
+        if(size < headerSize)
+            return -1;
+        buffer[0] = (char)DCP_MAGICV2;
+        buffer[1] = (char)this->cmdID;
+        buffer[2] = (char)((this->sessID>>8) & 0xFF);
+        buffer[3] = (char)(this->sessID & 0xFF);
+        buffer[4] = 0;      // Reserved
+        buffer += DCP_HEADERSIZEV2 - DCP_HEADERSIZE;
+    }
+    else
+    {
+        headerSize = DCP_HEADERSIZE;
+        if(size < headerSize)
+            return -1;
+        buffer[0] = (this->cmdID & 0x0F)<<4 | (this->sessID & 0x0F);
+    }
+    buffer[1] = (quint8)((this->timestamp>>16) & (quint32)0x000000FF);
+    buffer[2] = (quint8)((this->timestamp>>8) & (quint32)0x000000FF);
+    buffer[3] = (quint8)(this->timestamp & (quint32)0x000000FF);
+
+    len = this->encodePayload(buffer+DCP_HEADERSIZE, size-headerSize);
+    if(len < 0)
+        return -1;
+
+    return headerSize + len;
 }
 
-
-void DCPPacket::handle(DCPPacketHandlerInterface *handler)
+int DCPPacket::encodePayload(char *buffer, int size)
 {
-    handler->handleNull(this);
+    Q_UNUSED(buffer);
+    Q_UNUSED(size);
+    return 0;
 }
 
-bool DCPPacket::setTimestamp(qint32 timestamp)
+/*
+ * Decode the payload into the fields of the packet. Returns false if it
+ * is malformed: the fields may still hold the previous datagram.
+ * */
+bool DCPPacket::unbuildPayload()
 {
-    if(timestamp > (qint32)0x00FFFFFF)
-        return false;
-    this->timestamp = timestamp;
     return true;
 }
 
-int DCPPacket::getLenght()
-{
-    return DCP_HEADERSIZE + this->getPayloadLength();
-}
-
-int DCPPacket::getPayloadLength()
+/*
+ * Timestamps wrap to 24 bits, see DCP_TIMESTAMPLT to compare them.
+ * */
+void DCPPacket::setTimestamp(qint32 timestamp)
 {
-    return this->payload.length();
+    this->timestamp = DCP_TIMESTAMP(timestamp);
 }
 
 QString DCPPacket::toString()
@@ -111,6 +144,7 @@ QString DCPPacket::toString()
     QTextStream text(&str);
     text << "Addr Dst: " << this->addrDst.toString() << endl;
     text << "Port Dst: " << this->portDst << endl;
+    text << "Version: " << (int)this->version << endl;
     text << "Cmd Id: " << this->cmdID << endl;
     text << "Sess Id: " << this->sessID << endl;
     text << "Timestamp: " << this->timestamp << endl;
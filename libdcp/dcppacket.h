@@ -22,68 +22,72 @@
 #define DCPPACKETINTERFACE_H
 
 #include <QtGlobal>
-#include <QObject>
-#include <QTimer>
 #include <QByteArray>
 #include <QHostAddress>
+#include <QString>
+#include <QTextStream>
 
 #include <dcp.h>
-#include <dcppackethandlerinterface.h>
 
 
 
 
-class DCPPacket : public QTimer
+/*
+ * DCP -- Base packet.
+ * Plain value object: retransmission timers are owned by DCPServer, and
+ * decoded packets are reused by DCPPacketFactory for every datagram.
+ * encode() writes the datagram into a buffer owned by the caller and never
+ * allocates, with the header of the packet's version: a decoded packet
+ * keeps the version it was received in, a new one is v1 until set.
+ * */
+class DCPPacket
 {
-    Q_OBJECT
-
     friend class DCPPacketFactory;
 
 public:
-    DCPPacket(qint8 cmdID=DCP_CMDACK, qint8 sessID=DCP_SESSIDCENTRAL,
+    DCPPacket(quint8 cmdID=DCP_CMDACK, qint16 sessID=DCP_SESSIDCENTRAL,
               qint32 timestamp=0);
-    void    buildFromData(char *data, int len);
+    virtual ~DCPPacket() {}
+    bool    buildFromData(char *data, int len);
 
-    inline qint8        getCommandID()  { return this->cmdID;       }
-    inline qint8        getSessionID()  { return this->sessID;      }
+    static int  commandFromData(const char *data, int len);
+
+    inline quint8       getCommandID()  { return this->cmdID;       }
+    inline qint16       getSessionID()  { return this->sessID;      }
+    inline qint8        getVersion()    { return this->version;     }
     qint32              getTimestamp()  { return this->timestamp;   }
     inline QHostAddress getAddrDst()    { return this->addrDst;     }
     inline quint16      getPortDst()    { return this->portDst;     }
-    int                 getLenght();
     inline bool         needResend()    { return this->__needResend;}
+    inline int          getDelivery()   { return DCP_DELIVERY(this->cmdID); }
 
-    bool            setTimestamp(qint32 timestamp);
+    void            setTimestamp(qint32 timestamp);
+    inline void     setSessionID(qint16 sessID)     { this->sessID = sessID; }
+    inline void     setVersion(qint8 version)       { this->version = version; }
     inline void     setAddrDst(QHostAddress addr)   { this->addrDst = addr; }
     inline void     setPortDst(quint16 port)        { this->portDst = port; }
 
 
-    virtual void    handle(DCPPacketHandlerInterface *handler);
-    DCPPacket*      dataToPacket(char* data, int len);
-    QByteArray*     packetToData();
+    int             encode(char *buffer, int size);
 
     virtual QString toString();
 
-    int         nbResend;
-
 protected:
-    QByteArray  payload;
+    QByteArray  payload;    // Decoded payload, not owned (receive buffer)
     bool        __needResend;
 
 
-    virtual QByteArray  buildPayload();
-    virtual void        unbuildPayload();
-    virtual int         getPayloadLength();
+    virtual int         encodePayload(char *buffer, int size);
+    virtual bool        unbuildPayload();
 
 private:
-    qint8       cmdID;
-    qint8       sessID;
+    quint8      cmdID;
+    qint16      sessID;
     qint32      timestamp;
+    qint8       version;
 
     QHostAddress    addrDst;
     quint16         portDst;
-
-    QByteArray  header;
-    QByteArray  buildHeader();
 };
 
 #endif // DCPPACKETINTERFACE_H
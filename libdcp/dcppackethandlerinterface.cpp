@@ -90,64 +90,72 @@ DCPPacketHandlerInterface::DCPPacketHandlerInterface(DCPServer *server) :
 //{}
 
 
+/*
+ * COMMAND STATION -- Base of the command station handlers
+ * */
+DCPPacketHandlerCommandStation::DCPPacketHandlerCommandStation(
+        DCPServerCommand *command) :
+    DCPPacketHandlerInterface(command),
+    command(command)
+{}
+
+
 /*
  * COMMAND STATION -- Packet Handler for Hello handshake
  * */
 DCPPacketHandlerCommandStationHello::DCPPacketHandlerCommandStationHello(
-        DCPServer *backend) :
-    DCPPacketHandlerInterface(backend)
+        DCPServerCommand *command) :
+    DCPPacketHandlerCommandStation(command)
 {}
 
 void DCPPacketHandlerCommandStationHello::handleNull(DCPPacket *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandAilerons(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandAilerons(
+        DCPCommandAilerons *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandIsAlive(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandIsAlive(
+        DCPCommandIsAlive *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandAck(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandAck(
+        DCPCommandAck *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandThrottle(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandThrottle(
+        DCPCommandThrottle *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandSetSessID(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandSetSessID(
+        DCPCommandSetSessID *packet)
 {}
 
 void DCPPacketHandlerCommandStationHello::handleCommandHelloFromRemote(
-        DCPPacket *packet)
+        DCPCommandHelloFromRemote *packet)
 {}
 
 void DCPPacketHandlerCommandStationHello::handleCommandHelloFromCentral(
-        DCPPacket *packet)
+        DCPCommandHelloFromCentralStation *packet)
 {
-    qint8 sessIdCentral;
-    qint8 IdCommand;
-    DCPServerCommand *command =
-            dynamic_cast<DCPServerCommand*> (this->server);
+    qint16 sessIdCentral;
+    qint16 IdCommand;
     if(packet->getSessionID() == DCP_IDNULL)
     {
         DCPPacket* myHello =
-                command->findInAckQueue(packet->getTimestamp());
+                command->findInAckQueue(packet);
         if(myHello)
         {
             command->removeFromAckQueue(myHello);
 
-            DCPCommandHelloFromCentralStation* hello =
-                    dynamic_cast<DCPCommandHelloFromCentralStation*>(packet);
-            sessIdCentral   = hello->getSessIdCentralStation();
-            IdCommand       = hello->getIdRemote();
+            sessIdCentral   = packet->getSessIdCentralStation();
+            IdCommand       = packet->getIdRemote();
 
-            DCPCommandAck *ack =
-                    new DCPCommandAck(packet->getSessionID());
-            ack->setTimestamp(packet->getTimestamp());
-            ack->setAddrDst(packet->getAddrDst());
-            ack->setPortDst(packet->getPortDst());
-            command->sendPacket(ack);
+            command->sendAck(packet);
 
+            // The central station answers in the version it speaks
             command->setMyId(IdCommand);
+            command->setCentralVersion(packet->getVersion());
             command->setSessionIdCentralStation(sessIdCentral);
             command->setHandler(
                         new DCPPacketHandlerCommandStationNotConnected(command));
@@ -156,20 +164,24 @@ void DCPPacketHandlerCommandStationHello::handleCommandHelloFromCentral(
     }
 }
 
-void DCPPacketHandlerCommandStationHello::handleCommandLog(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandLog(
+        DCPCommandLog *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandBye(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandBye(
+        DCPCommandBye *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandConnectToDrone(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandConnectToDrone(
+        DCPCommandConnectToDrone *packet)
 {}
 
 void DCPPacketHandlerCommandStationHello::handleCommandDisconnect(
-        DCPPacket *packet)
+        DCPCommandDisconnect *packet)
 {}
 
-void DCPPacketHandlerCommandStationHello::handleCommandVideoServers(DCPPacket *packet)
+void DCPPacketHandlerCommandStationHello::handleCommandVideoServers(
+        DCPCommandVideoServers *packet)
 {}
 
 
@@ -177,73 +189,64 @@ void DCPPacketHandlerCommandStationHello::handleCommandVideoServers(DCPPacket *p
  * COMMAND STATION -- Packet Handler Not Connected
  * */
 DCPPacketHandlerCommandStationNotConnected::DCPPacketHandlerCommandStationNotConnected(
-        DCPServer *backend) :
-    DCPPacketHandlerInterface(backend)
+        DCPServerCommand *command) :
+    DCPPacketHandlerCommandStation(command)
 {}
 
 void DCPPacketHandlerCommandStationNotConnected::handleNull(DCPPacket *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandAilerons(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandAilerons(
+        DCPCommandAilerons *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandIsAlive(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandIsAlive(
+        DCPCommandIsAlive *packet)
 {
-    DCPServerCommand *command =
-            dynamic_cast<DCPServerCommand*> (this->server);
-    qint8 packetSessId = packet->getSessionID();
+    qint16 packetSessId = packet->getSessionID();
 
     if(packetSessId == command->getSessionIdCentralStation())
     {
-        DCPCommandAck *ack = new DCPCommandAck(packetSessId);
-        ack->setTimestamp(packet->getTimestamp());
-        ack->setAddrDst(packet->getAddrDst());
-        ack->setPortDst(packet->getPortDst());
-        command->sendPacket(ack);
+        command->sendAck(packet);
     }
 }
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandAck(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandAck(
+        DCPCommandAck *packet)
 {
-    DCPServerCommand *command =
-            dynamic_cast<DCPServerCommand*> (this->server);
-    qint8 packetSessId = packet->getSessionID();
+    qint16 packetSessId = packet->getSessionID();
 
     if(packetSessId == command->getSessionIdDrone() ||
             packetSessId == command->getSessionIdCentralStation())
     {
         command->removeFromAckQueue(
-                    command->findInAckQueue(packet->getTimestamp()) );
+                    command->findInAckQueue(packet) );
     }
 }
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandThrottle(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandThrottle(
+        DCPCommandThrottle *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandSetSessID(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandSetSessID(
+        DCPCommandSetSessID *packet)
 {
-    DCPServerCommand *command =
-            dynamic_cast<DCPServerCommand*> (this->server);
-    DCPCommandSetSessID *sess =
-            dynamic_cast<DCPCommandSetSessID*> (packet);
-    qint8 packetSessId = packet->getSessionID();
+    qint16 packetSessId = packet->getSessionID();
+    DCPPacket *acked;
     DCPCommandConnectToDrone *conn;
 
     if(packetSessId == command->getSessionIdCentralStation())
     {
-        conn = dynamic_cast<DCPCommandConnectToDrone*>
-                (command->findInAckQueue(packet->getTimestamp()));
-        if(conn)
+        acked = command->findInAckQueue(packet);
+        if(acked && acked->getCommandID() == DCP_CMDCONNECTTODRONE)
         {
-            command->setSessionIdDrone(sess->getDroneSessId());
+            conn = static_cast<DCPCommandConnectToDrone*> (acked);
+            command->setSessionIdDrone(packet->getDroneSessId());
+            command->setDroneVersion(packet->getPeerVersion());
             command->setDroneId(conn->getDroneId());
             command->removeFromAckQueue(conn);
 
-            DCPCommandAck *ack = new DCPCommandAck(packetSessId);
-            ack->setAddrDst(packet->getAddrDst());
-            ack->setPortDst(packet->getPortDst());
-            ack->setTimestamp(packet->getTimestamp());
-            command->sendPacket(ack);
+            command->sendAck(packet);
 
             command->setHandler(
                         new DCPPacketHandlerCommandStationConnected(command));
@@ -253,68 +256,68 @@ void DCPPacketHandlerCommandStationNotConnected::handleCommandSetSessID(DCPPacke
 }
 
 void DCPPacketHandlerCommandStationNotConnected::handleCommandHelloFromRemote(
-        DCPPacket *packet)
+        DCPCommandHelloFromRemote *packet)
 {}
 
 void DCPPacketHandlerCommandStationNotConnected::handleCommandHelloFromCentral(
-        DCPPacket *packet)
+        DCPCommandHelloFromCentralStation *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandLog(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandLog(
+        DCPCommandLog *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandBye(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandBye(
+        DCPCommandBye *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandConnectToDrone(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandConnectToDrone(
+        DCPCommandConnectToDrone *packet)
 {}
 
 void DCPPacketHandlerCommandStationNotConnected::handleCommandDisconnect(
-        DCPPacket *packet)
+        DCPCommandDisconnect *packet)
 {}
 
-void DCPPacketHandlerCommandStationNotConnected::handleCommandVideoServers(DCPPacket *packet)
+void DCPPacketHandlerCommandStationNotConnected::handleCommandVideoServers(
+        DCPCommandVideoServers *packet)
 {}
 
 /*
  * COMMAND STATION -- Packet Handler Connected
  * */
 DCPPacketHandlerCommandStationConnected::DCPPacketHandlerCommandStationConnected(
-        DCPServer *backend) :
-    DCPPacketHandlerInterface(backend)
+        DCPServerCommand *command) :
+    DCPPacketHandlerCommandStation(command)
 {}
 
 void DCPPacketHandlerCommandStationConnected::handleNull(DCPPacket *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandAilerons(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandAilerons(
+        DCPCommandAilerons *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandIsAlive(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandIsAlive(
+        DCPCommandIsAlive *packet)
 {
-    DCPServerCommand *command =
-            dynamic_cast<DCPServerCommand*> (this->server);
-    qint8 packetSessId = packet->getSessionID();
+    qint16 packetSessId = packet->getSessionID();
 
     if(packetSessId == command->getSessionIdCentralStation() ||
             packetSessId == command->getSessionIdDrone())
     {
-        DCPCommandAck *ack = new DCPCommandAck(packetSessId);
-        ack->setTimestamp(packet->getTimestamp());
-        ack->setAddrDst(packet->getAddrDst());
-        ack->setPortDst(packet->getPortDst());
-        command->sendPacket(ack);
+        command->sendAck(packet);
     }
 }
 
-void DCPPacketHandlerCommandStationConnected::handleCommandAck(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandAck(
+        DCPCommandAck *packet)
 {
-    DCPServerCommand *command = dynamic_cast<DCPServerCommand*> (this->server);
 
     if(packet->getSessionID() == command->getSessionIdCentralStation())
     {
         DCPPacket* ackedPacket =
-                command->findInAckQueue(packet->getTimestamp());
+                command->findInAckQueue(packet);
         if(ackedPacket != NULL)
         {
             switch(ackedPacket->getCommandID())
@@ -343,7 +346,7 @@ void DCPPacketHandlerCommandStationConnected::handleCommandAck(DCPPacket *packet
     else if(packet->getSessionID() == command->getSessionIdDrone())
     {
         DCPPacket* ackedPacket =
-                command->findInAckQueue(packet->getTimestamp());
+                command->findInAckQueue(packet);
         if(ackedPacket != NULL)
         {
             switch(ackedPacket->getCommandID())
@@ -358,114 +361,130 @@ void DCPPacketHandlerCommandStationConnected::handleCommandAck(DCPPacket *packet
     }
 }
 
-void DCPPacketHandlerCommandStationConnected::handleCommandThrottle(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandThrottle(
+        DCPCommandThrottle *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandSetSessID(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandSetSessID(
+        DCPCommandSetSessID *packet)
 {}
 
 void DCPPacketHandlerCommandStationConnected::handleCommandHelloFromRemote(
-        DCPPacket *packet)
+        DCPCommandHelloFromRemote *packet)
 {}
 
 void DCPPacketHandlerCommandStationConnected::handleCommandHelloFromCentral(
-        DCPPacket *packet)
+        DCPCommandHelloFromCentralStation *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandLog(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandLog(
+        DCPCommandLog *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandBye(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandBye(
+        DCPCommandBye *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandConnectToDrone(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandConnectToDrone(
+        DCPCommandConnectToDrone *packet)
 {}
 
 void DCPPacketHandlerCommandStationConnected::handleCommandDisconnect(
-        DCPPacket *packet)
+        DCPCommandDisconnect *packet)
 {}
 
-void DCPPacketHandlerCommandStationConnected::handleCommandVideoServers(DCPPacket *packet)
+void DCPPacketHandlerCommandStationConnected::handleCommandVideoServers(
+        DCPCommandVideoServers *packet)
 {}
 
 
 /*
  * CENTRAL STATION -- Packet Handler for central station normal operations
  * */
-DCPPacketHandlerCentralStation::DCPPacketHandlerCentralStation(DCPServer *backend) :
-    DCPPacketHandlerInterface(backend)
+DCPPacketHandlerCentralStation::DCPPacketHandlerCentralStation(
+        DCPServerCentral *central) :
+    DCPPacketHandlerInterface(central),
+    central(central)
 {}
 
 void DCPPacketHandlerCentralStation::handleNull(DCPPacket *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandAilerons(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandAilerons(
+        DCPCommandAilerons *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandIsAlive(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandIsAlive(
+        DCPCommandIsAlive *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandAck(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandAck(DCPCommandAck *packet)
 {
-    DCPServerCentral *central = dynamic_cast<DCPServerCentral*> (this->server);
-    DCPPacket *mypacket = central->findInAckQueue(packet->getTimestamp());
+    DCPPacket *mypacket = central->findInAckQueue(packet);
 
-    central->removeFromAckQueue(mypacket);
+    if(mypacket)
+        central->removeFromAckQueue(mypacket);
+    else
+        central->notifyUnmatchedAck(packet);
 }
 
-void DCPPacketHandlerCentralStation::handleCommandThrottle(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandThrottle(
+        DCPCommandThrottle *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandSetSessID(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandSetSessID(
+        DCPCommandSetSessID *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandHelloFromRemote(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandHelloFromRemote(
+        DCPCommandHelloFromRemote *packet)
 {
-    DCPServerCentral::remote_t *remote;
-    DCPServerCentral::session_t *session;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
+    DCPServerCentral::remote_t remote;
+    DCPServerCentral::session_t session;
+    bool added;
 
     // Check is usind default central sessId
     if(packet->getSessionID() == DCP_SESSIDCENTRAL)
     {
-        DCPCommandHelloFromRemote *hello =
-                dynamic_cast<DCPCommandHelloFromRemote*>(packet);
-        if(!hello) return; // Not Hello from remote packet = abort
-
         // Switch on remote type
-        switch(hello->getRemoteType())
+        switch(packet->getRemoteType())
         {
         case DCPCommandHelloFromRemote::remoteTypeCommandStation:
-            remote = central->addNewCommandStation(hello->getAddrDst(),
-                                          hello->getPortDst(),
-                                          hello->getDescription());
+            added = central->addNewCommandStation(packet->getAddrDst(),
+                                                  packet->getPortDst(),
+                                                  packet->getDescription(),
+                                                  packet->getVersion(),
+                                                  &remote);
             break;
         case DCPCommandHelloFromRemote::remoteTypeDrone:
-            remote = central->addNewDrone(hello->getAddrDst(),
-                                          hello->getPortDst(),
-                                          hello->getDescription());
+            added = central->addNewDrone(packet->getAddrDst(),
+                                         packet->getPortDst(),
+                                         packet->getDescription(),
+                                         packet->getVersion(),
+                                         &remote);
             break;
         default:
             // TODO: Unknwon type
             return; // Abort
         }
 
-        if(!remote)
+        if(!added)
         {
             // Could not add remote
             return;
         }
 
         // If session Id is available
-        if((session = central->addNewSession(central->getMyId(), remote->id))
-                != NULL)
+        if(central->addNewSession(central->getMyId(), remote.id, &session))
         {
+            // Answered in the version of the hello: v2 if the remote speaks it
             DCPCommandHelloFromCentralStation *myHello =
-               new DCPCommandHelloFromCentralStation(DCP_SESSIDCENTRAL);
+               central->newPacket<DCPCommandHelloFromCentralStation>(
+                   DCP_SESSIDCENTRAL);
+            myHello->setVersion(packet->getVersion());
             myHello->setTimestamp(packet->getTimestamp());
-            myHello->setIdRemote(remote->id);
-            myHello->setSessIdCentralStation(session->id);
+            myHello->setIdRemote(remote.id);
+            myHello->setSessIdCentralStation(session.id);
             myHello->setAddrDst(packet->getAddrDst());
             myHello->setPortDst(packet->getPortDst());
             central->sendPacket(myHello);
@@ -473,139 +492,111 @@ void DCPPacketHandlerCentralStation::handleCommandHelloFromRemote(DCPPacket *pac
     }
 }
 
-void DCPPacketHandlerCentralStation::handleCommandHelloFromCentral(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandHelloFromCentral(
+        DCPCommandHelloFromCentralStation *packet)
 {}
 
-void DCPPacketHandlerCentralStation::handleCommandLog(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandLog(DCPCommandLog *packet)
 {
     int remoteId;
-    DCPServerCentral::session_t *sessionCentral;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
-    DCPCommandLog *log = dynamic_cast<DCPCommandLog*> (packet);
+    DCPServerCentral::session_t sessionCentral;
 
     // sessId is valid to speak with central station ?
-    if((sessionCentral = central->sessionIsCentral(packet->getSessionID()))
-            != NULL)
+    if(central->sessionIsCentral(packet->getSessionID(), &sessionCentral))
     {
-        remoteId = (sessionCentral->station1==0) ? sessionCentral->station2 :
-                                                   sessionCentral->station1;
-
-        DCPCommandAck *ack = new DCPCommandAck(packet->getSessionID());
-        ack->setAddrDst(packet->getAddrDst());
-        ack->setPortDst(packet->getPortDst());
-        ack->setTimestamp(packet->getTimestamp());
-        central->sendPacket(ack);
+        remoteId = (sessionCentral.station1==0) ? sessionCentral.station2 :
+                                                  sessionCentral.station1;
+
+        // Acked once stored. Not when shed: the remote will send it again
+        central->addNewLog(remoteId, packet);
     }
 }
 
-void DCPPacketHandlerCentralStation::handleCommandBye(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandBye(DCPCommandBye *packet)
 {
-    int station1Id, station2Id;
-    DCPServerCentral::remote_t *station2;
-    DCPServerCentral::session_t *sessionCentral;
-    DCPServerCentral::session_t *sessionDrone;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
-    DCPCommandBye *bye =
-            dynamic_cast<DCPCommandBye*> (packet);
+    int station1Id;
+    DCPServerCentral::session_t sessionCentral;
 
     // sessId is valid to speak with central station ?
-    if((sessionCentral = central->sessionIsCentral(packet->getSessionID()))
-            != NULL)
+    if(central->sessionIsCentral(packet->getSessionID(), &sessionCentral))
     {
-        station1Id = (sessionCentral->station1==0) ? sessionCentral->station2 :
-                                                   sessionCentral->station1;
+        station1Id = (sessionCentral.station1==0) ? sessionCentral.station2 :
+                                                    sessionCentral.station1;
 
-        // Is remote connected to something ?
-        if((sessionDrone=central->getDroneSessionForStation(station1Id)) != NULL)
-        {
-            station2Id = (sessionDrone->station1==station1Id) ? sessionDrone->station2 :
-                                                                sessionDrone->station1;
-            station2 = central->getStation(station2Id);
-            central->deleteSession(sessionDrone->id);
-
-            // Send info to other end of the connection
-            DCPCommandDisconnect *disconn = new DCPCommandDisconnect(
-                        central->getCentralSessionForStation(station2Id)->id
-                        );
-            disconn->setAddrDst(station2->addr);
-            disconn->setPortDst(station2->port);
-            disconn->setTimestamp(central->msecSinceStart());
-            central->sendPacket(disconn);
-        }
+        // Is remote connected to something ? Tell the other end
+        central->dropDroneSession(station1Id);
+        // Its video servers refer to it, if any
+        central->deleteVideoServers(station1Id);
 
         // If problem while deleting
-        if(!central->deleteSession(sessionCentral->id) ||
+        if(!central->deleteSession(sessionCentral.id) ||
                 !central->deleteStationById(station1Id))
         {
             // TODO: Handle problem
         }
 
         // Even if we could not delete we say farewell to the drone/command
-        DCPCommandAck *ack = new DCPCommandAck(packet->getSessionID());
-        ack->setAddrDst(packet->getAddrDst());
-        ack->setPortDst(packet->getPortDst());
-        ack->setTimestamp(packet->getTimestamp());
-        central->sendPacket(ack);
+        central->sendAck(packet);
     }
 }
 
-void DCPPacketHandlerCentralStation::handleCommandConnectToDrone(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandConnectToDrone(
+        DCPCommandConnectToDrone *packet)
 {
     int remoteId;
-    DCPServerCentral::remote_t *command;
-    DCPServerCentral::remote_t *drone;
-    DCPServerCentral::session_t *sessionCentral;
-    DCPServerCentral::session_t *sessionDrone;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
-    DCPCommandConnectToDrone *conn =
-            dynamic_cast<DCPCommandConnectToDrone*> (packet);
+    DCPServerCentral::remote_t drone;
+    DCPServerCentral::remote_t commandStation;
+    DCPServerCentral::session_t sessionCentral;
+    DCPServerCentral::session_t sessionDroneCentral;
+    DCPServerCentral::session_t sessionDrone;
 
     // sessId is valid to speak with central station ?
-    if((sessionCentral = central->sessionIsCentral(packet->getSessionID()))
-            != NULL)
+    if(central->sessionIsCentral(packet->getSessionID(), &sessionCentral))
     {
 
-        remoteId = (sessionCentral->station1==0) ? sessionCentral->station2 :
-                                                   sessionCentral->station1;
+        remoteId = (sessionCentral.station1==0) ? sessionCentral.station2 :
+                                                  sessionCentral.station1;
         // Only command stations can connect to drones
-        if((command=central->stationIsCommand(remoteId)) != NULL)
+        if(central->stationIsCommand(remoteId, &commandStation))
         {
             // Can only connect to drone
-            if((drone=central->stationIsDrone(conn->getDroneId())) != NULL)
+            if(central->stationIsDrone(packet->getDroneId(), &drone))
             {
-                if(central->getDroneSessionForStation(remoteId))
+                if(central->getDroneSessionForStation(remoteId, NULL))
                 {
                     // TODO: Command Station already connected
                 }
-                else if(central->getDroneSessionForStation(drone->id))
+                else if(central->getDroneSessionForStation(drone.id, NULL))
                 {
                     // TODO: Drone already connected
                 }
-                else
+                else if(central->getCentralSessionForStation(drone.id,
+                                                        &sessionDroneCentral) &&
+                        central->addNewSession(remoteId, drone.id,
+                                               &sessionDrone))
                 {
-                    sessionDrone = central->addNewSession(remoteId, drone->id);
-
                     // Send to Drone
                     DCPCommandSetSessID *setSessDrone =
-                            new DCPCommandSetSessID(
-                                central->getCentralSessionForStation(drone->id)->id
-                                );
-                    setSessDrone->setAddrDst(drone->addr);
-                    setSessDrone->setPortDst(drone->port);
-                    setSessDrone->setTimestamp(central->msecSinceStart());
-                    setSessDrone->setDroneSessId(sessionDrone->id);
-                    central->sendPacket(setSessDrone);
+                            central->newPacket<DCPCommandSetSessID>(
+                                sessionDroneCentral.id);
+                    setSessDrone->setVersion(drone.protocol);
+                    setSessDrone->setAddrDst(drone.addr);
+                    setSessDrone->setPortDst(drone.port);
+                    setSessDrone->setTimestamp(central->timestamp());
+                    setSessDrone->setDroneSessId(sessionDrone.id);
+                    setSessDrone->setPeerVersion(commandStation.protocol);
+                    central->sendToStation(drone.id, setSessDrone);
 
                     // Send to Command Station
                     DCPCommandSetSessID *setSessCmd =
-                            new DCPCommandSetSessID(packet->getSessionID());
+                            central->newPacket<DCPCommandSetSessID>(
+                                packet->getSessionID());
+                    setSessCmd->setVersion(packet->getVersion());
                     setSessCmd->setAddrDst(packet->getAddrDst());
                     setSessCmd->setPortDst(packet->getPortDst());
                     setSessCmd->setTimestamp(packet->getTimestamp());
-                    setSessCmd->setDroneSessId(sessionDrone->id);
+                    setSessCmd->setDroneSessId(sessionDrone.id);
+                    setSessCmd->setPeerVersion(drone.protocol);
                     central->sendPacket(setSessCmd);
                 }
             }
@@ -613,79 +604,48 @@ void DCPPacketHandlerCentralStation::handleCommandConnectToDrone(DCPPacket *pack
     }
 }
 
-void DCPPacketHandlerCentralStation::handleCommandDisconnect(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandDisconnect(
+        DCPCommandDisconnect *packet)
 {
-    int station1Id, station2Id;
-    DCPServerCentral::remote_t  *station2;
-    DCPServerCentral::session_t *sessionCentral;
-    DCPServerCentral::session_t *sessionDrone;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
+    int station1Id;
+    DCPServerCentral::session_t sessionCentral;
 
     // SessionId exists and is with central station ?
-    if((sessionCentral = central->sessionIsCentral(packet->getSessionID()))
-            != NULL)
+    if(central->sessionIsCentral(packet->getSessionID(), &sessionCentral))
     {
-        station1Id = (sessionCentral->station1==0) ? sessionCentral->station2 :
-                                                   sessionCentral->station1;
+        station1Id = (sessionCentral.station1==0) ? sessionCentral.station2 :
+                                                    sessionCentral.station1;
 
-        // Is remote connected to something ?
-        if((sessionDrone=central->getDroneSessionForStation(station1Id)) != NULL)
+        // Is remote connected to something ? Tell the other end
+        if(central->dropDroneSession(station1Id))
         {
-            station2Id = (sessionDrone->station1==station1Id) ? sessionDrone->station2 :
-                                                            sessionDrone->station1;
-            station2 = central->getStation(station2Id);
-            central->deleteSession(sessionDrone->id);
-
-            // Send disconnect to other end
-            DCPCommandDisconnect *disconn = new DCPCommandDisconnect(
-                        central->getCentralSessionForStation(station2Id)->id
-                        );
-            disconn->setAddrDst(station2->addr);
-            disconn->setPortDst(station2->port);
-            disconn->setTimestamp(central->msecSinceStart());
-            central->sendPacket(disconn);
-
             // Disconnect OK
-            DCPCommandAck *ack = new DCPCommandAck(packet->getSessionID());
-            ack->setAddrDst(packet->getAddrDst());
-            ack->setPortDst(packet->getPortDst());
-            ack->setTimestamp(packet->getTimestamp());
-            central->sendPacket(ack);
+            central->sendAck(packet);
         }
     }
 }
 
-void DCPPacketHandlerCentralStation::handleCommandVideoServers(DCPPacket *packet)
+void DCPPacketHandlerCentralStation::handleCommandVideoServers(
+        DCPCommandVideoServers *packet)
 {
     int remoteId;
-    DCPServerCentral::session_t *sessionCentral;
-    DCPServerCentral::remote_t  *drone;
-    DCPServerCentral *central =
-            dynamic_cast<DCPServerCentral*>(this->server);
-    DCPCommandVideoServers *video =
-            dynamic_cast<DCPCommandVideoServers*> (packet);
+    DCPServerCentral::session_t sessionCentral;
 
     // SessionId exists and is with central station ?
-    if((sessionCentral = central->sessionIsCentral(packet->getSessionID()))
-            != NULL)
+    if(central->sessionIsCentral(packet->getSessionID(), &sessionCentral))
     {
-        remoteId = (sessionCentral->station1==0) ? sessionCentral->station2 :
-                                                   sessionCentral->station1;
+        remoteId = (sessionCentral.station1==0) ? sessionCentral.station2 :
+                                                  sessionCentral.station1;
 
         // Only drones can register video servers
-        if((drone=central->stationIsDrone(remoteId)) != NULL)
+        if(central->stationIsDrone(remoteId, NULL))
         {
             // Delete previously registered video servers if any
             central->deleteVideoServers(remoteId);
             // Register new servers
-            if(central->addNewVideoServers(remoteId, video->getRawUrlList()))
+            if(central->addNewVideoServers(remoteId, packet->getRawUrlList()))
             {
-                DCPCommandAck *ack = new DCPCommandAck(packet->getSessionID());
-                ack->setAddrDst(packet->getAddrDst());
-                ack->setPortDst(packet->getPortDst());
-                ack->setTimestamp(packet->getTimestamp());
-                central->sendPacket(ack);
+                central->sendAck(packet);
             }
         }
     }
@@ -28,29 +28,49 @@
 #include "dcpserver.h"
 
 class DCPServer;
+class DCPServerCommand;
+class DCPServerCentral;
 class DCPPacket;
+class DCPCommandAilerons;
+class DCPCommandIsAlive;
+class DCPCommandAck;
+class DCPCommandThrottle;
+class DCPCommandSetSessID;
 class DCPCommandHelloFromCentralStation;
+class DCPCommandHelloFromRemote;
+class DCPCommandLog;
+class DCPCommandBye;
+class DCPCommandConnectToDrone;
+class DCPCommandDisconnect;
+class DCPCommandVideoServers;
 
 
 
+/*
+ * Packets are decoded straight into their concrete type and handed to the
+ * current state through the factory's dispatch table, see DCPCommandType.
+ * */
 class DCPPacketHandlerInterface
 {
 public:
     DCPPacketHandlerInterface(DCPServer* server);
-
-    virtual void handleNull                         (DCPPacket *packet) = 0;
-    virtual void handleCommandAilerons              (DCPPacket *packet) = 0;
-    virtual void handleCommandIsAlive               (DCPPacket *packet) = 0;
-    virtual void handleCommandAck                   (DCPPacket *packet) = 0;
-    virtual void handleCommandThrottle              (DCPPacket *packet) = 0;
-    virtual void handleCommandSetSessID             (DCPPacket *packet) = 0;
-    virtual void handleCommandHelloFromCentral      (DCPPacket *packet) = 0;
-    virtual void handleCommandHelloFromRemote       (DCPPacket *packet) = 0;
-    virtual void handleCommandLog                   (DCPPacket *packet) = 0;
-    virtual void handleCommandBye                   (DCPPacket *packet) = 0;
-    virtual void handleCommandConnectToDrone        (DCPPacket *packet) = 0;
-    virtual void handleCommandDisconnect            (DCPPacket *packet) = 0;
-    virtual void handleCommandVideoServers          (DCPPacket *packet) = 0;
+    virtual ~DCPPacketHandlerInterface() {}
+
+    virtual void handleNull                 (DCPPacket *packet) = 0;
+    virtual void handleCommandAilerons      (DCPCommandAilerons *packet) = 0;
+    virtual void handleCommandIsAlive       (DCPCommandIsAlive *packet) = 0;
+    virtual void handleCommandAck           (DCPCommandAck *packet) = 0;
+    virtual void handleCommandThrottle      (DCPCommandThrottle *packet) = 0;
+    virtual void handleCommandSetSessID     (DCPCommandSetSessID *packet) = 0;
+    virtual void handleCommandHelloFromCentral
+                            (DCPCommandHelloFromCentralStation *packet) = 0;
+    virtual void handleCommandHelloFromRemote
+                            (DCPCommandHelloFromRemote *packet) = 0;
+    virtual void handleCommandLog           (DCPCommandLog *packet) = 0;
+    virtual void handleCommandBye           (DCPCommandBye *packet) = 0;
+    virtual void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet) = 0;
+    virtual void handleCommandDisconnect    (DCPCommandDisconnect *packet) = 0;
+    virtual void handleCommandVideoServers  (DCPCommandVideoServers *packet) = 0;
 
 protected:
     DCPServer* server;
@@ -77,73 +97,91 @@ protected:
 //    virtual void handleCommandUnconnectFromDrone    (DCPPacket* packet);
 //};
 
+/*
+ * COMMAND STATION -- Base of the command station handlers
+ * */
+class DCPPacketHandlerCommandStation : public DCPPacketHandlerInterface
+{
+public:
+    DCPPacketHandlerCommandStation(DCPServerCommand *command);
+
+protected:
+    DCPServerCommand* command;
+};
+
 /*
  * COMMAND STATION -- Packet Handler for Hello handshake
  * */
-class DCPPacketHandlerCommandStationHello : public DCPPacketHandlerInterface
+class DCPPacketHandlerCommandStationHello : public DCPPacketHandlerCommandStation
 {
 public:
-    DCPPacketHandlerCommandStationHello(DCPServer *backend);
-
-    virtual void handleNull                         (DCPPacket* packet);
-    virtual void handleCommandAilerons              (DCPPacket* packet);
-    virtual void handleCommandIsAlive               (DCPPacket* packet);
-    virtual void handleCommandAck                   (DCPPacket* packet);
-    virtual void handleCommandThrottle              (DCPPacket* packet);
-    virtual void handleCommandSetSessID             (DCPPacket* packet);
-    virtual void handleCommandHelloFromCentral      (DCPPacket* packet);
-    virtual void handleCommandHelloFromRemote       (DCPPacket* packet);
-    virtual void handleCommandLog                   (DCPPacket* packet);
-    virtual void handleCommandBye                   (DCPPacket* packet);
-    virtual void handleCommandConnectToDrone        (DCPPacket* packet);
-    virtual void handleCommandDisconnect            (DCPPacket* packet);
-    virtual void handleCommandVideoServers          (DCPPacket *packet);
+    DCPPacketHandlerCommandStationHello(DCPServerCommand *command);
+
+    virtual void handleNull                 (DCPPacket *packet);
+    virtual void handleCommandAilerons      (DCPCommandAilerons *packet);
+    virtual void handleCommandIsAlive       (DCPCommandIsAlive *packet);
+    virtual void handleCommandAck           (DCPCommandAck *packet);
+    virtual void handleCommandThrottle      (DCPCommandThrottle *packet);
+    virtual void handleCommandSetSessID     (DCPCommandSetSessID *packet);
+    virtual void handleCommandHelloFromCentral
+                            (DCPCommandHelloFromCentralStation *packet);
+    virtual void handleCommandHelloFromRemote
+                            (DCPCommandHelloFromRemote *packet);
+    virtual void handleCommandLog           (DCPCommandLog *packet);
+    virtual void handleCommandBye           (DCPCommandBye *packet);
+    virtual void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet);
+    virtual void handleCommandDisconnect    (DCPCommandDisconnect *packet);
+    virtual void handleCommandVideoServers  (DCPCommandVideoServers *packet);
 };
 
 /*
  * COMMAND STATION -- Packet Handler Not Connected
  * */
-class DCPPacketHandlerCommandStationNotConnected : public DCPPacketHandlerInterface
+class DCPPacketHandlerCommandStationNotConnected : public DCPPacketHandlerCommandStation
 {
 public:
-    DCPPacketHandlerCommandStationNotConnected(DCPServer *backend);
-
-    virtual void handleNull                         (DCPPacket* packet);
-    virtual void handleCommandAilerons              (DCPPacket* packet);
-    virtual void handleCommandIsAlive               (DCPPacket* packet);
-    virtual void handleCommandAck                   (DCPPacket* packet);
-    virtual void handleCommandThrottle              (DCPPacket* packet);
-    virtual void handleCommandSetSessID             (DCPPacket* packet);
-    virtual void handleCommandHelloFromCentral      (DCPPacket* packet);
-    virtual void handleCommandHelloFromRemote       (DCPPacket* packet);
-    virtual void handleCommandLog                   (DCPPacket* packet);
-    virtual void handleCommandBye                   (DCPPacket* packet);
-    virtual void handleCommandConnectToDrone        (DCPPacket* packet);
-    virtual void handleCommandDisconnect            (DCPPacket* packet);
-    virtual void handleCommandVideoServers          (DCPPacket *packet);
+    DCPPacketHandlerCommandStationNotConnected(DCPServerCommand *command);
+
+    virtual void handleNull                 (DCPPacket *packet);
+    virtual void handleCommandAilerons      (DCPCommandAilerons *packet);
+    virtual void handleCommandIsAlive       (DCPCommandIsAlive *packet);
+    virtual void handleCommandAck           (DCPCommandAck *packet);
+    virtual void handleCommandThrottle      (DCPCommandThrottle *packet);
+    virtual void handleCommandSetSessID     (DCPCommandSetSessID *packet);
+    virtual void handleCommandHelloFromCentral
+                            (DCPCommandHelloFromCentralStation *packet);
+    virtual void handleCommandHelloFromRemote
+                            (DCPCommandHelloFromRemote *packet);
+    virtual void handleCommandLog           (DCPCommandLog *packet);
+    virtual void handleCommandBye           (DCPCommandBye *packet);
+    virtual void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet);
+    virtual void handleCommandDisconnect    (DCPCommandDisconnect *packet);
+    virtual void handleCommandVideoServers  (DCPCommandVideoServers *packet);
 };
 
 /*
  * COMMAND STATION -- Packet Handler Connected
  * */
-class DCPPacketHandlerCommandStationConnected : public DCPPacketHandlerInterface
+class DCPPacketHandlerCommandStationConnected : public DCPPacketHandlerCommandStation
 {
 public:
-    DCPPacketHandlerCommandStationConnected(DCPServer *backend);
-
-    virtual void handleNull                         (DCPPacket* packet);
-    virtual void handleCommandAilerons              (DCPPacket* packet);
-    virtual void handleCommandIsAlive               (DCPPacket* packet);
-    virtual void handleCommandAck                   (DCPPacket* packet);
-    virtual void handleCommandThrottle              (DCPPacket* packet);
-    virtual void handleCommandSetSessID             (DCPPacket* packet);
-    virtual void handleCommandHelloFromCentral      (DCPPacket* packet);
-    virtual void handleCommandHelloFromRemote       (DCPPacket* packet);
-    virtual void handleCommandLog                   (DCPPacket* packet);
-    virtual void handleCommandBye                   (DCPPacket* packet);
-    virtual void handleCommandConnectToDrone        (DCPPacket* packet);
-    virtual void handleCommandDisconnect            (DCPPacket* packet);
-    virtual void handleCommandVideoServers          (DCPPacket *packet);
+    DCPPacketHandlerCommandStationConnected(DCPServerCommand *command);
+
+    virtual void handleNull                 (DCPPacket *packet);
+    virtual void handleCommandAilerons      (DCPCommandAilerons *packet);
+    virtual void handleCommandIsAlive       (DCPCommandIsAlive *packet);
+    virtual void handleCommandAck           (DCPCommandAck *packet);
+    virtual void handleCommandThrottle      (DCPCommandThrottle *packet);
+    virtual void handleCommandSetSessID     (DCPCommandSetSessID *packet);
+    virtual void handleCommandHelloFromCentral
+                            (DCPCommandHelloFromCentralStation *packet);
+    virtual void handleCommandHelloFromRemote
+                            (DCPCommandHelloFromRemote *packet);
+    virtual void handleCommandLog           (DCPCommandLog *packet);
+    virtual void handleCommandBye           (DCPCommandBye *packet);
+    virtual void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet);
+    virtual void handleCommandDisconnect    (DCPCommandDisconnect *packet);
+    virtual void handleCommandVideoServers  (DCPCommandVideoServers *packet);
 };
 
 /*
@@ -152,21 +190,26 @@ public:
 class DCPPacketHandlerCentralStation : public DCPPacketHandlerInterface
 {
 public:
-    DCPPacketHandlerCentralStation(DCPServer *backend);
-
-    virtual void handleNull                         (DCPPacket* packet);
-    virtual void handleCommandAilerons              (DCPPacket* packet);
-    virtual void handleCommandIsAlive               (DCPPacket* packet);
-    virtual void handleCommandAck                   (DCPPacket* packet);
-    virtual void handleCommandThrottle              (DCPPacket* packet);
-    virtual void handleCommandSetSessID             (DCPPacket* packet);
-    virtual void handleCommandHelloFromCentral      (DCPPacket* packet);
-    virtual void handleCommandHelloFromRemote       (DCPPacket* packet);
-    virtual void handleCommandLog                   (DCPPacket* packet);
-    virtual void handleCommandBye                   (DCPPacket* packet);
-    virtual void handleCommandConnectToDrone        (DCPPacket* packet);
-    virtual void handleCommandDisconnect            (DCPPacket* packet);
-    virtual void handleCommandVideoServers          (DCPPacket *packet);
+    DCPPacketHandlerCentralStation(DCPServerCentral *central);
+
+    virtual void handleNull                 (DCPPacket *packet);
+    virtual void handleCommandAilerons      (DCPCommandAilerons *packet);
+    virtual void handleCommandIsAlive       (DCPCommandIsAlive *packet);
+    virtual void handleCommandAck           (DCPCommandAck *packet);
+    virtual void handleCommandThrottle      (DCPCommandThrottle *packet);
+    virtual void handleCommandSetSessID     (DCPCommandSetSessID *packet);
+    virtual void handleCommandHelloFromCentral
+                            (DCPCommandHelloFromCentralStation *packet);
+    virtual void handleCommandHelloFromRemote
+                            (DCPCommandHelloFromRemote *packet);
+    virtual void handleCommandLog           (DCPCommandLog *packet);
+    virtual void handleCommandBye           (DCPCommandBye *packet);
+    virtual void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet);
+    virtual void handleCommandDisconnect    (DCPCommandDisconnect *packet);
+    virtual void handleCommandVideoServers  (DCPCommandVideoServers *packet);
+
+protected:
+    DCPServerCentral* central;
 };
 
 #endif // DCPPACKETHANDLERINTERFACE_H
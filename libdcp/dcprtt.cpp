@@ -0,0 +1,80 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcprtt.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcprtt.h"
+
+DCPRtt::DCPRtt() :
+    srtt(0),
+    rttvar(0),
+    rto(DCP_TIMEOUT),
+    backoff(0),
+    nbSamples(0)
+{}
+
+/*
+ * RTT of a packet acked without being resent.
+ * */
+void DCPRtt::sample(int msec)
+{
+    int delta;
+
+    if(msec < 0)
+        msec = 0;
+
+    if(this->nbSamples == 0)
+    {
+        this->srtt      = msec << 3;
+        this->rttvar    = msec << 1;    // msec/2, << 2
+    }
+    else
+    {
+        // SRTT += (R-SRTT)/8, RTTVAR += (|R-SRTT|-RTTVAR)/4
+        delta = msec - (this->srtt >> 3);
+        this->srtt += delta;
+        if(delta < 0)
+            delta = -delta;
+        this->rttvar += delta - (this->rttvar >> 2);
+    }
+    this->nbSamples++;
+    this->backoff = 0;
+
+    this->rto = qBound(DCP_RTOMIN, (this->srtt >> 3) + this->rttvar,
+                       DCP_RTOMAX);
+}
+
+/*
+ * A packet was resent for the nbResend-th time: the next packets wait as
+ * long, until an RTT is measured again.
+ * */
+void DCPRtt::timedOut(int nbResend)
+{
+    if(nbResend > this->backoff)
+        this->backoff = qMin(nbResend, DCP_MAXRESEND);
+}
+
+/*
+ * Msec to wait for the ack of a packet resent nbResend times.
+ * */
+int DCPRtt::timeout(int nbResend) const
+{
+    int shift = qMin(qMax(nbResend, this->backoff), DCP_MAXRESEND);
+
+    return qMin(this->rto << shift, DCP_RTOMAX);
+}
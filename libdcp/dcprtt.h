@@ -0,0 +1,58 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcprtt.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPRTT_H
+#define DCPRTT_H
+
+#include <QtGlobal>
+
+#include <dcp.h>
+
+
+
+/*
+ * DCP -- Round trip time of a peer, and the retransmission timeout derived
+ * from it, see DCP_TIMEOUT. Plain value, SRTT and RTTVAR are kept in
+ * fixed point (1/8 and 1/4 msec) as in Jacobson's paper.
+ * */
+class DCPRtt
+{
+public:
+    DCPRtt();
+
+    void    sample(int msec);
+    void    timedOut(int nbResend);
+    int     timeout(int nbResend) const;
+
+    inline int  getSrtt()       const { return this->srtt >> 3;     }
+    inline int  getRttVar()     const { return this->rttvar >> 2;   }
+    inline int  getRto()        const { return this->rto;           }
+    inline int  getBackoff()    const { return this->backoff;       }
+    inline int  getNbSamples()  const { return this->nbSamples;     }
+
+private:
+    int     srtt;       // msec << 3
+    int     rttvar;     // msec << 2
+    int     rto;        // msec, before backoff
+    int     backoff;    // the timeouts are doubled this many times
+    int     nbSamples;
+};
+
+#endif // DCPRTT_H
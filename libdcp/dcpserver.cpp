@@ -20,57 +20,444 @@
 
 #include "dcpserver.h"
 #include "dcpcommands.h"
+#include "dcplog.h"
+
+#include <QMetaObject>
+
+#ifdef Q_OS_LINUX
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#endif
 
 DCPServer::DCPServer(QUdpSocket *sock) :
     QObject(),
     sock(sock),
-    myID(0)
+    handler(NULL),
+    myID(0),
+    clockOffset(0),
+    nbResends(0),
+    nbGiveUps(0),
+    ackDelay(DCP_ACKDELAY),
+    lastRecvBatch(0),
+    maxRecvBatch(0),
+    nbWakeups(0),
+    nbDatagrams(0),
+    nbQueued(0),
+    flushPending(false),
+    nbSendCalls(0),
+    nbDatagramsSent(0),
+    nbSendErrors(0),
+    nbAckBundles(0),
+    nbAcksBundled(0)
 {
-    this->handler = new DCPPacketHandlerCommandStationHello(this);
+#ifdef Q_OS_LINUX
+    memset(this->recvMsgs, 0, sizeof(this->recvMsgs));
+    for(int i=0 ; i<DCPSERVER_RECVBATCH ; ++i)
+    {
+        this->recvIovecs[i].iov_base = this->recvBuffers[i];
+        this->recvIovecs[i].iov_len  = DCPSERVER_DATAGRAMMAX;
+        this->recvMsgs[i].msg_hdr.msg_iov       = &(this->recvIovecs[i]);
+        this->recvMsgs[i].msg_hdr.msg_iovlen    = 1;
+        this->recvMsgs[i].msg_hdr.msg_name      = &(this->recvAddrs[i]);
+    }
+
+    memset(this->sendMsgs, 0, sizeof(this->sendMsgs));
+    for(int i=0 ; i<DCPSERVER_SENDBATCH ; ++i)
+    {
+        this->sendIovecs[i].iov_base = this->sendBuffers[i];
+        this->sendMsgs[i].msg_hdr.msg_iov       = &(this->sendIovecs[i]);
+        this->sendMsgs[i].msg_hdr.msg_iovlen    = 1;
+        this->sendMsgs[i].msg_hdr.msg_name      = &(this->sendAddrs[i]);
+    }
+    this->sendFd        = -1;
+    this->sendFamily    = AF_UNSPEC;
+#endif
+
+    this->ackBuckets.fill(NULL, DCPSERVER_ACKBUCKETS);
+    this->nbAckEntries  = 0;
+    this->clock.start();
+    this->wheelTicker.setInterval(this->wheel.getTickMsec());
+    connect(&(this->wheelTicker), SIGNAL(timeout()), this, SLOT(wheelTick()));
+    this->ackTimer.setSingleShot(true);
+    connect(&(this->ackTimer), SIGNAL(timeout()), this, SLOT(flushAcks()));
+
+    this->factory   = new DCPPacketFactory();
+    this->ackPacket = new DCPCommandAck();
+    this->bundledAck = new DCPCommandAck();
     connect(sock, SIGNAL(readyRead()), this, SLOT(receiveDatagram()));
 }
 
+DCPServer::~DCPServer()
+{
+    DCPAckEntry *entry;
+    DCPCommandAckBundle *bundle;
+    void *storage;
+
+    foreach (entry, this->ackBuckets) {
+        while(entry) {
+            DCPAckEntry *next = entry->hashNext;
+            delete entry->packet;
+            delete entry;
+            entry = next;
+        }
+    }
+    foreach (entry, this->freeEntries) {
+        delete entry;
+    }
+    for(int i=0 ; i<DCP_NBCOMMANDS ; ++i) {
+        foreach (storage, this->freePackets[i]) {
+            ::operator delete(storage);
+        }
+    }
+    foreach (bundle, this->pendingAcks) {
+        delete bundle;
+    }
+    foreach (bundle, this->freeBundles) {
+        delete bundle;
+    }
+    delete this->factory;
+    delete this->ackPacket;
+    delete this->bundledAck;
+}
+
+bool DCPServer::transmitPacket(DCPPacket *packet)
+{
+    char *buffer = this->sendSlot();
+    int len = packet->encode(buffer, DCPSERVER_DATAGRAMMAX);
+    if(len < 0)
+        return false;
+
+    return this->queueDatagram(len, packet->getAddrDst(), packet->getPortDst());
+}
+
+bool DCPServer::transmitEntry(DCPAckEntry *entry)
+{
+    if(entry->len < 0)
+        return false;
+
+    memcpy(this->sendSlot(), entry->data, entry->len);
+    return this->queueDatagram(entry->len, entry->key.addr, entry->key.port);
+}
+
+/*
+ * Buffer in which to encode the next outgoing datagram.
+ * */
+char* DCPServer::sendSlot()
+{
+    if(this->nbQueued == DCPSERVER_SENDBATCH)
+        this->flush();
+
+    return this->sendBuffers[this->nbQueued];
+}
+
+#ifdef Q_OS_LINUX
+static socklen_t fillSockAddr(struct sockaddr_storage *ss, int family,
+                              const QHostAddress &addr, quint16 port)
+{
+    quint32 ip4;
+    bool isIp4;
+
+    memset(ss, 0, sizeof(*ss));
+    ip4 = addr.toIPv4Address(&isIp4);
+
+    if(family == AF_INET6)
+    {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6*)ss;
+        in6->sin6_family    = AF_INET6;
+        in6->sin6_port      = htons(port);
+        if(isIp4)
+        {
+            // IPv4-mapped address on a dual stack socket
+            in6->sin6_addr.s6_addr[10] = 0xFF;
+            in6->sin6_addr.s6_addr[11] = 0xFF;
+            in6->sin6_addr.s6_addr[12] = (ip4>>24) & 0xFF;
+            in6->sin6_addr.s6_addr[13] = (ip4>>16) & 0xFF;
+            in6->sin6_addr.s6_addr[14] = (ip4>>8) & 0xFF;
+            in6->sin6_addr.s6_addr[15] = ip4 & 0xFF;
+        }
+        else
+        {
+            Q_IPV6ADDR ip6 = addr.toIPv6Address();
+            memcpy(&(in6->sin6_addr), &ip6, sizeof(in6->sin6_addr));
+            in6->sin6_scope_id = addr.scopeId().toUInt();
+        }
+        return sizeof(*in6);
+    }
+
+    if(family == AF_INET && isIp4)
+    {
+        struct sockaddr_in *in = (struct sockaddr_in*)ss;
+        in->sin_family      = AF_INET;
+        in->sin_port        = htons(port);
+        in->sin_addr.s_addr = htonl(ip4);
+        return sizeof(*in);
+    }
+
+    return 0;
+}
+#endif
+
+/*
+ * Queue the datagram encoded in the current send slot. Until the socket
+ * is bound, datagrams go through QUdpSocket which binds it.
+ * */
+bool DCPServer::queueDatagram(int len, const QHostAddress &addr,
+                              quint16 port)
+{
+#ifdef Q_OS_LINUX
+    int i = this->nbQueued;
+    int fd = this->sock->socketDescriptor();
+    socklen_t namelen;
+
+    if(fd == -1)
+        return this->sock->writeDatagram(this->sendBuffers[i], len,
+                                         addr, port) >= 0;
+
+    if(fd != this->sendFd)
+    {
+        struct sockaddr_storage local;
+        socklen_t locallen = sizeof(local);
+        if(getsockname(fd, (struct sockaddr*)&local, &locallen) < 0)
+            return false;
+        this->sendFd        = fd;
+        this->sendFamily    = local.ss_family;
+    }
+
+    namelen = fillSockAddr(&(this->sendAddrs[i]), this->sendFamily,
+                           addr, port);
+    if(!namelen)
+        return false;
+
+    this->sendIovecs[i].iov_len             = len;
+    this->sendMsgs[i].msg_hdr.msg_namelen   = namelen;
+    this->nbQueued++;
+
+    if(!this->flushPending)
+    {
+        this->flushPending = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+    return true;
+#else
+    return this->sock->writeDatagram(this->sendBuffers[0], len,
+                                     addr, port) >= 0;
+#endif
+}
+
+/*
+ * Send every queued datagram, with as few system calls as possible.
+ * */
+void DCPServer::flush()
+{
+    this->flushPending = false;
+
+#ifdef Q_OS_LINUX
+    int sent = 0, ret;
+
+    while(sent < this->nbQueued)
+    {
+        ret = sendmmsg(this->sendFd, &(this->sendMsgs[sent]),
+                       this->nbQueued - sent, 0);
+        this->nbSendCalls++;
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            // The first datagram failed: drop it, as the network would
+            DCPLOG_WARNING("Send failure: " << strerror(errno));
+            this->nbSendErrors++;
+            sent++;
+            continue;
+        }
+        this->nbDatagramsSent += ret;
+        sent += ret;
+    }
+#endif
+
+    this->nbQueued = 0;
+}
+
 void DCPServer::sendPacket(DCPPacket *packet)
 {
-    QByteArray *datagram = packet->packetToData();
-    int err = this->sock->writeDatagram(datagram->data(), packet->getLenght(),
-                                packet->getAddrDst(), packet->getPortDst());
+    DCPAckEntry *entry;
+
+    if(packet->getCommandID() != DCP_CMDACK)
+        this->piggybackAcks(packet);
+
+    // Acks and latest commands are sent once, and forgotten
+    if(packet->getCommandID() == DCP_CMDACK ||
+       packet->getDelivery() == DCP_DELIVERYLATEST)
+    {
+        if(!this->transmitPacket(packet))
+            DCPLOG_WARNING("Send failure for:" << endl << packet->toString());
+        this->releasePacket(packet);
+        return;
+    }
+
+    entry = this->moveToAckQueue(packet);
+    if(this->transmitEntry(entry))
+    {
+        DCPLOG_DEBUG("Send success for:" << endl << packet->toString());
+    }
+    else
+    {
+        DCPLOG_WARNING("Send failure for:" << endl << packet->toString());
+        this->removeFromAckQueue(packet);
+    }
+}
+
+void DCPServer::sendAck(DCPPacket *packet)
+{
+    if(packet->getDelivery() == DCP_DELIVERYLATEST)
+        return;
+
+    if(packet->getVersion() >= DCP_VERSION2 && this->ackDelay > 0)
+    {
+        this->delayAck(packet);
+        return;
+    }
+
+    // Acks are in the version of the packet they acknowledge
+    this->ackPacket->setVersion(packet->getVersion());
+    this->ackPacket->setSessionID(packet->getSessionID());
+    this->ackPacket->setTimestamp(packet->getTimestamp());
+    this->ackPacket->setAddrDst(packet->getAddrDst());
+    this->ackPacket->setPortDst(packet->getPortDst());
+
+    if(!this->transmitPacket(this->ackPacket))
+        DCPLOG_WARNING("Send failure for:" << endl
+                       << this->ackPacket->toString());
+}
+
+void DCPServer::delayAck(DCPPacket *packet)
+{
+    DCPCommandAckBundle *bundle;
+    DCPAckKey key = ackKey(packet);
 
-    if(err >= 0)
+    key.timestamp = 0;
+    bundle = this->pendingAcks.value(key, NULL);
+    if(bundle)
     {
-        qDebug() << "Send success for:";
-        qDebug() << packet->toString();
-        if(packet->getCommandID() != DCP_CMDACK)
+        // Out of the bundle's span: it leaves now, a new one starts
+        if(!bundle->add(packet->getTimestamp()))
         {
-            this->moveToAckQueue(packet);
-            packet->start();
+            this->transmitAcks(bundle);
+            bundle->reset(packet->getTimestamp());
         }
+        return;
+    }
+
+    if(this->freeBundles.isEmpty())
+        bundle = new DCPCommandAckBundle();
+    else
+        bundle = this->freeBundles.takeLast();
+    bundle->setVersion(packet->getVersion());
+    bundle->setSessionID(packet->getSessionID());
+    bundle->setAddrDst(packet->getAddrDst());
+    bundle->setPortDst(packet->getPortDst());
+    bundle->reset(packet->getTimestamp());
+    this->pendingAcks.insert(key, bundle);
+
+    if(!this->ackTimer.isActive())
+        this->ackTimer.start(this->ackDelay);
+}
+
+/*
+ * The acks waiting for the session of an outgoing packet go in the same
+ * send batch, ahead of it.
+ * */
+void DCPServer::piggybackAcks(DCPPacket *packet)
+{
+    DCPCommandAckBundle *bundle;
+    DCPAckKey key;
+
+    if(this->pendingAcks.isEmpty())
+        return;
+
+    key = ackKey(packet);
+    key.timestamp = 0;
+    bundle = this->pendingAcks.take(key);
+    if(!bundle)
+        return;
+
+    this->transmitAcks(bundle);
+    this->freeBundles.append(bundle);
+}
+
+void DCPServer::flushAcks()
+{
+    DCPCommandAckBundle *bundle;
+
+    foreach (bundle, this->pendingAcks) {
+        this->transmitAcks(bundle);
+        this->freeBundles.append(bundle);
+    }
+    this->pendingAcks.clear();
+    this->flush();
+}
+
+/*
+ * A lone ack is sent as a plain one, it is shorter.
+ * */
+void DCPServer::transmitAcks(DCPCommandAckBundle *bundle)
+{
+    DCPPacket *packet = bundle;
+
+    if(bundle->getNbAcked() == 1)
+    {
+        this->ackPacket->setVersion(bundle->getVersion());
+        this->ackPacket->setSessionID(bundle->getSessionID());
+        this->ackPacket->setTimestamp(bundle->getTimestamp());
+        this->ackPacket->setAddrDst(bundle->getAddrDst());
+        this->ackPacket->setPortDst(bundle->getPortDst());
+        packet = this->ackPacket;
     }
     else
     {
-        qDebug() << "Send failure for:";
-        qDebug() << packet->toString();
+        this->nbAckBundles++;
+        this->nbAcksBundled += bundle->getNbAcked();
     }
 
-    return;
+    if(!this->transmitPacket(packet))
+        DCPLOG_WARNING("Send failure for:" << endl << packet->toString());
 }
 
-void DCPServer::resendPacket(DCPPacket *packet)
+void DCPServer::resendPacket(DCPAckEntry *entry)
 {
-    QByteArray *datagram = packet->packetToData();
-    int err = this->sock->writeDatagram(datagram->data(), packet->getLenght(),
-                                packet->getAddrDst(), packet->getPortDst());
+    DCPPacket *packet = entry->packet;
+
+    /*
+     * A v1 central station drops v2 headers: the last resend of an
+     * unanswered hello is in v1, the version of the answer telling which
+     * one got through. The earlier ones stay in v2, so that a lost hello
+     * or answer does not lock a v2 peer into v1.
+     * */
+    if(packet->getCommandID() == DCP_CMDHELLOFROMREMOTE &&
+       packet->getVersion() > DCP_VERSION1 &&
+       entry->nbResend+1 >= DCP_MAXRESEND)
+    {
+        packet->setVersion(DCP_VERSION1);
+        entry->len = packet->encode(entry->data, DCPSERVER_DATAGRAMMAX);
+    }
 
-    if(err >= 0)
+    if(this->transmitEntry(entry))
     {
-        qDebug() << "Resending packet: timestamp=" << packet->getTimestamp();
-        packet->start();
-        packet->nbResend++;
+        DCPLOG_DEBUG("Resending packet: timestamp=" << packet->getTimestamp());
+        entry->nbResend++;
+        this->nbResends++;
+        this->ackMutex.lock();
+        DCPRtt &rtt = this->rtts[DCPServer::peerKey(entry->key.addr,
+                                                    entry->key.port)];
+        rtt.timedOut(entry->nbResend);
+        this->wheel.schedule(&(entry->timer), this->clock.elapsed(),
+                             rtt.timeout(entry->nbResend));
+        this->ackMutex.unlock();
     }
     else
     {
-        qDebug() << "RE-send failure for (Aborting resends): timestamp="
-                 << packet->getTimestamp();
+        DCPLOG_WARNING("RE-send failure for (Aborting resends): timestamp="
+                       << packet->getTimestamp());
         removeFromAckQueue(packet);
     }
 
@@ -81,75 +468,416 @@ void DCPServer::receiveDatagram()
 {
     QHostAddress addr;
     quint16 port;
-    qint64 dataSize = this->sock->pendingDatagramSize();
-    if(dataSize <= 0)
+    qint64 dataSize;
+    int nb = 0;
+
+    /*
+     * The first datagram is read through QUdpSocket so that Qt re-enables
+     * its read notifier, the rest of the queue is then drained in batches.
+     * */
+    if(this->sock->hasPendingDatagrams())
+    {
+        dataSize = this->sock->readDatagram(this->recvBuffers[0],
+                                            DCPSERVER_DATAGRAMMAX,
+                                            &addr, &port);
+        if(dataSize > 0)
+        {
+            this->handleDatagram(this->recvBuffers[0], dataSize, addr, port);
+            nb++;
+        }
+    }
+
+#ifdef Q_OS_LINUX
+    int got;
+    do {
+        got = this->receiveBatch();
+        for(int i=0 ; i<got ; ++i)
+        {
+            struct sockaddr *sa = (struct sockaddr*)&(this->recvAddrs[i]);
+            if(sa->sa_family == AF_INET)
+                port = ntohs(((struct sockaddr_in*)sa)->sin_port);
+            else if(sa->sa_family == AF_INET6)
+                port = ntohs(((struct sockaddr_in6*)sa)->sin6_port);
+            else
+                continue;
+
+            // Truncated datagrams can not be valid DCP packets
+            if(this->recvMsgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                continue;
+
+            this->handleDatagram(this->recvBuffers[i],
+                                 this->recvMsgs[i].msg_len,
+                                 QHostAddress(sa), port);
+        }
+        nb += got;
+    } while(got == DCPSERVER_RECVBATCH);
+#else
+    while(this->sock->hasPendingDatagrams())
+    {
+        dataSize = this->sock->readDatagram(this->recvBuffers[0],
+                                            DCPSERVER_DATAGRAMMAX,
+                                            &addr, &port);
+        if(dataSize <= 0)
+            break;
+        this->handleDatagram(this->recvBuffers[0], dataSize, addr, port);
+        nb++;
+    }
+#endif
+
+    if(nb == 0)
         return;
 
-    char* data = new char[dataSize];
-    this->sock->readDatagram(data, dataSize, &addr, &port);
+    this->nbWakeups++;
+    this->nbDatagrams += nb;
+    this->lastRecvBatch = nb;
+    if(nb > this->maxRecvBatch)
+        this->maxRecvBatch = nb;
+    DCPLOG_DEBUG("Handled " << nb << " datagram(s) in this wakeup");
+    emit datagramsReceived(nb);
+
+    // Acks and responses of the whole batch leave together
+    this->flush();
+}
+
+/*
+ * Read as many pending datagrams as possible in one system call, without
+ * blocking. Returns the number of datagrams stored in recvBuffers.
+ * */
+int DCPServer::receiveBatch()
+{
+#ifdef Q_OS_LINUX
+    for(int i=0 ; i<DCPSERVER_RECVBATCH ; ++i)
+    {
+        this->recvMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        this->recvMsgs[i].msg_hdr.msg_flags   = 0;
+    }
+
+    int got = recvmmsg(this->sock->socketDescriptor(), this->recvMsgs,
+                       DCPSERVER_RECVBATCH, MSG_DONTWAIT, NULL);
+    return (got < 0) ? 0 : got;
+#else
+    return 0;
+#endif
+}
+
+void DCPServer::handleDatagram(char *data, qint64 len, QHostAddress addr,
+                               quint16 port)
+{
+    if(len < DCP_HEADERSIZE)
+        return;
+
+    DCPPacket* packet = this->factory->commandPacketFromData(data, len);
+    if(!packet)
+        return;
 
-    DCPPacket* packet = DCPPacketFactory::commandPacketFromData(data, dataSize);
     packet->setAddrDst(addr);
     packet->setPortDst(port);
-    qDebug() << "Got packet: ";
-    qDebug() << packet->toString();
-    packet->handle(this->handler);
+    DCPLOG_DEBUG("Got packet:" << endl << packet->toString());
+    this->packetReceived(packet);
+    if(!this->handler)
+        return;
+
+    if(packet->getCommandID() == DCP_CMDACKBUNDLE)
+        this->handleAckBundle(static_cast<DCPCommandAckBundle*>(packet));
+    else
+        this->factory->dispatch(packet, this->handler);
+}
+
+/*
+ * The handlers only know plain acks: every timestamp of the bundle is
+ * dispatched as one. A handler may change the handler, it is read again
+ * for each.
+ * */
+void DCPServer::handleAckBundle(DCPCommandAckBundle *bundle)
+{
+    this->bundledAck->setVersion(bundle->getVersion());
+    this->bundledAck->setSessionID(bundle->getSessionID());
+    this->bundledAck->setAddrDst(bundle->getAddrDst());
+    this->bundledAck->setPortDst(bundle->getPortDst());
+
+    for(int i=0 ; i<bundle->getSpan() ; ++i)
+    {
+        if(!bundle->isAcked(i))
+            continue;
+
+        this->bundledAck->setTimestamp(bundle->getTimestamp() + i);
+        this->factory->dispatch(this->bundledAck, this->handler);
+    }
 }
 
-void DCPServer::dcpResponseTimeout()
+void DCPServer::wheelTick()
 {
-    DCPPacket *packet = dynamic_cast<DCPPacket*>(QObject::sender());
+    DCPTimingWheel::Timer *timer, *next;
 
-    if(packet->nbResend < DCP_MAXRESEND && packet->needResend())
+    this->ackMutex.lock();
+    timer = this->wheel.advance(this->clock.elapsed());
+    this->ackMutex.unlock();
+
+    for( ; timer!=NULL ; timer=next)
     {
-        this->resendPacket(packet);
+        next = timer->next;
+        this->dcpResponseTimeout((DCPAckEntry*)timer->data);
+    }
+
+    if(this->wheel.getNbPending() == 0)
+        this->wheelTicker.stop();
+
+    this->flush();
+}
+
+void DCPServer::dcpResponseTimeout(DCPAckEntry *entry)
+{
+    if(entry->nbResend < DCP_MAXRESEND && entry->packet->needResend())
+    {
+        this->resendPacket(entry);
     }
     else
     {
-        qDebug() << "Max resends done (Aborting resends): timestamp="
-                 << packet->getTimestamp();
-        removeFromAckQueue(packet);
+        DCPLOG_INFO("Max resends done (Aborting resends): timestamp="
+                    << entry->packet->getTimestamp());
+        this->nbGiveUps++;
+        removeFromAckQueue(entry->packet);
     }
 }
 
-void DCPServer::setMyId(qint8 myID)
+void DCPServer::setMyId(qint16 myID)
 {
     this->myID = myID;
 }
 
-void DCPServer::moveToAckQueue(DCPPacket *packet)
+DCPAckKey DCPServer::ackKey(DCPPacket *packet)
 {
+    DCPAckKey key;
+
+    key.addr        = packet->getAddrDst();
+    key.port        = packet->getPortDst();
+    key.sessID      = packet->getSessionID();
+    key.timestamp   = packet->getTimestamp();
+    return key;
+}
+
+/*
+ * Peers are keyed as the packets they ack, with a null session and
+ * timestamp.
+ * */
+DCPAckKey DCPServer::peerKey(QHostAddress addr, quint16 port)
+{
+    DCPAckKey key;
+
+    key.addr        = addr;
+    key.port        = port;
+    key.sessID      = 0;
+    key.timestamp   = 0;
+    return key;
+}
+
+bool DCPServer::getRtt(QHostAddress addr, quint16 port, DCPRtt *rtt)
+{
+    QHash<DCPAckKey, DCPRtt>::const_iterator it;
+    bool found;
+
     this->ackMutex.lock();
-    this->ackQueue.append(packet);
-    connect(packet, SIGNAL(timeout()), this, SLOT(dcpResponseTimeout()));
+    it = this->rtts.constFind(DCPServer::peerKey(addr, port));
+    found = (it != this->rtts.constEnd());
+    if(found)
+        *rtt = it.value();
     this->ackMutex.unlock();
+
+    return found;
 }
 
-void DCPServer::removeFromAckQueue(DCPPacket *packet)
+/*
+ * Called with ackMutex held, when the ack of entry comes. An ack of a
+ * resent packet may be that of any copy: it is not measured (Karn).
+ * */
+void DCPServer::measureRtt(DCPAckEntry *entry)
 {
+    if(entry->nbResend > 0)
+        return;
+
+    this->rtts[DCPServer::peerKey(entry->key.addr, entry->key.port)].sample(
+                this->clock.elapsed() - entry->sentAt);
+}
+
+DCPAckEntry* DCPServer::moveToAckQueue(DCPPacket *packet)
+{
+    DCPAckEntry *entry;
+    int timeout;
+
     this->ackMutex.lock();
-    this->ackQueue.removeOne(packet);
-    disconnect(packet, SIGNAL(timeout()), this, SLOT(dcpResponseTimeout()));
-    delete packet;
+    entry = this->freeEntries.isEmpty() ? new DCPAckEntry :
+                                          this->freeEntries.takeLast();
+    entry->len          = packet->encode(entry->data, DCPSERVER_DATAGRAMMAX);
+    entry->timer.data   = entry;
+    entry->key          = DCPServer::ackKey(packet);
+    entry->packet       = packet;
+    entry->nbResend     = 0;
+    entry->sentAt       = this->clock.elapsed();
+    this->ackInsert(entry);
+    // A peer never measured times out after DCP_TIMEOUT
+    timeout = this->rtts.value(DCPServer::peerKey(entry->key.addr,
+                                                  entry->key.port)).timeout(0);
+    this->wheel.schedule(&(entry->timer), entry->sentAt, timeout);
     this->ackMutex.unlock();
+
+    if(!this->wheelTicker.isActive())
+        this->wheelTicker.start();
+
+    return entry;
 }
 
-DCPPacket* DCPServer::findInAckQueue(qint32 timestamp)
+void DCPServer::removeFromAckQueue(DCPPacket *packet)
 {
-    DCPPacket* packet=NULL;
+    DCPAckEntry **link;
+
+    if(!packet)
+        return;
+
     this->ackMutex.lock();
-    foreach (packet, this->ackQueue) {
-        if(packet->getTimestamp() == timestamp)
+    for(link=this->ackBucket(DCPServer::ackKey(packet)) ; *link ;
+        link=&((*link)->hashNext))
+    {
+        if((*link)->packet == packet)
         {
-            this->ackMutex.unlock();
-            return packet;
+            this->wheel.cancel(&((*link)->timer));
+            this->freeEntries.append(*link);
+            *link = (*link)->hashNext;
+            this->nbAckEntries--;
+            break;
         }
     }
+    this->releasePacket(packet);
+    this->ackMutex.unlock();
+}
+
+/*
+ * Find the packet acknowledged by ack. The ack comes from the peer the
+ * packet was sent to, and echoes its session ID and timestamp.
+ * */
+DCPPacket* DCPServer::findInAckQueue(DCPPacket *ack)
+{
+    DCPAckEntry *entry;
 
+    this->ackMutex.lock();
+    entry = this->ackFind(DCPServer::ackKey(ack));
+    if(entry)
+        this->measureRtt(entry);
+    this->ackMutex.unlock();
+
+    return entry ? entry->packet : NULL;
+}
+
+/*
+ * Remove the packet acked by (addr, port, sessID, timestamp) from the ack
+ * queue, for acks which were not received through this server's handler.
+ * */
+bool DCPServer::acknowledge(QHostAddress addr, quint16 port, qint16 sessID,
+                            qint32 timestamp)
+{
+    DCPAckEntry *entry;
+    DCPAckKey key;
+
+    key.addr        = addr;
+    key.port        = port;
+    key.sessID      = sessID;
+    key.timestamp   = timestamp;
+
+    this->ackMutex.lock();
+    entry = this->ackFind(key);
+    if(entry)
+        this->measureRtt(entry);
     this->ackMutex.unlock();
+
+    if(!entry)
+        return false;
+
+    this->removeFromAckQueue(entry->packet);
+    return true;
+}
+
+/*
+ * The ack queue buckets, called with ackMutex held. Their number is a
+ * power of two.
+ * */
+DCPAckEntry** DCPServer::ackBucket(const DCPAckKey &key)
+{
+    return &(this->ackBuckets[qHash(key) & (this->ackBuckets.size()-1)]);
+}
+
+DCPAckEntry* DCPServer::ackFind(const DCPAckKey &key)
+{
+    DCPAckEntry *entry;
+
+    for(entry=*(this->ackBucket(key)) ; entry ; entry=entry->hashNext)
+        if(entry->key == key)
+            return entry;
     return NULL;
 }
 
+/*
+ * The buckets double when there are more entries than buckets: as the
+ * entries are pooled, the queue stops allocating once it has held its
+ * peak number of pending packets.
+ * */
+void DCPServer::ackInsert(DCPAckEntry *entry)
+{
+    DCPAckEntry **bucket;
+
+    if(this->nbAckEntries >= this->ackBuckets.size())
+        this->ackRehash(this->ackBuckets.size()*2);
+
+    bucket = this->ackBucket(entry->key);
+    entry->hashNext = *bucket;
+    *bucket = entry;
+    this->nbAckEntries++;
+}
+
+void DCPServer::ackRehash(int nbBuckets)
+{
+    QVector<DCPAckEntry*> old(nbBuckets, NULL);
+    DCPAckEntry *entry, *next, **bucket;
+
+    this->ackBuckets.swap(old);
+    foreach (entry, old) {
+        for( ; entry ; entry=next) {
+            next = entry->hashNext;
+            bucket = this->ackBucket(entry->key);
+            entry->hashNext = *bucket;
+            *bucket = entry;
+        }
+    }
+}
+
+/*
+ * Storage of a sent packet of type cmdID, or NULL if there is none left.
+ * */
+void* DCPServer::takePacket(quint8 cmdID)
+{
+    void *storage = NULL;
+
+    this->poolMutex.lock();
+    if(!this->freePackets[cmdID].isEmpty())
+        storage = this->freePackets[cmdID].takeLast();
+    this->poolMutex.unlock();
+
+    return storage;
+}
+
+/*
+ * The packet is destroyed but its storage is kept for the next packet of
+ * the same type. Pools only grow to the peak number of packets of a type
+ * in flight.
+ * */
+void DCPServer::releasePacket(DCPPacket *packet)
+{
+    quint8 cmdID = packet->getCommandID();
+
+    packet->~DCPPacket();
+    this->poolMutex.lock();
+    this->freePackets[cmdID].append(packet);
+    this->poolMutex.unlock();
+}
+
 void DCPServer::setHandler(DCPPacketHandlerInterface *handler)
 {
     this->handler = handler;
@@ -22,14 +22,82 @@
 #define DCPSERVER_H
 
 #include <QtGlobal>
-#include <QTime>
-#include <QLinkedList>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QVector>
 #include <QMutex>
 #include <QUdpSocket>
 
+#include <new>
+
+#include <dcp.h>
+#include <dcprtt.h>
+#include <dcptimingwheel.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+/* --- Receive / send batching --- */
+#define DCPSERVER_RECVBATCH     (32)
+#define DCPSERVER_SENDBATCH     (32)
+#define DCPSERVER_DATAGRAMMAX   (4096)
+
+/* --- Ack queue --- */
+#define DCPSERVER_ACKBUCKETS    (1024)  // initial, doubled when full
+
 class DCPPacket;
+class DCPPacketFactory;
 class DCPPacketHandlerInterface;
+class DCPCommandAck;
+class DCPCommandAckBundle;
+template<class TYPE> struct DCPCommandID;
+
+
+/*
+ * Identifies a packet waiting for an ack: the peer it was sent to, and the
+ * session ID and timestamp the ack echoes back.
+ * */
+struct DCPAckKey
+{
+    QHostAddress    addr;
+    quint16         port;
+    qint16          sessID;
+    qint32          timestamp;
+};
+
+inline bool operator==(const DCPAckKey &a, const DCPAckKey &b)
+{
+    return a.timestamp == b.timestamp && a.sessID == b.sessID &&
+           a.port == b.port && a.addr == b.addr;
+}
+
+inline uint qHash(const DCPAckKey &key, uint seed=0)
+{
+    return qHash(key.addr, seed) ^ (((uint)key.port << 16) |
+                                    (uint)(quint16)key.sessID) ^
+           ((uint)key.timestamp * 2654435761U);
+}
 
+/*
+ * Packet waiting for an ack, with its retransmission timer. The packet is
+ * encoded once in data, resends transmit the same bytes. Entries are
+ * chained in the ack queue buckets through hashNext.
+ * */
+struct DCPAckEntry
+{
+    DCPTimingWheel::Timer   timer;
+    DCPAckEntry             *hashNext;
+    DCPAckKey               key;
+    DCPPacket               *packet;
+    int                     nbResend;
+    qint64                  sentAt;     // msec, first transmission
+    int                     len;
+    char                    data[DCPSERVER_DATAGRAMMAX];
+};
 
 
 class DCPServer : public QObject
@@ -38,40 +106,197 @@ class DCPServer : public QObject
 
 public:
     DCPServer(QUdpSocket *sock);
+    ~DCPServer();
 
     inline DCPPacketHandlerInterface*  getHandler() { return this->handler; }
 
-    void            moveToAckQueue(DCPPacket* packet);
+    /*
+     * Packets to send are taken from the server's pool, and given back to
+     * it by sendPacket() once sent or acked: the caller never deletes them.
+     * Only a packet type never sent before allocates.
+     * */
+    template<class T>
+    T*              newPacket(qint16 sessID=DCP_SESSIDCENTRAL,
+                              qint32 timestamp=0);
+
+    DCPAckEntry*    moveToAckQueue(DCPPacket* packet);
     void            removeFromAckQueue(DCPPacket* packet);
-    DCPPacket*      findInAckQueue(qint32 timestamp);
+    DCPPacket*      findInAckQueue(DCPPacket* ack);
+    bool            acknowledge(QHostAddress addr, quint16 port, qint16 sessID,
+                                qint32 timestamp);
 
     // TODO: Make avaliable only to friends
-    void            setMyId(qint8 myID);
-    inline qint8    getMyId()
+    void            setMyId(qint16 myID);
+    inline qint16   getMyId()
         { return this->myID; }
     void            setHandler(DCPPacketHandlerInterface *handler);
-    inline int      msecSinceStart()
-        { return this->time.elapsed(); }
+    // Timestamp of the packets sent now, on a monotonic clock
+    inline qint32   timestamp()
+        { return DCP_TIMESTAMP(this->clock.elapsed() + this->clockOffset); }
+    // Fast-forwards the timestamps, to test their wraparound
+    inline void     setClockOffset(qint64 msec)
+        { this->clockOffset = msec; }
+    // Msec v2 acks wait to be bundled, 0 sends each at once
+    inline void     setAckDelay(int msec)
+        { this->ackDelay = msec; }
+
+    // Receive statistics
+    inline int      getLastRecvBatch()  { return this->lastRecvBatch;   }
+    inline int      getMaxRecvBatch()   { return this->maxRecvBatch;    }
+    inline quint64  getNbWakeups()      { return this->nbWakeups;       }
+    inline quint64  getNbDatagrams()    { return this->nbDatagrams;     }
+
+    // Send statistics
+    inline quint64  getNbSendCalls()    { return this->nbSendCalls;     }
+    inline quint64  getNbDatagramsSent(){ return this->nbDatagramsSent; }
+    inline quint64  getNbSendErrors()   { return this->nbSendErrors;    }
+    inline quint64  getNbAckBundles()   { return this->nbAckBundles;    }
+    inline quint64  getNbAcksBundled()  { return this->nbAcksBundled;   }
+
+    // Retransmission statistics
+    inline int      getNbPendingTimers(){ return this->wheel.getNbPending();}
+    inline quint64  getNbResends()      { return this->nbResends;       }
+    inline quint64  getNbGiveUps()      { return this->nbGiveUps;       }
+    // RTT and retransmission timeout of a peer, false before any packet
+    bool            getRtt(QHostAddress addr, quint16 port, DCPRtt *rtt);
 
 public slots:
     void sendPacket(DCPPacket* packet);
+    void sendAck(DCPPacket* packet);
     void receiveDatagram();
-    void dcpResponseTimeout();
+    void flush();
+    void flushAcks();
+
+signals:
+    void datagramsReceived(int nb);
 
 protected:
     QUdpSocket      *sock;
     DCPPacketHandlerInterface   *handler;
 
-    QTime           time;
-    qint8           myID;
+    qint16          myID;
 
     QMutex                  ackMutex;
-    QLinkedList<DCPPacket*> ackQueue;
+
+    static DCPAckKey ackKey(DCPPacket* packet);
+    static DCPAckKey peerKey(QHostAddress addr, quint16 port);
+    // Every valid packet received, before it is dispatched to the handler
+    virtual void    packetReceived(DCPPacket* packet) { Q_UNUSED(packet); }
+
+private slots:
+    void wheelTick();
 
 private:
-    void resendPacket(DCPPacket* packet);
+    bool transmitPacket(DCPPacket* packet);
+    bool transmitEntry(DCPAckEntry* entry);
+    char* sendSlot();
+    bool queueDatagram(int len, const QHostAddress &addr, quint16 port);
+    void resendPacket(DCPAckEntry* entry);
+    void dcpResponseTimeout(DCPAckEntry* entry);
+    void measureRtt(DCPAckEntry* entry);
+    void handleDatagram(char *data, qint64 len, QHostAddress addr,
+                        quint16 port);
+    void handleAckBundle(DCPCommandAckBundle *bundle);
+    void delayAck(DCPPacket* packet);
+    void piggybackAcks(DCPPacket* packet);
+    void transmitAcks(DCPCommandAckBundle *bundle);
+    int  receiveBatch();
+    void*           takePacket(quint8 cmdID);
+    void            releasePacket(DCPPacket* packet);
+    DCPAckEntry**   ackBucket(const DCPAckKey &key);
+    DCPAckEntry*    ackFind(const DCPAckKey &key);
+    void            ackInsert(DCPAckEntry *entry);
+    void            ackRehash(int nbBuckets);
+
+    /*
+     * Packets waiting for an ack, indexed by (peer, session ID, timestamp)
+     * in a chained hash whose entries are the pooled DCPAckEntry: queuing
+     * a packet allocates nothing once the buckets have grown to the peak
+     * number of pending packets. Every one has a timer in the wheel, which
+     * is driven by a single ticker running only while timers are pending.
+     * */
+    QVector<DCPAckEntry*>               ackBuckets;
+    int                                 nbAckEntries;
+    QElapsedTimer                       clock;
+    qint64                              clockOffset;    // msec
+    DCPTimingWheel                      wheel;
+    QTimer                              wheelTicker;
+    QVector<DCPAckEntry*>               freeEntries;
+    QHash<DCPAckKey, DCPRtt>            rtts;   // by peerKey()
+    quint64                             nbResends;
+    quint64                             nbGiveUps;
+
+    // Storage of the sent packets, by command ID, see newPacket()
+    QVector<void*>          freePackets[DCP_NBCOMMANDS];
+    QMutex                  poolMutex;
+
+    // Decoded packets and outgoing acks are reused, never allocated
+    DCPPacketFactory        *factory;
+    DCPCommandAck           *ackPacket;
+    DCPCommandAck           *bundledAck;
+
+    /*
+     * v2 acks waiting to be sent, one bundle per (peer, session ID) with a
+     * null timestamp. They leave when ackTimer fires, ackDelay after the
+     * first one, or just before a packet sent on the same session.
+     * */
+    QHash<DCPAckKey, DCPCommandAckBundle*>  pendingAcks;
+    QVector<DCPCommandAckBundle*>           freeBundles;
+    QTimer                                  ackTimer;
+    int                                     ackDelay;   // msec
+
+    /*
+     * Receive buffers are allocated once and reused for every wakeup; the
+     * socket is drained DCPSERVER_RECVBATCH datagrams at a time.
+     * */
+    char            recvBuffers[DCPSERVER_RECVBATCH][DCPSERVER_DATAGRAMMAX];
+#ifdef Q_OS_LINUX
+    struct mmsghdr          recvMsgs[DCPSERVER_RECVBATCH];
+    struct iovec            recvIovecs[DCPSERVER_RECVBATCH];
+    struct sockaddr_storage recvAddrs[DCPSERVER_RECVBATCH];
+#endif
+
+    int             lastRecvBatch;
+    int             maxRecvBatch;
+    quint64         nbWakeups;
+    quint64         nbDatagrams;
+
+    /*
+     * Outgoing datagrams are encoded in the send buffers and queued; the
+     * queue is flushed with one system call at the end of the event loop
+     * iteration, of a receive wakeup or of a timer tick, or by flush().
+     * */
+    char            sendBuffers[DCPSERVER_SENDBATCH][DCPSERVER_DATAGRAMMAX];
+#ifdef Q_OS_LINUX
+    struct mmsghdr          sendMsgs[DCPSERVER_SENDBATCH];
+    struct iovec            sendIovecs[DCPSERVER_SENDBATCH];
+    struct sockaddr_storage sendAddrs[DCPSERVER_SENDBATCH];
+    int             sendFd;
+    int             sendFamily;
+#endif
+    int             nbQueued;
+    bool            flushPending;
+
+    quint64         nbSendCalls;
+    quint64         nbDatagramsSent;
+    quint64         nbSendErrors;
+    quint64         nbAckBundles;
+    quint64         nbAcksBundled;
 };
 
 
 
+/*
+ * The storage of a sent packet of the same type is constructed anew.
+ * */
+template<class T>
+T* DCPServer::newPacket(qint16 sessID, qint32 timestamp)
+{
+    void *storage = this->takePacket(DCPCommandID<T>::ID);
+
+    if(!storage)
+        return new T(sessID, timestamp);
+    return new (storage) T(sessID, timestamp);
+}
+
 #endif // DCPSERVER_H
@@ -21,195 +21,221 @@
 #include "dcpservercentral.h"
 #include "dcp.h"
 #include "dcpcommands.h"
+#include "dcplog.h"
 
-#include <QSqlQuery>
-#include <QSqlError>
-
-#define PINGDRONES_TIMEOUT      (3000)
+/*
+ * Standalone central station: loads its own registry from storage, which
+ * it takes over and which must be initialised, and writes it back there.
+ * */
+DCPServerCentral::DCPServerCentral(QUdpSocket *sock,
+                                   DCPCentralStorage *storage) :
+    DCPServer(sock),
+    registry(new DCPCentralRegistry()),
+    storage(storage),
+    liveness(new DCPLiveness()),
+    ownStorage(true),
+    worker(0)
+{
+    if(!this->storage->load(this->registry))
+        DCPLOG_CRITICAL("Could not load the registry from the storage");
+    this->storage->start();
+    this->init();
+}
 
-DCPServerCentral::DCPServerCentral(QUdpSocket *sock, QSqlDatabase db) :
+/*
+ * Central station sharing its registry, storage and liveness tracker with
+ * others.
+ * */
+DCPServerCentral::DCPServerCentral(QUdpSocket *sock,
+                                   DCPCentralRegistry *registry,
+                                   DCPCentralStorage *storage,
+                                   DCPLiveness *liveness) :
     DCPServer(sock),
-    db(db)
+    registry(registry),
+    storage(storage),
+    liveness(liveness),
+    ownStorage(false),
+    worker(0)
+{
+    this->init();
+}
+
+void DCPServerCentral::init()
 {
     this->myID = DCP_IDCENTRAL;
     this->handler = new DCPPacketHandlerCentralStation(this);
-    this->pingDronesTimer.start(PINGDRONES_TIMEOUT);
-    connect(&(this->pingDronesTimer), SIGNAL(timeout()),
-            this, SLOT(pingDrones()));
+    this->pingTimer.setInterval(this->liveness->getTickMsec());
+    connect(&(this->pingTimer), SIGNAL(timeout()), this, SLOT(pingTick()));
+    this->pingTimer.start();
 }
 
-DCPServerCentral::remote_t*
-DCPServerCentral::addNewDrone(QHostAddress addr, quint16 port, QString info)
+DCPServerCentral::~DCPServerCentral()
 {
-    DCPServerCentral::remote_t* remote = new DCPServerCentral::remote_t;
-
-    // Insert new entry
-    QSqlQuery query(this->db);
-    query.prepare("INSERT INTO " + QString(DCP_DBSTATIONS) +
-                  " (type, ip, port, info) VALUES ('drone', ?, ?, ?)");
-    query.bindValue(0, addr.toString());
-    query.bindValue(1, port);
-    query.bindValue(2, info);
-    if(!query.exec())
+    if(this->ownStorage)
     {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
+        delete this->liveness;
+        this->storage->stop();
+        delete this->storage;
+        delete this->registry;
     }
+}
 
-    qWarning() << "Sucessfully added new Drone:" << query.lastQuery();
-    remote->addr = addr;
-    remote->port = port;
-    remote->info = info;
-
-    // Get new entry id and date
-    query.clear();
-    query.prepare("SELECT id, date FROM " + QString(DCP_DBSTATIONS) +
-                  " WHERE type='drone' AND ip=? AND port=? AND info=?");
-    query.bindValue(0, addr.toString());
-    query.bindValue(1, port);
-    query.bindValue(2, info);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
-    remote->id      = query.value(0).toInt();
-    remote->date    = query.value(1).toDateTime();
+void DCPServerCentral::setPingDrones(bool enabled)
+{
+    if(enabled)
+        this->pingTimer.start();
+    else
+        this->pingTimer.stop();
+}
 
-    return remote;
+/*
+ * Everything but the hellos is sent on a central session: the station at
+ * the other end of it is alive.
+ * */
+void DCPServerCentral::packetReceived(DCPPacket *packet)
+{
+    DCPServerCentral::session_t session;
+    qint16 sessID = packet->getSessionID();
+
+    if(sessID == DCP_SESSIDCENTRAL ||
+       !this->registry->getSession(sessID, &session))
+        return;
+
+    if(session.station1 == DCP_IDCENTRAL)
+        this->liveness->seen(session.station2, this->worker);
+    else if(session.station2 == DCP_IDCENTRAL)
+        this->liveness->seen(session.station1, this->worker);
 }
 
-DCPServerCentral::remote_t*
-DCPServerCentral::addNewCommandStation(QHostAddress addr, quint16 port,
-                                       QString info)
+void DCPServerCentral::notifyUnmatchedAck(DCPPacket *ack)
 {
-    DCPServerCentral::remote_t* remote = new DCPServerCentral::remote_t;
-
-    // Insert new entry
-    QSqlQuery query(this->db);
-    query.prepare("INSERT INTO " + QString(DCP_DBSTATIONS) +
-                  " (type, ip, port, info) VALUES ('command', ?, ?, ?)");
-    query.bindValue(0, addr.toString());
-    query.bindValue(1, port);
-    query.bindValue(2, info);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
+    emit unmatchedAck(ack->getAddrDst(), ack->getPortDst(),
+                      ack->getSessionID(), ack->getTimestamp());
+}
 
-    qWarning() << "Sucessfully added new Command Station:" << query.lastQuery();
-    remote->addr = addr;
-    remote->port = port;
-    remote->info = info;
-
-    // Get new entry id and date
-    query.clear();
-    query.prepare("SELECT id, date FROM " + QString(DCP_DBSTATIONS) +
-                  " WHERE type='command' AND ip=? AND port=? AND info=?");
-    query.bindValue(0, addr.toString());
-    query.bindValue(1, port);
-    query.bindValue(2, info);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
-    remote->id      = query.value(0).toInt();
-    remote->date    = query.value(1).toDateTime();
+/*
+ * A station's packets are sent by its owner, the worker its traffic
+ * arrives at, so that their acks arrive there too. Worker 0 sends to the
+ * stations not heard from yet.
+ * */
+void DCPServerCentral::sendToStation(qint16 id, DCPPacket *packet)
+{
+    int owner = qMax(0, this->liveness->getOwner(id));
+
+    if(owner == this->worker)
+        this->sendPacket(packet);
+    else
+        emit packetForOwner(owner, packet);
+}
+
+void DCPServerCentral::writeBehind(int statement, const QVariantList &values)
+{
+    this->storage->submit(statement, values, this, "writeDone");
+}
+
+/*
+ * The registry is authoritative: a failed write is only reported. The id
+ * of a deleted station is given out again once its row is gone, and never
+ * if it could not be deleted.
+ * */
+void DCPServerCentral::writeDone(int statement, const QVariantList &values,
+                                 bool ok)
+{
+    if(!ok)
+        DCPLOG_WARNING("Could not write back: "
+                       << DCPCentralStorage::statementName(statement)
+                       << (statement == DCPCentralStorage::DeleteStation ?
+                               ", its id stays reserved" : ""));
+    else if(statement == DCPCentralStorage::DeleteStation)
+        this->registry->releaseStationId(values.at(0).toInt());
+}
 
-    return remote;
+bool DCPServerCentral::addNewDrone(QHostAddress addr, quint16 port,
+                                   QString info, qint8 protocol,
+                                   remote_t *remote)
+{
+    return this->addNewStation("drone", addr, port, info, protocol, remote);
 }
 
-bool DCPServerCentral::addNewVideoServers(qint8 id, QString videoServers)
+bool DCPServerCentral::addNewCommandStation(QHostAddress addr, quint16 port,
+                                            QString info, qint8 protocol,
+                                            remote_t *remote)
 {
+    return this->addNewStation("command", addr, port, info, protocol, remote);
+}
 
-    QSqlQuery query(this->db);
-    query.prepare("INSERT INTO " + QString(DCP_DBVIDEOSERVERS) +
-                  " (id, videos) VALUES (?, ?)");
-    query.bindValue(0, id);
-    query.bindValue(1, videoServers);
-    if(!query.exec())
+bool DCPServerCentral::addNewStation(const QString &type, QHostAddress addr,
+                                     quint16 port, QString info,
+                                     qint8 protocol, remote_t *remote)
+{
+    DCPServerCentral::remote_t station;
+
+    station.type    = type;
+    station.addr    = addr;
+    station.port    = port;
+    station.date    = QDateTime::currentDateTime();
+    station.info    = info;
+    station.protocol= protocol;
+    if(!this->registry->addStation(&station))
     {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
+        DCPLOG_WARNING("No station id left for " << type << " "
+                       << addr.toString() << ":" << port);
         return false;
     }
-    qWarning() << "Sucessfully added new Video servers:" << query.lastQuery();
+
+    DCPLOG_INFO("Added new station: " << type << " " << station.id
+                << " (DCP v" << (int)protocol << ")");
+    this->liveness->seen(station.id, this->worker);
+    this->writeBehind(DCPCentralStorage::InsertStation,
+                      QVariantList() << station.id << type << addr.toString()
+                                     << port << station.date << info
+                                     << protocol);
+    if(remote)
+        *remote = station;
     return true;
 }
 
-DCPServerCentral::session_t*
-DCPServerCentral::addNewSession(qint8 station1, qint8 station2)
+bool DCPServerCentral::addNewVideoServers(qint16 id, QString videoServers)
 {
-    DCPServerCentral::session_t* session = new DCPServerCentral::session_t;
-
-    // Insert new entry
-    QSqlQuery query(this->db);
-    query.prepare("INSERT INTO " + QString(DCP_DBSESSIONS) +
-                  " (station1, station2) VALUES (?, ?)");
-    query.bindValue(0, station1);
-    query.bindValue(1, station2);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
+    this->registry->setVideoServers(id, videoServers);
+    this->writeBehind(DCPCentralStorage::InsertVideoServers,
+                      QVariantList() << id << videoServers);
+    return true;
+}
 
-    qWarning() << "Sucessfully added new Session:" << query.lastQuery();
-    session->station1   = station1;
-    session->station2   = station2;
-
-    // Get new entry id and date
-    query.clear();
-    query.prepare("SELECT id, date FROM " + QString(DCP_DBSESSIONS) +
-                  " WHERE station1=? AND station2=?");
-    query.bindValue(0, station1);
-    query.bindValue(1, station2);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
+bool DCPServerCentral::addNewSession(qint16 station1, qint16 station2,
+                                     session_t *session)
+{
+    DCPServerCentral::session_t added;
+
+    added.station1  = station1;
+    added.station2  = station2;
+    added.date      = QDateTime::currentDateTime();
+    if(!this->registry->addSession(&added))
     {
-        // TODO: log ?
-        return NULL;
+        DCPLOG_WARNING("No session id left for stations " << station1
+                       << " and " << station2);
+        return false;
     }
-    session->id      = query.value(0).toInt();
-    session->date    = query.value(1).toDateTime();
 
-    return session;
+    DCPLOG_INFO("Added new session: " << added.id);
+    this->writeBehind(DCPCentralStorage::InsertSession,
+                      QVariantList() << added.id << station1 << station2
+                                     << added.date);
+    if(session)
+        *session = added;
+    return true;
 }
 
-bool DCPServerCentral::addNewLog(qint8 id, DCPCommandLog::logLevel level,
-                                 QString msg)
+/*
+ * The log is acked by logsWritten() once the storage has it: an ack
+ * tells the remote its log will not be lost.
+ * */
+bool DCPServerCentral::addNewLog(qint16 id, DCPCommandLog *log)
 {
+    DCPServerCentral::logAck_t ack;
     QString levelStr;
-    switch(level)
+    switch(log->getLogLevel())
     {
     case DCPCommandLog::Info:
         levelStr = QString(DCP_DBLOGINFO);
@@ -227,301 +253,263 @@ bool DCPServerCentral::addNewLog(qint8 id, DCPCommandLog::logLevel level,
         return false;
     }
 
-    QSqlQuery query(this->db);
-    query.prepare("INSERT INTO " + QString(DCP_DBLOGS) +
-                  " (id, level, msg) VALUES (?, ?, ?)");
-    query.bindValue(0, id);
-    query.bindValue(1, levelStr);
-    query.bindValue(2, msg);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
+    if(!this->storage->submitLog(id, levelStr, log->getMsg(),
+                                 this, "logsWritten"))
         return false;
-    }
+
+    ack.version     = log->getVersion();
+    ack.sessID      = log->getSessionID();
+    ack.timestamp   = log->getTimestamp();
+    ack.addr        = log->getAddrDst();
+    ack.port        = log->getPortDst();
+    this->pendingLogs.append(ack);
     return true;
 }
 
-bool DCPServerCentral::deleteVideoServers(qint8 id)
+/*
+ * Not acked when the write failed: the remotes send them again.
+ * */
+void DCPServerCentral::logsWritten(int nbLogs, bool ok)
 {
-    QSqlQuery query(this->db);
-    query.prepare("DELETE FROM " + QString(DCP_DBVIDEOSERVERS) +
-                  " WHERE id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
+    DCPServerCentral::logAck_t ack;
+
+    for(int i=0 ; i<nbLogs && !this->pendingLogs.isEmpty() ; ++i)
     {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return false;
+        ack = this->pendingLogs.takeFirst();
+        if(!ok)
+            continue;
+
+        this->logAck.setVersion(ack.version);
+        this->logAck.setSessionID(ack.sessID);
+        this->logAck.setTimestamp(ack.timestamp);
+        this->logAck.setAddrDst(ack.addr);
+        this->logAck.setPortDst(ack.port);
+        this->sendAck(&(this->logAck));
     }
+    this->flush();
+}
 
-    qWarning() << "Sucessfully deleted video servers :"
-               << query.lastQuery();
+bool DCPServerCentral::deleteVideoServers(qint16 id)
+{
+    if(!this->registry->removeVideoServers(id))
+        return false;
+
+    this->writeBehind(DCPCentralStorage::DeleteVideoServers,
+                      QVariantList() << id);
     return true;
 }
 
-bool DCPServerCentral::deleteSession(qint8 id)
+bool DCPServerCentral::deleteSession(qint16 id)
 {
-    QSqlQuery query(this->db);
-    query.prepare("DELETE FROM " + QString(DCP_DBSESSIONS) +
-                  " WHERE id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
+    if(!this->registry->removeSession(id))
         return false;
-    }
 
-    qWarning() << "Sucessfully deleted Session :"
-               << query.lastQuery();
+    this->writeBehind(DCPCentralStorage::DeleteSession,
+                      QVariantList() << id);
     return true;
 }
 
-bool DCPServerCentral::deleteStationById(qint8 id)
+bool DCPServerCentral::deleteStationById(qint16 id)
 {
-    QSqlQuery query(this->db);
-    query.prepare("DELETE FROM " + QString(DCP_DBSTATIONS) + " WHERE id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
+    if(!this->registry->removeStation(id))
         return false;
-    }
 
-    qWarning() << "Sucessfully deleted Station:" << query.lastQuery();
+    this->writeBehind(DCPCentralStorage::DeleteStation,
+                      QVariantList() << id);
     return true;
 }
 
-DCPServerCentral::session_t*
-DCPServerCentral::getDroneSessionForStation(qint8 id)
+bool DCPServerCentral::getDroneSessionForStation(qint16 id, session_t *session)
 {
-    DCPServerCentral::session_t* session = new DCPServerCentral::session_t;
-
-    QSqlQuery query(this->db);
-    query.prepare("SELECT id, station1, station2, date FROM " +
-                  QString(DCP_DBSESSIONS) + " WHERE (station1=? OR station2=?)"
-                  " AND (station1!=0 AND station2!=0)");
-    query.bindValue(0, id);
-    query.bindValue(1, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
+    DCPServerCentral::session_t found;
 
-    session->id = query.value(0).toInt();
-    session->station1 = query.value(1).toInt();
-    session->station2 = query.value(2).toInt();
-    session->date = QDateTime::fromString(query.value(3).toString());
-
-    return session;
+    if(!this->registry->getDroneSessionForStation(id, &found))
+        return false;
+    if(session)
+        *session = found;
+    return true;
 }
 
-DCPServerCentral::session_t*
-DCPServerCentral::getCentralSessionForStation(qint8 id)
+bool DCPServerCentral::getCentralSessionForStation(qint16 id,
+                                                   session_t *session)
 {
-    DCPServerCentral::session_t* session = new DCPServerCentral::session_t;
-
-    QSqlQuery query(this->db);
-    query.prepare("SELECT id, station1, station2, date FROM " +
-                  QString(DCP_DBSESSIONS) + " WHERE (station1=? OR station2=?)"
-                  " AND (station1=0 OR station2=0)");
-    query.bindValue(0, id);
-    query.bindValue(1, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
+    DCPServerCentral::session_t found;
 
-    session->id = query.value(0).toInt();
-    session->station1 = query.value(1).toInt();
-    session->station2 = query.value(2).toInt();
-    session->date = QDateTime::fromString(query.value(3).toString());
-
-    return session;
+    if(!this->registry->getCentralSessionForStation(id, &found))
+        return false;
+    if(session)
+        *session = found;
+    return true;
 }
 
-DCPServerCentral::remote_t*
-DCPServerCentral::getStation(qint8 id)
+bool DCPServerCentral::getStation(qint16 id, remote_t *remote)
 {
-    DCPServerCentral::remote_t* remote = new DCPServerCentral::remote_t;
+    DCPServerCentral::remote_t found;
 
-    QSqlQuery query(this->db);
-    query.prepare("SELECT type, ip, port, date, info FROM " +
-                  QString(DCP_DBSTATIONS) + " WHERE id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
+    if(!this->registry->getStation(id, &found))
+        return false;
+    if(remote)
+        *remote = found;
+    return true;
+}
 
-    remote->id      = id;
-    remote->type    = query.value(0).toString();
-    remote->addr    = QHostAddress(query.value(1).toString());
-    remote->port    = query.value(2).toInt();
-    remote->date    = QDateTime::fromString(query.value(3).toString());
-    remote->info    = query.value(4).toString();
+bool DCPServerCentral::stationIsDrone(qint16 id, remote_t *remote)
+{
+    DCPServerCentral::remote_t found;
 
-    return remote;
+    if(!this->registry->getStationOfType(id, "drone", &found))
+        return false;
+    if(remote)
+        *remote = found;
+    return true;
 }
 
-DCPServerCentral::remote_t*
-DCPServerCentral::stationIsDrone(qint8 id)
+bool DCPServerCentral::stationIsCommand(qint16 id, remote_t *remote)
 {
-    DCPServerCentral::remote_t* remote = new DCPServerCentral::remote_t;
+    DCPServerCentral::remote_t found;
 
-    QSqlQuery query(this->db);
-    query.prepare("SELECT type, ip, port, date, info FROM " +
-                  QString(DCP_DBSTATIONS) + " WHERE type='drone' AND id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
+    if(!this->registry->getStationOfType(id, "command", &found))
+        return false;
+    if(remote)
+        *remote = found;
+    return true;
+}
 
-    remote->id      = id;
-    remote->type    = query.value(0).toString();
-    remote->addr    = QHostAddress(query.value(1).toString());
-    remote->port    = query.value(2).toInt();
-    remote->date    = QDateTime::fromString(query.value(3).toString());
-    remote->info    = query.value(4).toString();
+bool DCPServerCentral::sessionIsCentral(qint16 id, session_t *session)
+{
+    DCPServerCentral::session_t found;
 
-    return remote;
+    if(!this->registry->getSession(id, &found) ||
+       (found.station1 != DCP_IDCENTRAL && found.station2 != DCP_IDCENTRAL))
+        return false;
+    if(session)
+        *session = found;
+    return true;
 }
 
-DCPServerCentral::remote_t*
-DCPServerCentral::stationIsCommand(qint8 id)
+/*
+ * Tear down the drone session of a station, telling the other end of it.
+ * */
+bool DCPServerCentral::dropDroneSession(qint16 stationId)
 {
-    DCPServerCentral::remote_t* remote = new DCPServerCentral::remote_t;
+    DCPServerCentral::session_t sessionDrone, sessionCentral;
+    DCPServerCentral::remote_t station2;
+    qint16 station2Id;
 
-    QSqlQuery query(this->db);
-    query.prepare("SELECT type, ip, port, date, info FROM " +
-                  QString(DCP_DBSTATIONS) + " WHERE type='command' AND id=?");
-    query.bindValue(0, id);
-    if(!query.exec())
-    {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
-    }
-    if(!query.next())
-    {
-        // TODO: log ?
-        return NULL;
-    }
+    if(!this->registry->getDroneSessionForStation(stationId, &sessionDrone))
+        return false;
 
-    remote->id      = id;
-    remote->type    = query.value(0).toString();
-    remote->addr    = QHostAddress(query.value(1).toString());
-    remote->port    = query.value(2).toInt();
-    remote->date    = QDateTime::fromString(query.value(3).toString());
-    remote->info    = query.value(4).toString();
+    station2Id = (sessionDrone.station1 == stationId) ? sessionDrone.station2 :
+                                                        sessionDrone.station1;
+    this->deleteSession(sessionDrone.id);
 
-    return remote;
+    if(this->registry->getStation(station2Id, &station2) &&
+       this->registry->getCentralSessionForStation(station2Id,
+                                                   &sessionCentral))
+    {
+        DCPCommandDisconnect *disconn =
+                this->newPacket<DCPCommandDisconnect>(sessionCentral.id);
+        disconn->setVersion(station2.protocol);
+        disconn->setAddrDst(station2.addr);
+        disconn->setPortDst(station2.port);
+        disconn->setTimestamp(this->timestamp());
+        this->sendToStation(station2Id, disconn);
+    }
+    return true;
 }
 
-DCPServerCentral::session_t*
-DCPServerCentral::sessionIsCentral(qint8 id)
+/*
+ * Update the liveness of the stations whose slot's turn it is and of the
+ * suspected ones, and ping those due. Only that share of the stations is
+ * copied from the registry, and no storage is accessed.
+ * */
+void DCPServerCentral::pingTick()
 {
-    DCPServerCentral::session_t* session = new DCPServerCentral::session_t;
-
-    QSqlQuery query(this->db);
-    query.prepare("SELECT station1, station2, date FROM " +
-                  QString(DCP_DBSESSIONS) +
-                  " WHERE id=? AND (station1=0 OR station2=0)");
-    query.bindValue(0, id);
-    if(!query.exec())
+    DCPServerCentral::remote_t remote;
+    qint8 turn = this->liveness->nextSlot();
+    int i;
+
+    this->registry->getRemoteStationsOfSlot(turn, &(this->pingStations));
+    for(i=0 ; i<this->pingStations.size() ; ++i)
     {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        return NULL;
+        if(this->pingStations.at(i).id > DCP_IDCENTRAL)
+            this->pingStation(this->pingStations.at(i), true);
     }
-    if(!query.next())
+
+    this->liveness->getSuspects(&(this->pingSuspects));
+    for(i=0 ; i<this->pingSuspects.size() ; ++i)
     {
-        // TODO: log ?
-        return NULL;
+        if(this->liveness->isTurn(this->pingSuspects.at(i), turn) ||
+           !this->registry->getStation(this->pingSuspects.at(i), &remote))
+            continue;
+        this->pingStation(remote, false);
     }
+    this->liveness->endSlot(turn);
 
-    session->id         = id;
-    session->station1   = query.value(0).toInt();
-    session->station2   = query.value(1).toInt();
-    session->date       = QDateTime::fromString(query.value(2).toString());
-
-    return session;
+    this->flush();
 }
 
-void DCPServerCentral::pingDrones()
+/*
+ * A dead station loses its drone session at once, and is forgotten
+ * after DCPLIVENESS_FORGET intervals.
+ * */
+void DCPServerCentral::pingStation(const remote_t &remote, bool turn)
 {
-    QHostAddress addr;
-    qint16 port, sessId;
-
-    QSqlQuery query(this->db);
-    query.prepare(
-    "SELECT DISTINCT tmp1.ip, tmp1.port, tmp2.id "
-    "FROM (SELECT * FROM " + QString(DCP_DBSTATIONS) +
-                " WHERE type!='central') AS tmp1 " +
-    "LEFT OUTER JOIN (SELECT * FROM " + QString(DCP_DBSESSIONS) +
-                    " WHERE station1=0 OR station2=0) AS tmp2 "
-    "ON tmp2.station1=tmp1.id OR tmp2.station2=tmp1.id" );
-
-    if(!query.exec())
+    DCPServerCentral::session_t session;
+    qint16 sessId, id = remote.id;
+    bool ping;
+
+    switch(this->liveness->update(id, turn, &ping))
     {
-        qWarning() << query.lastError().driverText() << endl;
-        qWarning() << query.lastError().databaseText() << endl;
-        qWarning() << query.lastQuery();
-        qWarning() << "Error while trying to ping drones" << endl;
+    case DCPLiveness::Suspected:
+        DCPLOG_INFO("Station " << id << " is suspected, phi="
+                    << this->liveness->getPhi(id));
+        emit stationSuspected(id);
+        break;
+    case DCPLiveness::Died:
+        DCPLOG_WARNING("Station " << id << " is dead, silent for "
+                       << this->liveness->msecSinceSeen(id) << " msec");
+        this->dropDroneSession(id);
+        emit stationDead(id);
+        break;
+    case DCPLiveness::Revived:
+        DCPLOG_INFO("Station " << id << " is alive again");
+        emit stationRevived(id);
+        break;
+    case DCPLiveness::Forgotten:
+        DCPLOG_WARNING("Station " << id << " is forgotten, silent for "
+                       << this->liveness->msecSinceSeen(id) << " msec");
+        this->forgetStation(id);
+        emit stationForgotten(id);
         return;
+    case DCPLiveness::None:
+        break;
     }
 
-    while(query.next()) {
-            addr = QHostAddress(query.value(0).toString());
-            port = query.value(1).toInt();
-            sessId = query.value(2).toInt();
+    if(!ping)
+        return;
 
+    sessId = this->registry->getCentralSessionForStation(id, &session)
+            ? session.id : DCP_IDNULL;
 
-            DCPCommandIsAlive *isalive =
-                    new DCPCommandIsAlive(sessId, this->msecSinceStart());
-            isalive->setAddrDst(addr);
-            isalive->setPortDst(port);
-            this->sendPacket(isalive);
-    }
+    DCPCommandIsAlive *isalive =
+            this->newPacket<DCPCommandIsAlive>(sessId, this->timestamp());
+    isalive->setVersion(remote.protocol);
+    isalive->setAddrDst(remote.addr);
+    isalive->setPortDst(remote.port);
+    this->sendToStation(id, isalive);
+}
+
+/*
+ * As if the station had said bye: its ids can be given out again.
+ * */
+void DCPServerCentral::forgetStation(qint16 id)
+{
+    DCPServerCentral::session_t session;
+
+    this->dropDroneSession(id);
+    if(this->registry->getCentralSessionForStation(id, &session))
+        this->deleteSession(session.id);
+    this->deleteVideoServers(id);
+    this->deleteStationById(id);
 }
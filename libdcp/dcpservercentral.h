@@ -22,65 +22,125 @@
 #define DCPSERVERCENTRAL_H
 
 #include <QtGlobal>
-#include <QtSql/QSqlDatabase>
 #include <QHostAddress>
 #include <QString>
 #include <QUdpSocket>
 #include <QDateTime>
 #include <QTimer>
+#include <QVector>
 
 #include <dcp.h>
 #include <dcpserver.h>
 #include <dcpcommands.h>
-
+#include <dcpcentralregistry.h>
+#include <dcpcentralstorage.h>
+#include <dcpliveness.h>
 
 class DCPServerCentral : public DCPServer
 {
     Q_OBJECT
 
 public:
-    DCPServerCentral(QUdpSocket *socket, QSqlDatabase db);
-
-    typedef struct remote_s {
-        qint8 id;
-        QString type;
-        QHostAddress addr;
-        quint16 port;
-        QDateTime date;
-        QString info;
-    } remote_t;
-    typedef struct session_s {
-        qint8 id;
-        qint8 station1;
-        qint8 station2;
-        QDateTime date;
-    } session_t;
-
-    // TODO: make avaliable only to packet handler
-    remote_t*   addNewDrone(QHostAddress addr, quint16 port, QString info);
-    remote_t*   addNewCommandStation(QHostAddress addr, quint16 port, QString info);
-    bool        addNewVideoServers(qint8 id, QString videoServers);
-    session_t*  addNewSession(qint8 station1, qint8 station2);
-    bool        addNewLog(qint8 id, DCPCommandLog::logLevel level, QString msg);
-
-    bool        deleteVideoServers(qint8 id);
-    bool        deleteSession(qint8 id);
-    bool        deleteStationById(qint8 id);
-
-    session_t*  getDroneSessionForStation(qint8 id);
-    session_t*  getCentralSessionForStation(qint8 id);
-    remote_t*   getStation(qint8 id);
-
-    remote_t*   stationIsDrone(qint8 id);
-    remote_t*   stationIsCommand(qint8 id);
-    session_t*  sessionIsCentral(qint8 id);
-
-public slots:
-    void        pingDrones();
+    DCPServerCentral(QUdpSocket *socket, DCPCentralStorage *storage);
+    DCPServerCentral(QUdpSocket *socket, DCPCentralRegistry *registry,
+                     DCPCentralStorage *storage, DCPLiveness *liveness);
+    ~DCPServerCentral();
+
+    typedef DCPCentralRegistry::remote_t    remote_t;
+    typedef DCPCentralRegistry::session_t   session_t;
+
+    inline DCPCentralRegistry*  getRegistry()   { return this->registry; }
+    inline DCPCentralStorage*   getStorage()    { return this->storage; }
+    inline DCPLiveness*         getLiveness()   { return this->liveness; }
+
+    /*
+     * Stations and sessions are copied into the caller's values, nothing
+     * is allocated. Each returns false when nothing matches or could be
+     * added; a NULL value only tests. protocol is the DCP version the
+     * station said hello in.
+     * TODO: make avaliable only to packet handler
+     * */
+    bool        addNewDrone(QHostAddress addr, quint16 port, QString info,
+                            qint8 protocol, remote_t *remote);
+    bool        addNewCommandStation(QHostAddress addr, quint16 port,
+                                     QString info, qint8 protocol,
+                                     remote_t *remote);
+    bool        addNewVideoServers(qint16 id, QString videoServers);
+    bool        addNewSession(qint16 station1, qint16 station2,
+                              session_t *session);
+    // The log is acked once stored, false if it could not be queued
+    bool        addNewLog(qint16 id, DCPCommandLog *log);
+
+    bool        deleteVideoServers(qint16 id);
+    bool        deleteSession(qint16 id);
+    bool        deleteStationById(qint16 id);
+
+    bool        getDroneSessionForStation(qint16 id, session_t *session);
+    bool        getCentralSessionForStation(qint16 id, session_t *session);
+    bool        getStation(qint16 id, remote_t *remote);
+
+    bool        stationIsDrone(qint16 id, remote_t *remote);
+    bool        stationIsCommand(qint16 id, remote_t *remote);
+    bool        sessionIsCentral(qint16 id, session_t *session);
+
+    bool        dropDroneSession(qint16 stationId);
+
+    void        setPingDrones(bool enabled);
+    // Index of the worker among those sharing the liveness tracker
+    inline void setWorker(int index)    { this->worker = index; }
+    inline int  getWorker()             { return this->worker; }
+    void        sendToStation(qint16 id, DCPPacket *packet);
+    void        notifyUnmatchedAck(DCPPacket *ack);
+
+private slots:
+    void        pingTick();
+    void        writeDone(int statement, const QVariantList &values,
+                          bool ok);
+    void        logsWritten(int nbLogs, bool ok);
+
+signals:
+    // An ack for a packet this server did not send, see CentralWorker
+    void        unmatchedAck(QHostAddress addr, quint16 port, qint16 sessID,
+                             qint32 timestamp);
+    // A packet for a station owned by another worker, see sendToStation()
+    void        packetForOwner(int owner, DCPPacket *packet);
+    // Only emitted by the pinging server, see DCPLiveness
+    void        stationSuspected(int id);
+    void        stationDead(int id);
+    void        stationRevived(int id);
+    void        stationForgotten(int id);
+
+protected:
+    void        packetReceived(DCPPacket *packet);
 
 private:
-    QSqlDatabase    db;
-    QTimer          pingDronesTimer;
+    // What acks a log
+    typedef struct logAck_s {
+        qint8           version;
+        qint16          sessID;
+        qint32          timestamp;
+        QHostAddress    addr;
+        quint16         port;
+    } logAck_t;
+
+    void        init();
+    bool        addNewStation(const QString &type, QHostAddress addr,
+                              quint16 port, QString info, qint8 protocol,
+                              remote_t *remote);
+    void        writeBehind(int statement, const QVariantList &values);
+    void        pingStation(const remote_t &remote, bool turn);
+    void        forgetStation(qint16 id);
+
+    QTimer              pingTimer;
+    QVector<remote_t>   pingStations;   // Of the slot, kept between ticks
+    QVector<qint16>     pingSuspects;
+    QList<logAck_t>     pendingLogs;    // Submitted, in order
+    DCPCommandLog       logAck;         // Reused to ack them
+    DCPCentralRegistry  *registry;
+    DCPCentralStorage   *storage;
+    DCPLiveness         *liveness;
+    bool                ownStorage;
+    int                 worker;
 };
 
 #endif // DCPSERVERCENTRAL_H
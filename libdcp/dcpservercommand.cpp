@@ -26,10 +26,19 @@ DCPServerCommand::DCPServerCommand(QUdpSocket *sock) :
     droneId(DCP_IDNULL),
     sessIdDrone(DCP_IDNULL),
     sessIdCentralStation(DCP_SESSIDCENTRAL),
+    centralVersion(DCP_VERSION1),
+    droneVersion(DCP_VERSION1),
     status(Init),
-    delayIsAlive(3000)
+    delayIsAlive(3000),
+    controlRate(DCPSERVERCOMMAND_CONTROLRATE),
+    aileronRight(0),
+    aileronLeft(0),
+    rudder(0),
+    aileronsSet(false)
 {
     this->handler = new DCPPacketHandlerCommandStationHello(this);
+    connect(&(this->timerControl), SIGNAL(timeout()),
+            this, SLOT(timeoutControl()));
 }
 
 void DCPServerCommand::setCentralStationHost(
@@ -46,7 +55,7 @@ void DCPServerCommand::setDroneHost(QHostAddress addr, quint16 port)
     this->portDrone = port;
 }
 
-void DCPServerCommand::setSessionIdDrone(qint8 sessID)
+void DCPServerCommand::setSessionIdDrone(qint16 sessID)
 {
     this->sessIdDrone = sessID;
     connect(&(this->timerIsAlive), SIGNAL(timeout()),
@@ -55,7 +64,7 @@ void DCPServerCommand::setSessionIdDrone(qint8 sessID)
 }
 
 void DCPServerCommand::setSessionIdCentralStation(
-        qint8 sessIdCentralStation)
+        qint16 sessIdCentralStation)
 {
     this->sessIdCentralStation = sessIdCentralStation;
 }
@@ -74,29 +83,33 @@ void DCPServerCommand::sayHello(QString description)
     if(status != Init &&  status != Stopped) return;
     this->setStatus(SayingHello);
 
+    // In the newest version, DCPServer resends it in v1 last if it is not answered
     DCPCommandHelloFromRemote *hello =
-            new DCPCommandHelloFromRemote(this->sessIdCentralStation);
+            this->newPacket<DCPCommandHelloFromRemote>(
+                this->sessIdCentralStation);
+    hello->setVersion(DCP_VERSION);
     hello->setDescription(description);
     hello->setAddrDst(this->addrCentralStation);
     hello->setPortDst(this->portCentralStation);
     hello->setRemoteType(DCPCommandHelloFromRemote::remoteTypeCommandStation);
-    this->time.start();
-    hello->setTimestamp(this->time.elapsed());
+    hello->setTimestamp(this->timestamp());
     this->sendPacket(hello);
 }
 
-void DCPServerCommand::connectToDrone(qint8 id)
+void DCPServerCommand::connectToDrone(qint16 id)
 {
     enum DCPServerCommandStatus status = this->getStatus();
     if(status != NotConnected &&  status != Disconnected) return;
 
     this->setStatus(Connecting);
-    DCPCommandConnectToDrone *conn = new DCPCommandConnectToDrone(
+    DCPCommandConnectToDrone *conn =
+            this->newPacket<DCPCommandConnectToDrone>(
                 this->sessIdCentralStation);
+    conn->setVersion(this->centralVersion);
     conn->setAddrDst(this->addrCentralStation);
     conn->setPortDst(this->portCentralStation);
     conn->setDroneId(id);
-    conn->setTimestamp(this->time.elapsed());
+    conn->setTimestamp(this->timestamp());
     this->sendPacket(conn);
 }
 
@@ -109,11 +122,12 @@ void DCPServerCommand::disconnectFromDrone()
     this->timerIsAlive.stop();
 
     this->setStatus(Disconnecting);
-    DCPCommandDisconnect *disc = new DCPCommandDisconnect(
-                this->sessIdCentralStation);
+    DCPCommandDisconnect *disc =
+            this->newPacket<DCPCommandDisconnect>(this->sessIdCentralStation);
+    disc->setVersion(this->centralVersion);
     disc->setAddrDst(this->addrCentralStation);
     disc->setPortDst(this->portCentralStation);
-    disc->setTimestamp(this->time.elapsed());
+    disc->setTimestamp(this->timestamp());
     this->sendPacket(disc);
 
 }
@@ -125,10 +139,12 @@ void DCPServerCommand::sayByeBye()
         return;
 
     this->setStatus(Stopping);
-    DCPCommandBye *bye = new DCPCommandBye(this->sessIdCentralStation);
+    DCPCommandBye *bye =
+            this->newPacket<DCPCommandBye>(this->sessIdCentralStation);
+    bye->setVersion(this->centralVersion);
     bye->setAddrDst(this->addrCentralStation);
     bye->setPortDst(this->portCentralStation);
-    bye->setTimestamp(this->time.elapsed());
+    bye->setTimestamp(this->timestamp());
     this->sendPacket(bye);
 }
 
@@ -136,20 +152,24 @@ void DCPServerCommand::log(DCPCommandLog::logLevel level, QString msg)
 {
     if(this->getStatus() < NotConnected) return;
 
-    DCPCommandLog *log = new DCPCommandLog(this->sessIdCentralStation);
+    DCPCommandLog *log =
+            this->newPacket<DCPCommandLog>(this->sessIdCentralStation);
+    log->setVersion(this->centralVersion);
     log->setAddrDst(this->addrCentralStation);
     log->setPortDst(this->portCentralStation);
     log->setLogLevel(level);
     log->setMsg(msg);
-    log->setTimestamp(this->time.elapsed());
+    log->setTimestamp(this->timestamp());
     this->sendPacket(log);
 }
 
 void DCPServerCommand::timeoutIsAlive() {
-    DCPCommandIsAlive *isAlive = new DCPCommandIsAlive(this->sessIdDrone);
+    DCPCommandIsAlive *isAlive =
+            this->newPacket<DCPCommandIsAlive>(this->sessIdDrone);
+    isAlive->setVersion(this->droneVersion);
     isAlive->setAddrDst(this->addrDrone);
     isAlive->setPortDst(this->portDrone);
-    isAlive->setTimestamp(this->time.elapsed());
+    isAlive->setTimestamp(this->timestamp());
     this->sendPacket(isAlive);
 }
 
@@ -158,12 +178,107 @@ void DCPServerCommand::sendCommandAilerons(qint8 aileronRight,
 {
     if(this->getStatus() != Connected) return;
 
-    DCPCommandAilerons *aileron = new DCPCommandAilerons(this->sessIdDrone);
+    this->aileronRight  = aileronRight;
+    this->aileronLeft   = aileronLeft;
+    this->rudder        = rudder;
+    this->aileronsSet   = true;
+    if(this->controlRate == 0)
+    {
+        this->sendAilerons();
+        this->flush();
+    }
+    this->scheduleControl();
+}
+
+void DCPServerCommand::sendCommandThrottle(qint8 motor, qint8 throttle)
+{
+    if(this->getStatus() != Connected) return;
+
+    this->throttles.insert(motor, throttle);
+    if(this->controlRate == 0)
+    {
+        this->sendThrottle(motor, throttle);
+        this->flush();
+    }
+    this->scheduleControl();
+}
+
+void DCPServerCommand::setControlRate(int hz)
+{
+    this->controlRate = qMax(hz, 0);
+    if(this->timerControl.isActive())
+        this->timerControl.start(this->controlInterval());
+}
+
+int DCPServerCommand::controlInterval()
+{
+    if(this->controlRate > 0)
+        return 1000 / this->controlRate;
+    return 1000 / DCPSERVERCOMMAND_CONTROLRATE;
+}
+
+/*
+ * Send at once when the control channel was idle, the next values wait
+ * for the following tick. The timer then runs until the status leaves
+ * Connected.
+ * */
+void DCPServerCommand::scheduleControl()
+{
+    if(this->timerControl.isActive())
+        return;
+
+    if(this->controlRate > 0)
+        this->timeoutControl();
+    this->timerControl.start(this->controlInterval());
+}
+
+void DCPServerCommand::timeoutControl()
+{
+    QHash<qint8, qint8>::const_iterator it;
+
+    // The next session starts from neutral, not from these values
+    if(this->getStatus() != Connected)
+    {
+        this->aileronsSet = false;
+        this->throttles.clear();
+        this->timerControl.stop();
+        return;
+    }
+
+    // Changed or not: the last values replace a lost command
+    if(this->aileronsSet)
+        this->sendAilerons();
+
+    for(it=this->throttles.constBegin() ; it!=this->throttles.constEnd() ; ++it)
+        this->sendThrottle(it.key(), it.value());
+
+    // Control input: do not wait for the end of the event loop iteration
+    this->flush();
+}
+
+void DCPServerCommand::sendAilerons()
+{
+    DCPCommandAilerons *aileron =
+            this->newPacket<DCPCommandAilerons>(this->sessIdDrone);
+    aileron->setVersion(this->droneVersion);
     aileron->setAddrDst(this->addrDrone);
     aileron->setPortDst(this->portDrone);
-    aileron->setTimestamp(this->time.elapsed());
-    aileron->setAileronRight(aileronRight);
-    aileron->setAileronLeft(aileronLeft);
-    aileron->setRudder(rudder);
+    aileron->setTimestamp(this->timestamp());
+    aileron->setAileronRight(this->aileronRight);
+    aileron->setAileronLeft(this->aileronLeft);
+    aileron->setRudder(this->rudder);
     this->sendPacket(aileron);
 }
+
+void DCPServerCommand::sendThrottle(qint8 motor, qint8 throttle)
+{
+    DCPCommandThrottle *packet =
+            this->newPacket<DCPCommandThrottle>(this->sessIdDrone);
+    packet->setVersion(this->droneVersion);
+    packet->setAddrDst(this->addrDrone);
+    packet->setPortDst(this->portDrone);
+    packet->setTimestamp(this->timestamp());
+    packet->setMotor(motor);
+    packet->setThrottle(throttle);
+    this->sendPacket(packet);
+}
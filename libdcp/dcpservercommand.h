@@ -27,11 +27,14 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QTimer>
+#include <QHash>
 
 #include <dcpserver.h>
 #include <dcpcommands.h>
 
 
+/* --- Control channel --- */
+#define DCPSERVERCOMMAND_CONTROLRATE    (50)    // Hz
 
 enum DCPServerCommandStatus {
     Init, SayingHello, NotConnected, Connecting, Connected, Disconnecting,
@@ -50,8 +53,8 @@ public:
         { return this->addrCentralStation; }
     inline quint16         getPortCentralStation()
         { return this->portCentralStation; }
-    inline qint8           getSessionIdDrone()  { return this->sessIdDrone; }
-    inline qint8            getSessionIdCentralStation()
+    inline qint16          getSessionIdDrone()  { return this->sessIdDrone; }
+    inline qint16           getSessionIdCentralStation()
         { return this->sessIdCentralStation; }
     inline enum DCPServerCommandStatus getStatus()
         { return this->status; }
@@ -61,26 +64,43 @@ public:
     void            setStatus(enum DCPServerCommandStatus status);
 
     // TODO: Make avaliable only to friends
-    void            setSessionIdDrone(qint8 sessIdDrone);
-    void            setSessionIdCentralStation(qint8 sessIdCentralStation);
-    inline void     setDroneId(qint8 id)
+    void            setSessionIdDrone(qint16 sessIdDrone);
+    void            setSessionIdCentralStation(qint16 sessIdCentralStation);
+    inline void     setDroneId(qint16 id)
         { this->droneId = id; }
+    // DCP versions, from the answer to the hello and from SetSessID
+    inline void     setCentralVersion(qint8 version)
+        { this->centralVersion = version; }
+    inline void     setDroneVersion(qint8 version)
+        { this->droneVersion = version; }
 
     void            sayHello(QString description);
-    void            connectToDrone(qint8 id);
+    void            connectToDrone(qint16 id);
     void            disconnectFromDrone();
     void            sayByeBye();
     void            log(DCPCommandLog::logLevel level, QString msg);
     void            sendCommandAilerons(qint8 aileronRight, qint8 aileronLeft,
                                         qint8 rudder);
+    void            sendCommandThrottle(qint8 motor, qint8 throttle);
+
+    /*
+     * The last control values are sent at this rate while connected. 0
+     * sends each command at once, and repeats the last values at
+     * DCPSERVERCOMMAND_CONTROLRATE.
+     * */
+    void            setControlRate(int hz);
+    inline int      getControlRate()
+        { return this->controlRate; }
 
 signals:
     void statusChanged(enum DCPServerCommandStatus status);
 
 protected:
-    qint8           droneId;
-    qint8           sessIdDrone;
-    qint8           sessIdCentralStation;
+    qint16          droneId;
+    qint16          sessIdDrone;
+    qint16          sessIdCentralStation;
+    qint8           centralVersion;
+    qint8           droneVersion;
     QHostAddress    addrDrone;
     quint16         portDrone;
     QHostAddress    addrCentralStation;
@@ -93,8 +113,25 @@ private:
     int     delayIsAlive;
     QTimer  timerIsAlive;
 
+    /*
+     * Control channel: the commands only record the newest values, which
+     * are sent on every tick, changed or not. They are latest commands
+     * (DCP_DELIVERY), the next tick replaces a lost one.
+     * */
+    void    scheduleControl();
+    int     controlInterval();
+    void    sendAilerons();
+    void    sendThrottle(qint8 motor, qint8 throttle);
+
+    int                 controlRate;
+    QTimer              timerControl;
+    qint8               aileronRight, aileronLeft, rudder;
+    bool                aileronsSet;    // ailerons sent in this session
+    QHash<qint8, qint8> throttles;      // motor -> newest throttle
+
 private slots:
     void    timeoutIsAlive();
+    void    timeoutControl();
 };
 
 #endif // DCPSERVERCOMMAND_H
@@ -0,0 +1,173 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcptimingwheel.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#include "dcptimingwheel.h"
+
+#include <string.h>
+
+#define ROOTSIZE        (1<<DCPTIMINGWHEEL_ROOTBITS)
+#define ROOTMASK        (ROOTSIZE-1)
+#define LEVELSIZE       (1<<DCPTIMINGWHEEL_LEVELBITS)
+#define LEVELMASK       (LEVELSIZE-1)
+#define LEVELSHIFT(l)   (DCPTIMINGWHEEL_ROOTBITS + (l)*DCPTIMINGWHEEL_LEVELBITS)
+#define MAXDELTA        ((qint64)1<<LEVELSHIFT(DCPTIMINGWHEEL_LEVELS-1))
+
+DCPTimingWheel::DCPTimingWheel(int tickMsec) :
+    tickMsec(tickMsec),
+    current(0),
+    nbPending(0)
+{
+    memset(this->root, 0, sizeof(this->root));
+    memset(this->levels, 0, sizeof(this->levels));
+}
+
+void DCPTimingWheel::schedule(Timer *timer, qint64 nowMsec, int delayMsec)
+{
+    qint64 now = nowMsec / this->tickMsec;
+    qint64 ticks = (delayMsec + this->tickMsec - 1) / this->tickMsec;
+
+    if(timer->isScheduled())
+        this->cancel(timer);
+
+    // Nothing pending: skip the idle ticks instead of walking them
+    if(this->nbPending == 0 && now > this->current)
+        this->current = now;
+
+    timer->expire = now + qMax(ticks, (qint64)1);
+    this->insert(timer);
+    this->nbPending++;
+}
+
+void DCPTimingWheel::cancel(Timer *timer)
+{
+    if(!timer->isScheduled())
+        return;
+
+    *(timer->pprev) = timer->next;
+    if(timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next     = NULL;
+    timer->pprev    = NULL;
+    this->nbPending--;
+}
+
+/*
+ * Process every tick up to nowMsec. Expired timers are unlinked from the
+ * wheel and returned as a list chained by their next pointer.
+ * */
+DCPTimingWheel::Timer* DCPTimingWheel::advance(qint64 nowMsec)
+{
+    qint64 now = nowMsec / this->tickMsec;
+    Timer *expired = NULL, **tail = &expired;
+    Timer *timer, *next;
+    int index, level;
+
+    while(this->current <= now)
+    {
+        if(this->nbPending == 0)
+        {
+            this->current = now + 1;
+            break;
+        }
+
+        index = this->current & ROOTMASK;
+        if(index == 0)
+        {
+            // Root wrapped: bring the next slot of each upper level down
+            for(level=0 ; level<DCPTIMINGWHEEL_LEVELS-1 ; ++level)
+            {
+                int i = (this->current >> LEVELSHIFT(level)) & LEVELMASK;
+                this->cascade(level, i);
+                if(i != 0)
+                    break;
+            }
+        }
+
+        timer = this->root[index];
+        this->root[index] = NULL;
+        for( ; timer!=NULL ; timer=next)
+        {
+            next = timer->next;
+            timer->next     = NULL;
+            timer->pprev    = NULL;
+            *tail = timer;
+            tail = &(timer->next);
+            this->nbPending--;
+        }
+
+        this->current++;
+    }
+
+    return expired;
+}
+
+void DCPTimingWheel::insert(Timer *timer)
+{
+    qint64 expire = timer->expire;
+    qint64 delta = expire - this->current;
+    Timer **slot = NULL;
+
+    if(delta < 0)
+    {
+        // Already late: fire on the next processed tick
+        slot = &(this->root[this->current & ROOTMASK]);
+    }
+    else if(delta < ROOTSIZE)
+    {
+        slot = &(this->root[expire & ROOTMASK]);
+    }
+    else
+    {
+        // Too far for the wheel: park it in the last slot, it will be
+        // re-inserted with its real expiry when cascaded
+        if(delta >= MAXDELTA)
+            expire = this->current + MAXDELTA - 1;
+
+        for(int level=0 ; level<DCPTIMINGWHEEL_LEVELS-1 ; ++level)
+        {
+            if(expire - this->current <
+                    ((qint64)1 << (LEVELSHIFT(level)+DCPTIMINGWHEEL_LEVELBITS)))
+            {
+                slot = &(this->levels[level]
+                         [(expire >> LEVELSHIFT(level)) & LEVELMASK]);
+                break;
+            }
+        }
+    }
+
+    timer->next = *slot;
+    if(timer->next)
+        timer->next->pprev = &(timer->next);
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+void DCPTimingWheel::cascade(int level, int index)
+{
+    Timer *timer = this->levels[level][index];
+    Timer *next;
+
+    this->levels[level][index] = NULL;
+    for( ; timer!=NULL ; timer=next)
+    {
+        next = timer->next;
+        this->insert(timer);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dcptimingwheel.h -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+#ifndef DCPTIMINGWHEEL_H
+#define DCPTIMINGWHEEL_H
+
+#include <QtGlobal>
+
+/* --- Wheel geometry --- */
+#define DCPTIMINGWHEEL_TICK         (10)    // msec per tick
+#define DCPTIMINGWHEEL_ROOTBITS     (8)     // 256 slots of 1 tick
+#define DCPTIMINGWHEEL_LEVELBITS    (6)     // 64 slots per upper level
+#define DCPTIMINGWHEEL_LEVELS       (3)     // 1 + 2 upper levels
+
+
+
+/*
+ * DCP -- Hierarchical timing wheel.
+ * Timers are intrusive: the caller owns the Timer structure and embeds it
+ * in its own data. schedule() and cancel() are O(1), expiry is amortized
+ * O(1) since a timer is cascaded at most once per upper level.
+ * Not thread safe, must be used from a single thread.
+ * */
+class DCPTimingWheel
+{
+public:
+    struct Timer
+    {
+        Timer() : next(NULL), pprev(NULL), expire(0), data(NULL) {}
+        inline bool isScheduled() const { return this->pprev != NULL; }
+
+        Timer   *next;
+        Timer   **pprev;
+        qint64  expire;     // absolute tick
+        void    *data;      // user data
+    };
+
+    DCPTimingWheel(int tickMsec=DCPTIMINGWHEEL_TICK);
+
+    void    schedule(Timer *timer, qint64 nowMsec, int delayMsec);
+    void    cancel(Timer *timer);
+    Timer*  advance(qint64 nowMsec);
+
+    inline int  getTickMsec()   { return this->tickMsec;    }
+    inline int  getNbPending()  { return this->nbPending;   }
+
+private:
+    void    insert(Timer *timer);
+    void    cascade(int level, int index);
+
+    int     tickMsec;
+    qint64  current;        // next tick to process
+    int     nbPending;
+
+    Timer*  root[1<<DCPTIMINGWHEEL_ROOTBITS];
+    Timer*  levels[DCPTIMINGWHEEL_LEVELS-1][1<<DCPTIMINGWHEEL_LEVELBITS];
+};
+
+#endif // DCPTIMINGWHEEL_H
@@ -15,21 +15,41 @@ CONFIG += staticlib
 DEFINES += LIBDCP_LIBRARY
 
 SOURCES += \
+    dcpcentraldatabase.cpp \
+    dcpcentralmemorystorage.cpp \
+    dcpcentralregistry.cpp \
+    dcpcentralschema.cpp \
+    dcpcentralstorage.cpp \
     dcpcommands.cpp \
+    dcpfailuredetector.cpp \
+    dcpliveness.cpp \
+    dcplog.cpp \
     dcppacket.cpp \
     dcppackethandlerinterface.cpp \
+    dcprtt.cpp \
     dcpserver.cpp \
     dcpservercentral.cpp \
-    dcpservercommand.cpp
+    dcpservercommand.cpp \
+    dcptimingwheel.cpp
 
 HEADERS += \
     dcp.h \
+    dcpcentraldatabase.h \
+    dcpcentralmemorystorage.h \
+    dcpcentralregistry.h \
+    dcpcentralschema.h \
+    dcpcentralstorage.h \
     dcpcommands.h \
+    dcpfailuredetector.h \
+    dcpliveness.h \
+    dcplog.h \
     dcppacket.h \
     dcppackethandlerinterface.h \
+    dcprtt.h \
     dcpserver.h \
     dcpservercentral.h \
     dcpservercommand.h \
+    dcptimingwheel.h \
     libdcp_global.h
 
 unix {
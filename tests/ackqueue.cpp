@@ -0,0 +1,144 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- ackqueue.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+/*
+ * Ack queue benchmark.
+ * Fills the ack queue of a DCPServer with 10 to 100k packets pending for
+ * 16 peers, then times the lookup of random acks, and the erase and insert
+ * of a packet keeping the depth constant. Both should stay flat with the
+ * depth. Run with ./tests/test.sh ackqueue, against the libdcp build.
+ * */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QUdpSocket>
+#include <QVector>
+
+#include <dcpserver.h>
+#include <dcpcommands.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ACKQUEUE_NBPEERS    (16)
+#define ACKQUEUE_NBLOOKUPS  (1000000)
+#define ACKQUEUE_NBCYCLES   (200000)
+// Cache misses grow with the depth, a linear scan would be 10^4 slower
+#define ACKQUEUE_MAXRATIO   (10.0)
+
+static QHostAddress peerAddr(QHostAddress::LocalHost);
+
+static DCPCommandIsAlive* pending(DCPServer *server, int i)
+{
+    DCPCommandIsAlive *packet = server->newPacket<DCPCommandIsAlive>(
+                1, DCP_TIMESTAMP(i / ACKQUEUE_NBPEERS + 1));
+
+    packet->setVersion(DCP_VERSION2);
+    packet->setAddrDst(peerAddr);
+    packet->setPortDst(20000 + i % ACKQUEUE_NBPEERS);
+    server->moveToAckQueue(packet);
+    return packet;
+}
+
+/*
+ * Nanoseconds per lookup and per erase + insert at the given depth, false
+ * if an ack did not find its packet.
+ * */
+static bool run(int depth, double *lookupNs, double *cycleNs)
+{
+    QUdpSocket sock;
+    DCPServer *server = new DCPServer(&sock);
+    QVector<DCPCommandIsAlive*> packets(depth);
+    QVector<int> order(ACKQUEUE_NBLOOKUPS);
+    DCPCommandAck ack;
+    QElapsedTimer timer;
+    qint64 found = 0;
+    int next = depth;
+
+    for(int i=0 ; i<depth ; ++i)
+        packets[i] = pending(server, i);
+    for(int i=0 ; i<ACKQUEUE_NBLOOKUPS ; ++i)
+        order[i] = rand() % depth;
+
+    ack.setVersion(DCP_VERSION2);
+    ack.setAddrDst(peerAddr);
+    ack.setSessionID(1);
+    timer.start();
+    for(int i=0 ; i<ACKQUEUE_NBLOOKUPS ; ++i)
+    {
+        DCPCommandIsAlive *packet = packets[order[i]];
+        ack.setPortDst(packet->getPortDst());
+        ack.setTimestamp(packet->getTimestamp());
+        found += (server->findInAckQueue(&ack) == packet);
+    }
+    *lookupNs = (double)timer.nsecsElapsed() / ACKQUEUE_NBLOOKUPS;
+
+    if(found != ACKQUEUE_NBLOOKUPS)
+    {
+        printf("FAIL: %lld acks of %d matched their packet at depth %d\n",
+               (long long)found, ACKQUEUE_NBLOOKUPS, depth);
+        *cycleNs = 0;
+        delete server;
+        return false;
+    }
+
+    // Timestamps of the new packets move past those of the old ones
+    timer.restart();
+    for(int i=0 ; i<ACKQUEUE_NBCYCLES ; ++i)
+    {
+        int slot = order[i];
+        server->removeFromAckQueue(packets[slot]);
+        packets[slot] = pending(server, next++);
+    }
+    *cycleNs = (double)timer.nsecsElapsed() / ACKQUEUE_NBCYCLES;
+
+    delete server;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    static const int depths[] = { 10, 100, 1000, 10000, 100000 };
+    const int nbDepths = sizeof(depths) / sizeof(depths[0]);
+    double lookupNs[nbDepths], cycleNs[nbDepths];
+    bool failed = false;
+
+    srand(1);
+    printf("%8s %12s %16s\n", "depth", "lookup ns", "erase+insert ns");
+    for(int i=0 ; i<nbDepths ; ++i)
+    {
+        if(!run(depths[i], &(lookupNs[i]), &(cycleNs[i])))
+            failed = true;
+        printf("%8d %12.1f %16.1f\n", depths[i], lookupNs[i], cycleNs[i]);
+    }
+
+    if(lookupNs[nbDepths-1] > ACKQUEUE_MAXRATIO * lookupNs[0] ||
+       cycleNs[nbDepths-1] > ACKQUEUE_MAXRATIO * cycleNs[0])
+    {
+        printf("FAIL: cost at depth %d is more than %.0f times that at %d\n",
+               depths[nbDepths-1], ACKQUEUE_MAXRATIO, depths[0]);
+        failed = true;
+    }
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/*!
+ *   \file  codec.c
+ *   \brief  DCP header encoding test.
+ *
+ *  Sends packets of both DCP versions to itself through the UAV server and
+ *  checks that they decode back to the same header and payload, that
+ *  datagrams shorter than their header are dropped, and that an
+ *  unanswered hello stays in v2 until its last resend. Run with
+ *  ./tests/test.sh codec.
+ *
+ *  \author  Bertrand.F (),
+ *
+ *  \internal
+ *      Compiler:  gcc
+ *     Copyright:  Copyright (C), 2014, Bertrand.F
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* dcp_send() and uavsrv_dcp_waitone() are internal to uav_server.c */
+#include "../UAVStation/src/uav_server.c"
+
+static int nbfailed;
+
+static void check(int cond, const char* what, int value)
+{
+    if(!cond) {
+        printf("FAIL: %s (%d)\n", what, value);
+        nbfailed++;
+    }
+}
+
+/*!
+ *  \brief  Binds a loopback socket on any port.
+ */
+static int bind_loopback(struct sockaddr_storage* addr, socklen_t* addrlen)
+{
+    struct sockaddr_in *in = (struct sockaddr_in*)addr;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(addr, 0, sizeof(*addr));
+    in->sin_family      = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    in->sin_port        = 0;
+    bind(sock, (struct sockaddr*)in, sizeof(*in));
+    *addrlen = sizeof(*in);
+    getsockname(sock, (struct sockaddr*)in, addrlen);
+    return sock;
+}
+
+/*!
+ *  \brief  The UAV server sends to itself.
+ */
+static void setup()
+{
+    uavsrv.sock = bind_loopback(&(uavsrv.params.central_addr), &(uavsrv.params.central_addrlen));
+    uavsrv.params.timeout.tv_sec    = 0;
+    uavsrv.params.timeout.tv_usec   = 20000;
+    uavsrv.start_time               = uavsrv_clock();
+    uavsrv.state                    = SOCKREADY;
+    ackqueue_init();
+}
+
+/*!
+ *  \brief  Send a packet and decode it back.
+ */
+static void roundtrip(uint8_t version, uint8_t cmd, uint16_t sessid, uint32_t timestamp, const char* data)
+{
+    struct dcp_packet_s sent, *received;
+
+    memset(&sent, 0, sizeof(sent));
+    sent.dstaddr    = uavsrv.params.central_addr;
+    sent.dstaddrlen = uavsrv.params.central_addrlen;
+    sent.version    = version;
+    sent.cmd        = cmd;
+    sent.sessid     = sessid;
+    sent.timestamp  = timestamp;
+    sent.datalen    = strlen(data);
+    memcpy(sent.data, data, sent.datalen);
+    check(dcp_send(&sent) == 0, "sent", version);
+
+    received = uavsrv_dcp_waitone();
+    check(received != NULL, "received", version);
+    if(!received)
+        return;
+    check(received->version == version, "version", received->version);
+    check(received->cmd == cmd, "cmd", received->cmd);
+    check(received->sessid == sessid, "sessid", received->sessid);
+    check(received->timestamp == timestamp, "timestamp", (int)received->timestamp);
+    check(received->datalen == sent.datalen &&
+          memcmp(received->data, data, sent.datalen) == 0, "payload", received->datalen);
+    dcp_packetfree(received);
+}
+
+/*!
+ *  \brief  Headers of both versions, every byte of the session ID set.
+ */
+static void test_roundtrip()
+{
+    roundtrip(DCP_VERSION1, DCP_CMDLOG, 0x0A, 0x123456, "v1 log");
+    roundtrip(DCP_VERSION1, DCP_CMDACK, 0x0F, 0xFFFFFF, "");
+    roundtrip(DCP_VERSION2, DCP_CMDLOG, 0x1234, 0x123456, "v2 log");
+    roundtrip(DCP_VERSION2, DCP_CMDACK, 0xA5C3, 0x000001, "");
+    roundtrip(DCP_VERSION2, DCP_CMDACKBUNDLE, 0x00FF, 0xABCDEF, "bundle");
+}
+
+/*!
+ *  \brief  A datagram shorter than its header is dropped.
+ */
+static void test_short()
+{
+    const char v2[] = { (char)DCP_MAGICV2, DCP_CMDAILERON, 0x12, 0x34, 0x00 };
+    const char v1[] = { (char)(DCP_CMDTHROTTLE<<4 | 0x03), 0x00 };
+    struct dcp_packet_s *received;
+
+    sendto(uavsrv.sock, v2, sizeof(v2), 0, (struct sockaddr*)&(uavsrv.params.central_addr), uavsrv.params.central_addrlen);
+    received = uavsrv_dcp_waitone();
+    check(received == NULL && uavsrv_err == UAVSRV_ERR_BADDATALEN, "short v2 dropped", uavsrv_err);
+
+    sendto(uavsrv.sock, v1, sizeof(v1), 0, (struct sockaddr*)&(uavsrv.params.central_addr), uavsrv.params.central_addrlen);
+    received = uavsrv_dcp_waitone();
+    check(received == NULL && uavsrv_err == UAVSRV_ERR_BADDATALEN, "short v1 dropped", uavsrv_err);
+}
+
+/*!
+ *  \brief  Unanswered hello: only its last resend falls back to v1.
+ */
+static void test_hello()
+{
+    struct sockaddr_storage central;
+    socklen_t centrallen;
+    char buff[64];
+    int sock, i, nb=0;
+    int versions[DCP_MAXRESEND+2];
+
+    sock = bind_loopback(&central, &centrallen);
+    uavsrv.params.central_addr      = central;
+    uavsrv.params.central_addrlen   = centrallen;
+    uavsrv.params.info              = "codec";
+
+    check(uavsrv_start() < 0 && uavsrv_err == UAVSRV_ERR_TIMEDOUT, "hello not answered", uavsrv_err);
+    while(nb < DCP_MAXRESEND+2 && recv(sock, buff, sizeof(buff), MSG_DONTWAIT) > 0)
+        versions[nb++] = ((unsigned char)buff[0] == DCP_MAGICV2) ? DCP_VERSION2 : DCP_VERSION1;
+
+    check(nb == DCP_MAXRESEND+1, "hello sent 1+DCP_MAXRESEND times", nb);
+    for(i=0 ; i<nb-1 ; ++i)
+        check(versions[i] == DCP_VERSION2, "hello in v2 before the last resend", i);
+    check(nb > 0 && versions[nb-1] == DCP_VERSION1, "last resend in v1", nb-1);
+    close(sock);
+}
+
+int main()
+{
+    openlog("codec", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    setup();
+    test_roundtrip();
+    test_short();
+    test_hello();
+
+    close(uavsrv.sock);
+    printf("%s\n", nbfailed ? "FAILED" : "OK");
+    return nbfailed ? 1 : 0;
+}
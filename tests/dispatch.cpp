@@ -0,0 +1,215 @@
+/*
+ *  This file is part of the libDCP Project
+ *  Copyright (C) 15/04/2014 -- dispatch.cpp -- bertrand
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * */
+
+/*
+ * Packet dispatch micro-benchmark.
+ * Decodes a mix of ailerons, throttle, isalive and ack datagrams with
+ * DCPPacketFactory and hands each packet to a handler, in two ways:
+ *  - table: DCPPacketFactory::dispatch(), the handler method of the
+ *    concrete type called through the command table;
+ *  - legacy: the former path, rebuilt here as it was before the command
+ *    table: a virtual call per command taking a DCPPacket, in which the
+ *    handler dynamic_casts its server and the packet.
+ * The decoding is the same for both, the difference is the dispatch. Run
+ * with ./tests/test.sh dispatch, against the libdcp build.
+ * */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QUdpSocket>
+
+#include <dcpserver.h>
+#include <dcpcommands.h>
+#include <dcppackethandlerinterface.h>
+
+#include <stdio.h>
+
+#define DISPATCH_NBPACKETS  (5000000)
+#define DISPATCH_NBKINDS    (4)
+
+/*
+ * Counts what it is handed, through the command table.
+ * */
+class TableHandler : public DCPPacketHandlerInterface
+{
+public:
+    TableHandler(DCPServer *server) :
+        DCPPacketHandlerInterface(server), sum(0) {}
+
+    void handleNull(DCPPacket *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandAilerons(DCPCommandAilerons *packet)
+        { this->sum += packet->getTimestamp(); }
+    void handleCommandIsAlive(DCPCommandIsAlive *packet)
+        { this->sum += packet->getTimestamp(); }
+    void handleCommandAck(DCPCommandAck *packet)
+        { this->sum += packet->getTimestamp(); }
+    void handleCommandThrottle(DCPCommandThrottle *packet)
+        { this->sum += packet->getTimestamp(); }
+    void handleCommandSetSessID(DCPCommandSetSessID *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandHelloFromCentral(
+            DCPCommandHelloFromCentralStation *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandHelloFromRemote(DCPCommandHelloFromRemote *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandLog(DCPCommandLog *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandBye(DCPCommandBye *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandConnectToDrone(DCPCommandConnectToDrone *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandDisconnect(DCPCommandDisconnect *packet)
+        { Q_UNUSED(packet); }
+    void handleCommandVideoServers(DCPCommandVideoServers *packet)
+        { Q_UNUSED(packet); }
+
+    qint64 sum;
+};
+
+/*
+ * Counts what it is handed, the way the handlers did before the command
+ * table.
+ * */
+class LegacyHandler
+{
+public:
+    LegacyHandler(QObject *server) : server(server), sum(0) {}
+    virtual ~LegacyHandler() {}
+
+    virtual void handleCommandAilerons(DCPPacket *packet);
+    virtual void handleCommandIsAlive(DCPPacket *packet);
+    virtual void handleCommandAck(DCPPacket *packet);
+    virtual void handleCommandThrottle(DCPPacket *packet);
+
+    QObject *server;
+    qint64 sum;
+};
+
+template<class TYPE>
+static inline void legacyHandle(LegacyHandler *handler, DCPPacket *packet)
+{
+    DCPServer *server = dynamic_cast<DCPServer*>(handler->server);
+    TYPE *typed = dynamic_cast<TYPE*>(packet);
+
+    if(server && typed)
+        handler->sum += typed->getTimestamp();
+}
+
+void LegacyHandler::handleCommandAilerons(DCPPacket *packet)
+    { legacyHandle<DCPCommandAilerons>(this, packet); }
+void LegacyHandler::handleCommandIsAlive(DCPPacket *packet)
+    { legacyHandle<DCPCommandIsAlive>(this, packet); }
+void LegacyHandler::handleCommandAck(DCPPacket *packet)
+    { legacyHandle<DCPCommandAck>(this, packet); }
+void LegacyHandler::handleCommandThrottle(DCPPacket *packet)
+    { legacyHandle<DCPCommandThrottle>(this, packet); }
+
+// Was the virtual DCPPacket::handle() of each command
+static void legacyDispatch(DCPPacket *packet, LegacyHandler *handler)
+{
+    switch(packet->getCommandID())
+    {
+    case DCP_CMDAILERON:    handler->handleCommandAilerons(packet); break;
+    case DCP_CMDISALIVE:    handler->handleCommandIsAlive(packet);  break;
+    case DCP_CMDACK:        handler->handleCommandAck(packet);      break;
+    case DCP_CMDTHROTTLE:   handler->handleCommandThrottle(packet); break;
+    }
+}
+
+struct datagram_t
+{
+    char    data[DCPSERVER_DATAGRAMMAX];
+    int     len;
+};
+
+static void encode(DCPPacket *packet, datagram_t *datagram)
+{
+    packet->setVersion(DCP_VERSION2);
+    datagram->len = packet->encode(datagram->data, DCPSERVER_DATAGRAMMAX);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QUdpSocket sock;
+    DCPServer server(&sock);
+    DCPPacketFactory factory;
+    TableHandler table(&server);
+    LegacyHandler legacy(&server);
+    datagram_t datagrams[DISPATCH_NBKINDS];
+    QElapsedTimer timer;
+    double tableNs, legacyNs;
+    bool failed = false;
+
+    DCPCommandAilerons ailerons(1, 1);
+    ailerons.setAileronLeft(10);
+    ailerons.setAileronRight(-10);
+    ailerons.setRudder(5);
+    encode(&ailerons, &(datagrams[0]));
+    DCPCommandThrottle throttle(1, 2);
+    throttle.setMotor(1);
+    throttle.setThrottle(50);
+    encode(&throttle, &(datagrams[1]));
+    DCPCommandIsAlive isAlive(1, 3);
+    encode(&isAlive, &(datagrams[2]));
+    DCPCommandAck ack(1, 4);
+    encode(&ack, &(datagrams[3]));
+
+    timer.start();
+    for(int i=0 ; i<DISPATCH_NBPACKETS ; ++i)
+    {
+        datagram_t *datagram = &(datagrams[i % DISPATCH_NBKINDS]);
+        DCPPacket *packet = factory.commandPacketFromData(datagram->data,
+                                                          datagram->len);
+        if(packet)
+            factory.dispatch(packet, &table);
+    }
+    tableNs = (double)timer.nsecsElapsed() / DISPATCH_NBPACKETS;
+
+    timer.restart();
+    for(int i=0 ; i<DISPATCH_NBPACKETS ; ++i)
+    {
+        datagram_t *datagram = &(datagrams[i % DISPATCH_NBKINDS]);
+        DCPPacket *packet = factory.commandPacketFromData(datagram->data,
+                                                          datagram->len);
+        if(packet)
+            legacyDispatch(packet, &legacy);
+    }
+    legacyNs = (double)timer.nsecsElapsed() / DISPATCH_NBPACKETS;
+
+    printf("%8s %14s\n", "path", "ns per packet");
+    printf("%8s %14.1f\n", "table", tableNs);
+    printf("%8s %14.1f\n", "legacy", legacyNs);
+    printf("dispatch saves %.1f ns per packet (%.0f%%)\n",
+           legacyNs - tableNs, 100.0 * (legacyNs - tableNs) / legacyNs);
+
+    // Both handled every packet
+    if(table.sum != legacy.sum ||
+       table.sum != (qint64)DISPATCH_NBPACKETS / DISPATCH_NBKINDS * 10)
+    {
+        printf("FAIL: table handled %lld, legacy %lld\n",
+               (long long)table.sum, (long long)legacy.sum);
+        failed = true;
+    }
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,900 @@
+#!/usr/bin/env python3
+
+##########################################################################
+#
+# This file is part of the Drone project
+# Copyright (C) 2014/04/24 -- loadgen.py -- bertrand
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+##########################################################################
+#
+# Load generator for the central station.
+#
+# Simulates N drones and M command stations over UDP, each one with its own
+# socket. Every station says hello, the drones register their video
+# servers, the command stations connect to a free drone and then stream
+# controls to it, everybody sends logs, and after --lifetime seconds says
+# bye and starts again. In v1 the station and session ids being 4 bits
+# wide, a net holds at most 15 stations: registration throughput is
+# measured with this churn rather than with more stations. With
+# --protocol 2 the ids are 16 bits wide, and the acks of the central
+# station come in bundles; --ack-delay makes the stations bundle theirs.
+#
+# Reports, as JSON:
+#   - registrations per second and hello latency,
+#   - packets per second both ways, and how many acks were bundled,
+#   - logs sent and acked per second, and those resent because the
+#     central station did not ack them, as when it sheds load,
+#   - ack / reply RTT percentiles per command; the controls are latest
+#     commands, neither acked nor resent: their losses and reordering are
+#     counted instead,
+#   - retransmissions, both ours and the central station's (duplicates),
+#   - CPU time of the central station per packet it received, when its
+#     pid is known (--central-pid, or the process started with --central).
+#
+# Example, against a central station with an in-memory storage:
+#   ./tests/loadgen.py --central "CentralStation --storage memory" \
+#       --drones 8 --commands 7 --duration 60 --output run.json
+#
+# Ack bundling, to compare with --ack-delay 0 on both sides:
+#   ./tests/loadgen.py --central "CentralStation --storage memory" \
+#       --protocol 2 --ack-delay 10 --log-rate 200 --output bundled.json
+#
+# Failure detection, on a lossy link: the drones crash now and then, go
+# silent, and come back later as new stations. The central station tells
+# the command station of a dead drone with a Disconnect, which gives the
+# detection latency; a Disconnect for a drone still alive is a false
+# positive. ./tests/test.sh failures runs it at several loss rates:
+#   ./tests/loadgen.py --central "CentralStation --storage memory" \
+#       --protocol 2 --drones 10 --commands 10 --lifetime 0 --loss 0.1 \
+#       --crash-rate 0.01 --duration 300
+#
+# Soak: with --rss-interval the resident memory of the central station is
+# sampled along the run; past the first fifth, the warmup, it must not grow
+# by more than --max-rss-growth, or the exit status is 1. ./tests/test.sh
+# soak runs a fleet with churn for an hour.
+#
+# One Python process does not load a multi-threaded central station: with
+# --processes, each process simulates its own --drones and --commands, and
+# the report covers all of them. ./tests/test.sh scaling runs it against
+# 1, 2 and 4 central station threads.
+#
+##########################################################################
+
+from __future__ import print_function
+
+import argparse
+import json
+import multiprocessing
+import os
+import random
+import select
+import shlex
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+
+# --- Protocol, see libdcp/dcp.h ---
+CMD_ACK             = 0x00
+CMD_ISALIVE         = 0x01
+CMD_AILERON         = 0x02
+CMD_THROTTLE        = 0x03
+CMD_SETSESSID       = 0x04
+CMD_LOG             = 0x05
+CMD_HELLOFROMCENTRAL= 0x06
+CMD_HELLOFROMREMOTE = 0x07
+CMD_BYE             = 0x08
+CMD_CONNECTTODRONE  = 0x09
+CMD_DISCONNECT      = 0x0A
+CMD_VIDEOSERVERS    = 0x0B
+CMD_ACKBUNDLE       = 0x0C
+
+CMD_NAMES = {
+    CMD_ACK: "ack", CMD_ISALIVE: "isalive", CMD_AILERON: "ailerons",
+    CMD_THROTTLE: "throttle", CMD_SETSESSID: "setsessid", CMD_LOG: "log",
+    CMD_HELLOFROMCENTRAL: "hellofromcentral",
+    CMD_HELLOFROMREMOTE: "hellofromremote", CMD_BYE: "bye",
+    CMD_CONNECTTODRONE: "connecttodrone", CMD_DISCONNECT: "disconnect",
+    CMD_VIDEOSERVERS: "videoservers", CMD_ACKBUNDLE: "ackbundle",
+}
+
+TSMASK          = 0xFFFFFF  # DCP_TIMESTAMPMASK
+TSHALF          = 0x800000  # DCP_TIMESTAMPHALF
+MAGICV2         = 0xF2      # DCP_MAGICV2
+ACKBUNDLEMAX    = 32        # DCP_ACKBUNDLEMAX, bitmap bytes
+ACKBUNDLESPAN   = 8 * ACKBUNDLEMAX
+SESSIDCENTRAL   = 0x00
+IDMAX           = 0x0F
+TIMEOUT         = 1.0       # sec, DCP_TIMEOUT
+RTOMAX          = 8.0       # sec, DCP_RTOMAX
+MAXRESEND       = 5         # DCP_MAXRESEND
+DUPWINDOW       = 10.0      # sec a received packet is remembered
+
+# DCP_DELIVERY: sent once, never acked, the stale ones dropped
+LATEST          = (CMD_AILERON, CMD_THROTTLE)
+
+REMOTETYPECOMMAND   = b'C'
+REMOTETYPEDRONE     = b'D'
+LOGLEVELS           = [b'I', b'W', b'C']
+
+
+def encode(cmd, sess, ts, payload=b'', version=1):
+    if version >= 2:
+        header = struct.pack("!BBHB", MAGICV2, cmd, sess, 0)
+    else:
+        header = struct.pack("!B", ((cmd & 0x0F) << 4) | (sess & 0x0F))
+    return header + struct.pack("!I", ts & TSMASK)[1:] + payload
+
+
+def ts_before(a, b):
+    """ DCP_TIMESTAMPLT: serial number comparison of 24-bit timestamps. """
+    d = (b - a) & TSMASK
+    return 0 < d < TSHALF
+
+
+def ts_diff(a, b):
+    """ DCP_TIMESTAMPDIFF: a-b in [-TSHALF, TSHALF[. """
+    return ((a - b + TSHALF) & TSMASK) - TSHALF
+
+
+def decode(data):
+    """ (version, cmd, sess, ts, payload) or None. """
+    b = bytearray(data[:8])
+    if len(b) >= 8 and b[0] == MAGICV2:
+        return 2, b[1], (b[2] << 8) | b[3], \
+               (b[5] << 16) | (b[6] << 8) | b[7], data[8:]
+    if len(b) < 4:
+        return None
+    return 1, (b[0] >> 4) & 0x0F, b[0] & 0x0F, \
+           (b[1] << 16) | (b[2] << 8) | b[3], data[4:]
+
+
+def bundle_acks(timestamps):
+    """ (first, payload) per ack bundle, as DCPCommandAckBundle; a lone
+    timestamp has a None payload, it goes as a plain ack. """
+    bundles = []
+    first, offsets = None, set()
+    for ts in timestamps + [None]:
+        if ts is not None and first is not None:
+            offset = ts_diff(ts, first)
+            if 0 <= offset < ACKBUNDLESPAN:
+                offsets.add(offset)
+                continue
+        if first is not None:
+            span = max(offsets) + 1
+            run = 0
+            while run < 255 and run + 1 < span and run + 1 in offsets:
+                run += 1
+            bitmap = bytearray((span - (run + 1) + 7) // 8)
+            for offset in offsets:
+                if offset > run:
+                    bit = offset - (run + 1)
+                    bitmap[bit // 8] |= 1 << (bit % 8)
+            bundles.append((first, None if len(offsets) == 1 else
+                            struct.pack("!B", run) + bytes(bitmap)))
+        first, offsets = ts, set([0])
+    return bundles
+
+
+def unbundle_acks(first, payload):
+    """ Timestamps acked by an ack bundle. """
+    if len(payload) < 1:
+        return [first]
+    data = bytearray(payload)
+    run = data[0]
+    acked = [(first + i) & TSMASK for i in range(run + 1)]
+    for bit in range(8 * (len(data) - 1)):
+        if data[1 + bit // 8] & (1 << (bit % 8)):
+            acked.append((first + run + 1 + bit) & TSMASK)
+    return acked
+
+
+def percentiles(values):
+    if not values:
+        return None
+    values = sorted(values)
+    def pick(p):
+        return values[min(len(values)-1, int(p * len(values)))]
+    return {
+        "count": len(values),
+        "p50_ms": round(pick(0.50) * 1000, 3),
+        "p90_ms": round(pick(0.90) * 1000, 3),
+        "p99_ms": round(pick(0.99) * 1000, 3),
+        "max_ms": round(values[-1] * 1000, 3),
+    }
+
+
+def rss_kb(pid):
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    return int(line.split()[1])
+    except (IOError, OSError, IndexError, ValueError):
+        pass
+    return None
+
+
+def rss_report(args, samples):
+    """ Growth of the RSS past the warmup, and its slope in kB/h. """
+    if not samples:
+        return None
+    warmup = args.duration / 5.0
+    steady = [(t, kb) for t, kb in samples if t >= warmup] or samples[-1:]
+    n = len(steady)
+    slope = None
+    if n > 1:
+        mt = sum(t for t, _ in steady) / float(n)
+        mk = sum(kb for _, kb in steady) / float(n)
+        var = sum((t - mt) ** 2 for t, _ in steady)
+        if var > 0:
+            slope = sum((t - mt) * (kb - mk) for t, kb in steady) / var
+    return {
+        "samples": [[round(t, 1), kb] for t, kb in samples],
+        "warmup_kb": steady[0][1],
+        "end_kb": samples[-1][1],
+        "max_kb": max(kb for _, kb in samples),
+        "growth_kb": samples[-1][1] - steady[0][1],
+        "slope_kb_per_h": round(slope * 3600, 1) if slope is not None
+                          else None,
+    }
+
+
+def cpu_seconds(pid):
+    try:
+        with open("/proc/%d/stat" % pid) as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        # utime and stime, fields 14 and 15 of stat(5)
+        return (int(fields[11]) + int(fields[12])) / \
+               float(os.sysconf("SC_CLK_TCK"))
+    except (IOError, OSError, IndexError, ValueError):
+        return None
+
+
+class Stats(object):
+    def __init__(self):
+        self.rtt = {}               # command name -> [sec]
+        self.sent = 0
+        self.received = 0
+        self.acksSent = 0           # ack datagrams, bundles included
+        self.bundlesSent = 0
+        self.bundledSent = 0        # acks in the bundles sent
+        self.acksReceived = 0
+        self.bundlesReceived = 0
+        self.bundledReceived = 0
+        self.resends = 0            # ours
+        self.failures = 0           # no answer after MAXRESEND resends
+        self.duplicates = 0         # central station retransmissions
+        self.registrations = 0
+        self.byes = 0
+        self.connections = 0
+        self.refused = 0            # hello without answer
+        self.controlsSent = 0
+        self.controlsReceived = 0
+        self.controlsStale = 0      # older than the last one, dropped
+        self.logsSent = 0           # resends not counted
+        self.logsAcked = 0
+        self.logsResent = 0         # not acked in time, or shed
+        self.logsFailed = 0
+        self.dropped = 0            # --loss, both ways
+        self.crashes = 0
+        self.detections = []        # sec from a crash to its Disconnect
+        self.undetected = 0         # back up before any Disconnect
+        self.falseDeaths = 0        # Disconnect of a drone alive
+        self.monitored = 0.0        # sec of connected drones alive
+        self.rss = []               # (sec, kB) of the central station
+
+    def addRtt(self, cmd, sec):
+        self.rtt.setdefault(CMD_NAMES[cmd], []).append(sec)
+
+    def merge(self, other):
+        """ Adds the counts of another process. """
+        for name, value in other.__dict__.items():
+            if name == "rtt":
+                for cmd, values in value.items():
+                    self.rtt.setdefault(cmd, []).extend(values)
+            else:
+                setattr(self, name, getattr(self, name) + value)
+
+
+class Station(object):
+    """ One simulated drone or command station. """
+
+    def __init__(self, gen, index, kind):
+        self.gen    = gen
+        self.kind   = kind
+        self.name   = "%s%s-%02d" % (gen.prefix, kind, index)
+        self.sock   = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind((gen.args.bind, 0))
+        self.sock.setblocking(False)
+        self.version = gen.args.protocol
+        self.lastTs = None
+        self.pendingAcks = {}       # (addr, sess) -> [ts]
+        self.lastControl = {}       # (sess, cmd) -> ts
+        self.ackDeadline = None
+        self.pending = {}           # ts -> [packet, cmd, first, sent, tries]
+        self.seen = {}              # (cmd, sess, ts) -> time
+        self.reset(gen.start + random.uniform(0, gen.args.ramp))
+
+    def reset(self, start):
+        self.state      = "idle"
+        self.id         = None
+        self.sess       = None
+        self.droneSess  = None
+        self.peer       = None      # connected station
+        self.nextHello  = start
+        self.nextLog    = None
+        self.nextControl= None
+        self.byeAt      = None
+        self.crashAt    = None
+        self.restartAt  = None
+        self.detected   = False
+
+    def fileno(self):
+        return self.sock.fileno()
+
+    def timestamp(self):
+        ts = (int((time.time() - self.gen.start) * 1000) +
+              self.gen.args.clock_offset) & TSMASK
+        if self.lastTs is not None and not ts_before(self.lastTs, ts):
+            ts = (self.lastTs + 1) & TSMASK
+        self.lastTs = ts
+        return ts
+
+    def send(self, data, addr=None):
+        self.gen.stats.sent += 1
+        if self.gen.args.loss > 0 and random.random() < self.gen.args.loss:
+            self.gen.stats.dropped += 1
+            return
+        self.sock.sendto(data, addr or self.gen.central)
+
+    def request(self, cmd, sess, payload=b'', addr=None):
+        """ Send a packet which expects an answer echoing its timestamp. """
+        ts = self.timestamp()
+        data = encode(cmd, sess, ts, payload, self.version)
+        now = time.time()
+        self.pending[ts] = [data, cmd, now, now, 0, addr]
+        # Pending acks of the session leave ahead of it
+        self.flushAcks((addr or self.gen.central, sess))
+        self.send(data, addr)
+        return ts
+
+    def answered(self, ts, now):
+        entry = self.pending.pop(ts, None)
+        if entry is not None:
+            self.gen.stats.addRtt(entry[1], now - entry[2])
+            if entry[1] == CMD_LOG:
+                self.gen.stats.logsAcked += 1
+        return entry
+
+    def ack(self, version, sess, ts, addr):
+        """ v2 acks wait --ack-delay to be bundled, as DCPServer's. """
+        if version < 2 or self.gen.args.ack_delay <= 0:
+            self.sendAck(version, sess, ts, None, addr)
+            return
+        self.pendingAcks.setdefault((addr, sess), []).append(ts)
+        if self.ackDeadline is None:
+            self.ackDeadline = time.time() + self.gen.args.ack_delay / 1000.0
+
+    def sendAck(self, version, sess, ts, payload, addr):
+        stats = self.gen.stats
+        if payload is None:
+            self.send(encode(CMD_ACK, sess, ts, b'', version), addr)
+        else:
+            self.send(encode(CMD_ACKBUNDLE, sess, ts, payload, version), addr)
+            stats.bundlesSent += 1
+            stats.bundledSent += len(unbundle_acks(ts, payload))
+        stats.acksSent += 1
+
+    def flushAcks(self, key=None):
+        keys = list(self.pendingAcks) if key is None else [key]
+        for addr, sess in keys:
+            for first, payload in bundle_acks(
+                    self.pendingAcks.pop((addr, sess), [])):
+                self.sendAck(2, sess, first, payload, addr)
+        if not self.pendingAcks:
+            self.ackDeadline = None
+
+    # --- Timers ---
+    def tick(self, now):
+        args = self.gen.args
+
+        # A crashed drone is silent until it starts again, as a new station
+        if self.state == "crashed":
+            if now >= self.restartAt:
+                if not self.detected:
+                    self.gen.stats.undetected += 1
+                self.unlink()
+                self.pending.clear()
+                self.pendingAcks.clear()
+                self.ackDeadline = None
+                self.reset(now + random.uniform(0, args.ramp))
+            return
+        if self.crashAt is not None and now >= self.crashAt:
+            if self.peer is not None:
+                self.crash(now)
+                return
+            self.crashAt = now + random.expovariate(args.crash_rate)
+
+        if self.ackDeadline is not None and now >= self.ackDeadline:
+            self.flushAcks()
+
+        # No RTT estimation: the timeout starts from TIMEOUT and backs off
+        for ts, entry in list(self.pending.items()):
+            if now - entry[3] < min(TIMEOUT * 2 ** entry[4], RTOMAX):
+                continue
+            if entry[4] >= MAXRESEND:
+                del self.pending[ts]
+                self.gen.stats.failures += 1
+                if entry[1] == CMD_LOG:
+                    self.gen.stats.logsFailed += 1
+                if entry[1] == CMD_HELLOFROMREMOTE:
+                    self.gen.stats.refused += 1
+                    self.reset(now + random.uniform(0, args.ramp))
+                elif entry[1] == CMD_BYE:
+                    self.gone(now)
+                continue
+            entry[3] = now
+            entry[4] += 1
+            self.gen.stats.resends += 1
+            if entry[1] == CMD_LOG:
+                self.gen.stats.logsResent += 1
+            self.send(entry[0], entry[5])
+
+        for key, when in list(self.seen.items()):
+            if now - when > DUPWINDOW:
+                del self.seen[key]
+
+        if self.state == "idle" and now >= self.nextHello:
+            self.state = "hello"
+            self.request(CMD_HELLOFROMREMOTE, SESSIDCENTRAL,
+                         (REMOTETYPEDRONE if self.kind == "drone" else
+                          REMOTETYPECOMMAND) + self.name.encode("utf-8"))
+            return
+
+        if self.state != "registered":
+            return
+
+        if self.byeAt is not None and now >= self.byeAt:
+            self.state = "bye"
+            self.request(CMD_BYE, self.sess)
+            return
+
+        # Logs due since the last tick are all sent, the load stays open
+        while self.nextLog is not None and now >= self.nextLog:
+            self.nextLog += random.expovariate(args.log_rate)
+            self.gen.stats.logsSent += 1
+            self.request(CMD_LOG, self.sess,
+                         random.choice(LOGLEVELS) +
+                         ("load %s %d" % (self.name, self.lastTs))
+                         .encode("utf-8"))
+
+        if self.kind == "command":
+            if self.peer is None and self.droneSess is None and \
+               not any(e[1] == CMD_CONNECTTODRONE
+                       for e in self.pending.values()):
+                drone = self.gen.freeDrone()
+                if drone is not None:
+                    self.request(CMD_CONNECTTODRONE, self.sess,
+                                 struct.pack("!H" if self.version >= 2
+                                             else "!B", drone.id))
+            elif self.droneSess is not None and self.peer is not None and \
+                 args.control_rate > 0 and now >= self.nextControl:
+                self.nextControl = now + 1.0 / args.control_rate
+                payload = struct.pack("!bbb", random.randint(-100, 100),
+                                      random.randint(-100, 100),
+                                      random.randint(-100, 100))
+                self.send(encode(CMD_AILERON, self.droneSess,
+                                 self.timestamp(), payload, self.version),
+                          self.peer.sock.getsockname())
+                self.gen.stats.controlsSent += 1
+
+    def registered(self, now):
+        args = self.gen.args
+        self.state = "registered"
+        self.gen.stats.registrations += 1
+        # Only a drone connected to a command station crashes, the
+        # Disconnect of the command station telling it was detected
+        if self.kind == "drone" and args.crash_rate > 0:
+            self.crashAt = now + random.expovariate(args.crash_rate)
+        self.nextLog = now + random.expovariate(args.log_rate) \
+                       if args.log_rate > 0 else None
+        self.nextControl = now
+        self.byeAt = now + random.uniform(0.5, 1.5) * args.lifetime \
+                     if args.lifetime > 0 else None
+        if self.kind == "drone":
+            self.request(CMD_VIDEOSERVERS, self.sess,
+                         ("rtsp://127.0.0.1/%s/front$rtsp://127.0.0.1/%s/"
+                          "bottom" % (self.name, self.name)).encode("utf-8"))
+
+    def gone(self, now):
+        self.gen.stats.byes += 1
+        self.unlink()
+        self.reset(now + random.uniform(0, self.gen.args.ramp))
+
+    def unlink(self):
+        if self.peer is not None:
+            self.peer.peer = None
+            self.peer.droneSess = None
+
+    def crash(self, now):
+        self.state      = "crashed"
+        self.crashAt    = now
+        self.restartAt  = now + self.gen.args.crash_downtime
+        self.detected   = False
+        self.gen.stats.crashes += 1
+
+    # --- Reception ---
+    def receive(self, now):
+        while True:
+            try:
+                data, addr = self.sock.recvfrom(4096)
+            except (socket.error, OSError):
+                return
+            if self.state == "crashed":
+                continue
+            if self.gen.args.loss > 0 and \
+               random.random() < self.gen.args.loss:
+                self.gen.stats.dropped += 1
+                continue
+            packet = decode(data)
+            if packet is None:
+                continue
+            self.gen.stats.received += 1
+            self.handle(packet, addr, now)
+
+    def handle(self, packet, addr, now):
+        version, cmd, sess, ts, payload = packet
+        stats = self.gen.stats
+
+        if cmd in (CMD_ACK, CMD_ACKBUNDLE):
+            acked = [ts]
+            if cmd == CMD_ACKBUNDLE:
+                acked = unbundle_acks(ts, payload)
+                stats.bundlesReceived += 1
+                stats.bundledReceived += len(acked)
+            stats.acksReceived += 1
+            for ts in acked:
+                entry = self.answered(ts, now)
+                if entry is not None and entry[1] == CMD_BYE:
+                    self.gone(now)
+            return
+
+        if cmd in LATEST:
+            stats.controlsReceived += 1
+            last = self.lastControl.get((sess, cmd))
+            if last is not None and ts_before(ts, last):
+                stats.controlsStale += 1
+            else:
+                self.lastControl[(sess, cmd)] = ts
+            return
+
+        # Everything else is acked, even the duplicates whose ack was lost
+        self.ack(version, sess, ts, addr)
+        key = (cmd, sess, ts)
+        if key in self.seen:
+            self.gen.stats.duplicates += 1
+            return
+        self.seen[key] = now
+
+        if cmd == CMD_HELLOFROMCENTRAL and self.state == "hello":
+            if self.answered(ts, now) is None:
+                return
+            if version >= 2:
+                if len(payload) < 4:
+                    return
+                self.sess, self.id = struct.unpack("!HH", payload[:4])
+            else:
+                if len(payload) < 1:
+                    return
+                b = bytearray(payload)[0]
+                self.sess   = (b >> 4) & 0x0F
+                self.id     = b & 0x0F
+            self.registered(now)
+        elif cmd == CMD_SETSESSID and \
+             len(payload) >= (2 if version >= 2 else 1):
+            if version >= 2:
+                self.droneSess = struct.unpack("!H", payload[:2])[0]
+            else:
+                self.droneSess = bytearray(payload)[0]
+            if self.kind == "command":
+                entry = self.answered(ts, now)
+                if entry is not None:
+                    self.gen.stats.connections += 1
+                self.peer = self.gen.connectedDrone(self)
+                if self.peer is not None:
+                    self.peer.peer = self
+        elif cmd == CMD_DISCONNECT:
+            drone = self.peer
+            if drone is not None and drone.state == "crashed":
+                if not drone.detected:
+                    drone.detected = True
+                    stats.detections.append(now - drone.crashAt)
+            elif drone is not None:
+                stats.falseDeaths += 1
+            self.unlink()
+            self.peer = None
+            self.droneSess = None
+
+
+class LoadGenerator(object):
+    def __init__(self, args, index=0, start=None):
+        self.args       = args
+        self.central    = (args.address, args.port)
+        self.stats      = Stats()
+        self.start      = start or time.time()
+        self.prefix     = "p%d-" % index if args.processes > 1 else ""
+        # One process samples the central station's memory
+        self.rssPid     = args.central_pid \
+                          if index == 0 and args.rss_interval > 0 else None
+        self.stations   = [Station(self, i, "drone")
+                           for i in range(args.drones)] + \
+                          [Station(self, i, "command")
+                           for i in range(args.commands)]
+
+    def freeDrone(self):
+        busy = set(s.peer for s in self.stations if s.kind == "command")
+        pending = [s for s in self.stations
+                   if s.kind == "drone" and s.state == "registered" and
+                      s.peer is None and s not in busy]
+        return random.choice(pending) if pending else None
+
+    def connectedDrone(self, command):
+        """ The drone given the same drone session as command. """
+        for s in self.stations:
+            if s.kind == "drone" and s.droneSess == command.droneSess and \
+               s.state == "registered":
+                return s
+        return None
+
+    def run(self):
+        end = self.start + self.args.duration
+        last = time.time()
+        nextRss = self.start
+
+        while True:
+            now = time.time()
+            if now >= end:
+                break
+            ready, _, _ = select.select(self.stations, [], [], 0.005)
+            now = time.time()
+            for station in ready:
+                station.receive(now)
+            for station in self.stations:
+                station.tick(now)
+            if self.args.crash_rate > 0:
+                self.stats.monitored += (now - last) * sum(
+                    1 for s in self.stations if s.kind == "drone" and
+                    s.state == "registered" and s.peer is not None)
+            last = now
+            if self.rssPid and now >= nextRss:
+                nextRss += self.args.rss_interval
+                kb = rss_kb(self.rssPid)
+                if kb is not None:
+                    self.stats.rss.append((now - self.start, kb))
+
+        return self.stats
+
+
+def generate(job):
+    """ Runs the stations of one process, returns their Stats. """
+    args, index, start = job
+    random.seed(None if args.seed is None else args.seed + index)
+    return LoadGenerator(args, index, start).run()
+
+
+def report(args, stats, start, elapsed, cpuStart, cpuEnd):
+    sent = stats.sent
+    cpu = None
+    if cpuStart is not None and cpuEnd is not None:
+        cpu = cpuEnd - cpuStart
+
+    return {
+        "config": {
+            "address": args.address,
+            "port": args.port,
+            "drones": args.drones,
+            "commands": args.commands,
+            "duration_s": args.duration,
+            "lifetime_s": args.lifetime,
+            "log_rate_hz": args.log_rate,
+            "control_rate_hz": args.control_rate,
+            "protocol": args.protocol,
+            "ack_delay_ms": args.ack_delay,
+            "processes": args.processes,
+            "loss": args.loss,
+            "crash_rate_hz": args.crash_rate,
+            "crash_downtime_s": args.crash_downtime,
+        },
+        "start": time.strftime("%Y-%m-%dT%H:%M:%SZ",
+                               time.gmtime(start)),
+        "elapsed_s": round(elapsed, 3),
+        "packets": {
+            "sent": stats.sent,
+            "received": stats.received,
+            "sent_per_s": round(stats.sent / elapsed, 3),
+            "received_per_s": round(stats.received / elapsed, 3),
+            "resent": stats.resends,
+            "resend_rate": round(stats.resends / float(stats.sent), 6)
+                           if stats.sent else 0.0,
+            "failed": stats.failures,
+            "central_duplicates": stats.duplicates,
+            "central_retransmit_rate":
+                round(stats.duplicates / float(stats.received), 6)
+                if stats.received else 0.0,
+        },
+        "acks": {
+            "sent": stats.acksSent,
+            "bundles_sent": stats.bundlesSent,
+            "acks_in_bundles_sent": stats.bundledSent,
+            "received": stats.acksReceived,
+            "bundles_received": stats.bundlesReceived,
+            "acks_in_bundles_received": stats.bundledReceived,
+        },
+        "registrations": {
+            "count": stats.registrations,
+            "per_s": round(stats.registrations / elapsed, 3),
+            "refused": stats.refused,
+            "byes": stats.byes,
+            "connections": stats.connections,
+        },
+        "logs": {
+            "sent": stats.logsSent,
+            "acked": stats.logsAcked,
+            "acked_per_s": round(stats.logsAcked / elapsed, 3),
+            "resent": stats.logsResent,
+            "failed": stats.logsFailed,
+        },
+        "controls": {
+            "sent": stats.controlsSent,
+            "received": stats.controlsReceived,
+            "lost": max(0, stats.controlsSent - stats.controlsReceived),
+            "stale": stats.controlsStale,
+        },
+        "failure_detection": {
+            "loss": args.loss,
+            "dropped": stats.dropped,
+            "crashes": stats.crashes,
+            "detected": len(stats.detections),
+            "undetected": stats.undetected,
+            "latency": percentiles(stats.detections),
+            "false_positives": stats.falseDeaths,
+            "monitored_station_hours": round(stats.monitored / 3600, 3),
+            "false_positives_per_station_hour":
+                round(stats.falseDeaths * 3600 / stats.monitored, 3)
+                if stats.monitored else None,
+        } if args.loss > 0 or args.crash_rate > 0 else None,
+        "central_rss": rss_report(args, stats.rss),
+        "rtt": dict((name, percentiles(values))
+                    for name, values in stats.rtt.items()),
+        "central_cpu": {
+            "seconds": round(cpu, 3),
+            "usec_per_packet": round(cpu * 1e6 / sent, 3) if sent else None,
+        } if cpu is not None else None,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Load generator for the DCP central station.")
+    parser.add_argument("--address", default="127.0.0.1",
+                        help="central station address")
+    parser.add_argument("--port", type=int, default=5688,
+                        help="central station port")
+    parser.add_argument("--bind", default="127.0.0.1",
+                        help="address the simulated stations bind to")
+    parser.add_argument("--drones", type=int, default=8)
+    parser.add_argument("--commands", type=int, default=7)
+    parser.add_argument("--duration", type=float, default=30.0,
+                        help="seconds")
+    parser.add_argument("--ramp", type=float, default=1.0,
+                        help="seconds over which the hellos are spread")
+    parser.add_argument("--lifetime", type=float, default=5.0,
+                        help="mean seconds before a station says bye, "
+                             "0 to stay")
+    parser.add_argument("--log-rate", type=float, default=5.0,
+                        help="logs per second and station")
+    parser.add_argument("--control-rate", type=float, default=50.0,
+                        help="controls per second from a command station "
+                             "to its drone, which do not go through the "
+                             "central station")
+    parser.add_argument("--central-pid", type=int, default=None,
+                        help="pid of the central station, for its CPU time")
+    parser.add_argument("--central", default=None,
+                        help="command starting the central station, the "
+                             "address and port are appended")
+    parser.add_argument("--clock-offset", type=int, default=0,
+                        help="msec the stations' timestamps start ahead, "
+                             "to test their wraparound")
+    parser.add_argument("--protocol", type=int, choices=[1, 2], default=1,
+                        help="DCP version the stations speak")
+    parser.add_argument("--ack-delay", type=int, default=0,
+                        help="msec the stations' v2 acks wait to be "
+                             "bundled, 0 to send each at once")
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="probability a datagram is lost, in both "
+                             "directions")
+    parser.add_argument("--crash-rate", type=float, default=0.0,
+                        help="crashes per second of a connected drone")
+    parser.add_argument("--crash-downtime", type=float, default=60.0,
+                        help="seconds a crashed drone stays silent")
+    parser.add_argument("--rss-interval", type=float, default=0.0,
+                        help="seconds between two samples of the central "
+                             "station's RSS, 0 not to sample it")
+    parser.add_argument("--max-rss-growth", type=int, default=None,
+                        help="kB the central station's RSS may grow past "
+                             "the warmup, the exit status is 1 beyond")
+    parser.add_argument("--processes", type=int, default=1,
+                        help="generator processes, each one with --drones "
+                             "and --commands stations")
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument("--output", default="-",
+                        help="JSON report file, - for stdout")
+    args = parser.parse_args()
+
+    args.processes = max(1, args.processes)
+    if args.protocol == 1 and \
+       (args.drones + args.commands) * args.processes > IDMAX:
+        parser.error("a net holds at most %d stations" % IDMAX)
+
+    process = None
+    try:
+        if args.central:
+            process = subprocess.Popen(
+                shlex.split(args.central) + [args.address, str(args.port)])
+            time.sleep(1.0)
+        pid = args.central_pid or (process.pid if process else None)
+        args.central_pid = pid
+        start = time.time()
+        cpuStart = cpu_seconds(pid) if pid else None
+        jobs = [(args, i, start) for i in range(args.processes)]
+        if args.processes > 1:
+            pool = multiprocessing.Pool(args.processes)
+            stats = Stats()
+            for other in pool.map(generate, jobs):
+                stats.merge(other)
+            pool.close()
+            pool.join()
+        else:
+            stats = generate(jobs[0])
+        elapsed = time.time() - start
+        cpuEnd = cpu_seconds(pid) if pid else None
+        result = report(args, stats, start, elapsed, cpuStart, cpuEnd)
+    finally:
+        if process:
+            process.terminate()
+            process.wait()
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    json.dump(result, out, indent=2, sort_keys=True)
+    out.write("\n")
+    if out is not sys.stdout:
+        out.close()
+
+    rss = result["central_rss"]
+    if args.max_rss_growth is not None and rss is not None and \
+       rss["growth_kb"] > args.max_rss_growth:
+        sys.stderr.write("central station RSS grew by %d kB past the "
+                         "warmup, more than %d kB\n" %
+                         (rss["growth_kb"], args.max_rss_growth))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,231 @@
+/*!
+ *   \file  rtt.c
+ *   \brief  DCP retransmission timeout test.
+ *
+ *  Drives the UAV server ack queue with an injected clock: checks that the
+ *  RTO follows the measured RTT on a LAN and on a slow radio link, that
+ *  the acks of resent packets are not measured (Karn's rule), that the
+ *  resends back off exponentially before giving up, and that latest
+ *  commands are neither kept nor acked. Run with ./tests/test.sh rtt.
+ *
+ *  \author  Bertrand.F (),
+ *
+ *  \internal
+ *      Compiler:  gcc
+ *     Copyright:  Copyright (C), 2014, Bertrand.F
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The ack queue and the server state are internal to uav_server.c */
+#include "../UAVStation/src/uav_server.c"
+
+#define NBSAMPLES   (64)    ///< Packets acked per link.
+
+static uint64_t fake_now;   ///< Injected clock, msec.
+static int      nbfailed;
+
+static uint64_t fake_clock()
+{
+    return fake_now;
+}
+
+static void check(int cond, const char* what, int value)
+{
+    if(!cond) {
+        printf("FAIL: %s (%d)\n", what, value);
+        nbfailed++;
+    }
+}
+
+/*!
+ *  \brief  Sends to itself, as the central station.
+ */
+static void setup()
+{
+    struct sockaddr_in *in = (struct sockaddr_in*)&(uavsrv.params.central_addr);
+
+    uavsrv_clock        = fake_clock;
+    fake_now            = 1000;
+    uavsrv.start_time   = uavsrv_clock();
+    uavsrv.state        = REGISTERED;
+    ackqueue_init();
+
+    uavsrv.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    in->sin_family      = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    in->sin_port        = 0;
+    bind(uavsrv.sock, (struct sockaddr*)in, sizeof(*in));
+    uavsrv.params.central_addrlen = sizeof(*in);
+    getsockname(uavsrv.sock, (struct sockaddr*)in, &(uavsrv.params.central_addrlen));
+}
+
+/*!
+ *  \brief  Ack the packet of the ack queue sent with timestamp ts.
+ */
+static void ack(uint32_t ts)
+{
+    struct dcp_packet_s packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.cmd          = DCP_CMDACK;
+    packet.timestamp    = ts;
+    handler_ack(&packet);
+}
+
+/*!
+ *  \brief  Send a log, acked after rtt msec.
+ */
+static void log_acked(int rtt)
+{
+    uint32_t ts;
+
+    fake_now++;
+    ts = uavsrv_msec_sincestart();
+    dcp_log("rtt");
+    fake_now += rtt;
+    ack(ts);
+}
+
+static struct dcp_rtt_s* central_rtt()
+{
+    return rtt_find(&(uavsrv.params.central_addr), uavsrv.params.central_addrlen);
+}
+
+/*!
+ *  \brief  20 msec LAN: the RTO drops from DCP_TIMEOUT to DCP_RTOMIN.
+ */
+static void test_lan()
+{
+    int i, srtt, rttvar, rto;
+
+    check(uavsrv_getrtt(&(uavsrv.params.central_addr), &srtt, &rttvar, &rto) < 0,
+          "no RTT before the first packet", 0);
+    check(rtt_timeout(central_rtt(), 0) == DCP_TIMEOUT, "initial RTO", rtt_timeout(central_rtt(), 0));
+
+    for(i=0 ; i<NBSAMPLES ; ++i)
+        log_acked(18 + 2*(i%3));
+
+    uavsrv_getrtt(&(uavsrv.params.central_addr), &srtt, &rttvar, &rto);
+    check(srtt >= 18 && srtt <= 22, "LAN srtt", srtt);
+    check(rto == DCP_RTOMIN, "LAN rto", rto);
+    check(central_rtt()->nbsamples == NBSAMPLES, "LAN samples", central_rtt()->nbsamples);
+    check(uavsrv.ackqueue == NULL, "LAN ack queue empty", 0);
+    printf("LAN: srtt=%d rttvar=%d rto=%d\n", srtt, rttvar, rto);
+}
+
+/*!
+ *  \brief  The ack of a resent packet is not measured, the backoff stays.
+ */
+static void test_karn()
+{
+    struct dcp_rtt_s *rtt = central_rtt();
+    int nbsamples = rtt->nbsamples, rto = rtt->rto;
+    uint32_t ts;
+
+    fake_now++;
+    ts = uavsrv_msec_sincestart();
+    dcp_log("karn");
+    fake_now += rto;
+    check(ackqueue_resend() == 1, "resent after the RTO", rto);
+    check(rtt_timeout(rtt, 0) == 2*rto, "backed off", rtt_timeout(rtt, 0));
+    fake_now += 5;
+    ack(ts);
+    check(rtt->nbsamples == nbsamples, "ack of a resent packet not measured", rtt->nbsamples);
+    check(rtt_timeout(rtt, 0) == 2*rto, "backoff kept until a measure", rtt_timeout(rtt, 0));
+
+    log_acked(20);
+    check(rtt_timeout(rtt, 0) == rto, "backoff reset by a measure", rtt_timeout(rtt, 0));
+}
+
+/*!
+ *  \brief  Unanswered packet: resent DCP_MAXRESEND times, twice later each time.
+ */
+static void test_backoff()
+{
+    int i, nbresend = 0;
+    uint64_t last, expected = central_rtt()->rto;
+
+    fake_now++;
+    dcp_log("backoff");
+    last = fake_now;
+    for(i=0 ; i<100000 && uavsrv.ackqueue!=NULL ; ++i) {
+        fake_now++;
+        if(ackqueue_resend() == 0)
+            continue;
+        check(fake_now - last == expected, "resend interval", (int)(fake_now - last));
+        last = fake_now;
+        expected = (expected*2 < DCP_RTOMAX) ? expected*2 : DCP_RTOMAX;
+        if(uavsrv.ackqueue != NULL)
+            nbresend++;
+    }
+    check(nbresend == DCP_MAXRESEND, "given up after DCP_MAXRESEND resends", nbresend);
+    check(uavsrv.ackqueue == NULL, "ack queue empty", 0);
+}
+
+/*!
+ *  \brief  Radio link, 900 to 1700 msec: the RTO covers the variation.
+ */
+static void test_radio()
+{
+    int i, srtt, rttvar, rto;
+
+    for(i=0 ; i<NBSAMPLES ; ++i)
+        log_acked(900 + 200*(i%5));
+
+    uavsrv_getrtt(&(uavsrv.params.central_addr), &srtt, &rttvar, &rto);
+    check(srtt >= 1100 && srtt <= 1500, "radio srtt", srtt);
+    check(rto > 1700 && rto <= DCP_RTOMAX, "radio rto above the slowest ack", rto);
+    printf("radio: srtt=%d rttvar=%d rto=%d\n", srtt, rttvar, rto);
+}
+
+/*!
+ *  \brief  Latest commands (DCP_DELIVERY) skip the ack queue and the acks.
+ */
+static void test_latest()
+{
+    struct dcp_packet_s *packet = dcp_packetnew();
+
+    packet->dstaddr     = uavsrv.params.central_addr;
+    packet->dstaddrlen  = uavsrv.params.central_addrlen;
+    packet->cmd         = DCP_CMDTHROTTLE;
+    packet->timestamp   = uavsrv_msec_sincestart();
+    dcp_send(packet);
+    ackqueue_add(packet);
+    check(uavsrv.ackqueue == NULL, "latest command not kept", 0);
+
+    packet = dcp_packetnew();
+    packet->cmd = DCP_CMDAILERON;
+    dcp_packetack(packet);
+    check(packet->cmd == DCP_CMDAILERON, "latest command not acked", packet->cmd);
+    dcp_packetfree(packet);
+}
+
+int main()
+{
+    openlog("rtt", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    setup();
+    test_lan();
+    test_karn();
+    test_backoff();
+    test_radio();
+    test_latest();
+
+    close(uavsrv.sock);
+    printf("%s\n", nbfailed ? "FAILED" : "OK");
+    return nbfailed ? 1 : 0;
+}
@@ -23,12 +23,15 @@
 SCRIPTDIR=`dirname $0`
 DBDIR="$SCRIPTDIR/../Database/"
 BUILDDIR="$SCRIPTDIR/../../build-Drone-Desktop-Debug/"
+LIBDCPDIR="$SCRIPTDIR/../libdcp"
 
 COMMANDSTATION="$BUILDDIR/CommandStation/CommandStation"
 CENTRALSTATION="$BUILDDIR/CentralStation/CentralStation"
 
 DBNAME="drones"
 DBUSER="dronedbmanager"
+# The central station takes the password psql uses
+export DCP_DBPASSWORD="${DCP_DBPASSWORD:-$PGPASSWORD}"
 
 
 
@@ -40,6 +43,21 @@ usage()
 	echo "Actions:"
 	echo "  db        Manage drone database."
 	echo "  test1     Run test with setup 1."
+	echo "  timestamps  Build and run the timestamps wraparound test."
+	echo "  rtt       Build and run the retransmission timeout test."
+	echo "  codec     Build and run the DCP header encoding test."
+	echo "  ackqueue  Build and run the ack queue benchmark, needs libdcp built."
+	echo "  dispatch  Build and run the packet dispatch benchmark, needs libdcp built."
+	echo "  scaling [threads,...] [processes]"
+	echo "            Datagrams/s of the central station with 1,2,4 threads."
+	echo "  registrations [stations]"
+	echo "            Registrations/s of the central station on PostgreSQL."
+	echo "  logs [logs/s per station]"
+	echo "            Sustained logs/s of the central station on PostgreSQL."
+	echo "  failures [loss,...]"
+	echo "            Failure detection latency and false positives under loss."
+	echo "  soak [minutes]"
+	echo "            Checks the central station RSS stays flat under a fleet."
 }
 
 
@@ -185,6 +203,251 @@ test_test1()
 
 
 
+##################
+### TIMESTAMPS ###
+##################
+test_timestamps()
+{
+	TESTBIN="/tmp/dcp-timestamps"
+
+	gcc -Wall -o $TESTBIN "$SCRIPTDIR/timestamps.c" && $TESTBIN
+}
+
+
+
+###########
+### RTT ###
+###########
+test_rtt()
+{
+	TESTBIN="/tmp/dcp-rtt"
+
+	gcc -Wall -o $TESTBIN "$SCRIPTDIR/rtt.c" && $TESTBIN
+}
+
+
+
+#############
+### CODEC ###
+#############
+test_codec()
+{
+	TESTBIN="/tmp/dcp-codec"
+
+	gcc -Wall -o $TESTBIN "$SCRIPTDIR/codec.c" && $TESTBIN
+}
+
+
+
+################
+### ACKQUEUE ###
+################
+# The libdcp benchmarks link against the static library of the Qt Creator
+# build, see BUILDDIR
+build_libdcp_test()
+{
+	g++ -Wall -O2 -fPIC -o $1 -I"$LIBDCPDIR" "$2" \
+		-L"$BUILDDIR/libdcp" -ldcp \
+		`pkg-config --cflags --libs Qt5Core Qt5Network Qt5Sql`
+}
+
+test_ackqueue()
+{
+	TESTBIN="/tmp/dcp-ackqueue"
+
+	build_libdcp_test $TESTBIN "$SCRIPTDIR/ackqueue.cpp" && $TESTBIN
+}
+
+
+
+################
+### DISPATCH ###
+################
+test_dispatch()
+{
+	TESTBIN="/tmp/dcp-dispatch"
+
+	build_libdcp_test $TESTBIN "$SCRIPTDIR/dispatch.cpp" && $TESTBIN
+}
+
+
+
+###############
+### SCALING ###
+###############
+# Prints a field of a loadgen.py report, - if it has none
+report_field()
+{
+	python3 -c "import json, sys; r = json.load(open(sys.argv[1]))
+for key in sys.argv[2].split('.'): r = r.get(key) if r else None
+print('-' if r is None else r)" "$1" "$2"
+}
+
+# Same load, more central station threads: every drone sends logs as fast
+# as the generator processes can, the memory storage keeps the database
+# out of the measure.
+test_scaling()
+{
+	THREADS=${2:-"1,2,4"}
+	PROCESSES=${3:-4}
+
+	echo "threads  datagrams/s in  datagrams/s out  central CPU us/packet"
+	for N in ${THREADS//,/ }; do
+		REPORT="/tmp/dcp-scaling-$N.json"
+		"$SCRIPTDIR/loadgen.py" \
+			--central "$CENTRALSTATION --storage memory --threads $N" \
+			--protocol 2 --processes $PROCESSES --drones 16 --commands 0 \
+			--lifetime 0 --log-rate 1000 --duration 20 \
+			--output $REPORT || return 1
+		echo "$N  `report_field $REPORT packets.sent_per_s`" \
+		     " `report_field $REPORT packets.received_per_s`" \
+		     " `report_field $REPORT central_cpu.usec_per_packet`"
+	done
+}
+
+
+
+#####################
+### REGISTRATIONS ###
+#####################
+# Rows inserted in a table since the database was created, the statistics
+# collector lags up to a second behind
+rows_inserted()
+{
+	psql -d $DBNAME -U $DBUSER -tA -c "SELECT coalesce(sum(n_tup_ins), 0)
+		FROM pg_stat_user_tables WHERE relname = '$1'"
+}
+
+# Stations say hello, bye shortly after, and hello again. The central
+# station answers from its registry and writes behind: the rate of its
+# answers and that of the rows PostgreSQL inserted are both printed, the
+# second one lower when the database does not keep up.
+test_registrations()
+{
+	STATIONS=${2:-200}
+	REPORT="/tmp/dcp-registrations.json"
+
+	test_db db drop > /dev/null
+	test_db db create > /dev/null
+	BEFORE=`rows_inserted stations`
+	"$SCRIPTDIR/loadgen.py" \
+		--central "$CENTRALSTATION --storage postgres --db-name $DBNAME --db-user $DBUSER" \
+		--protocol 2 --processes 2 --drones $STATIONS --commands 0 \
+		--lifetime 0.2 --ramp 0.1 --log-rate 0 --control-rate 0 \
+		--duration 20 --output $REPORT || return 1
+	sleep 1
+	AFTER=`rows_inserted stations`
+
+	ELAPSED=`report_field $REPORT elapsed_s`
+	echo "registrations/s answered: `report_field $REPORT registrations.per_s`"
+	echo "hello RTT p50/p99 ms: `report_field $REPORT rtt.hellofromremote.p50_ms`" \
+	     "/ `report_field $REPORT rtt.hellofromremote.p99_ms`"
+	echo "stations inserted/s: `python3 -c "print(round(($AFTER - $BEFORE) / $ELAPSED, 3))"`"
+}
+
+
+
+############
+### LOGS ###
+############
+# A chatty fleet: 100 stations log at the given rate each. The logs acked
+# per second are those the central station committed to the database, the
+# logs stored per second are those PostgreSQL holds at the end. Logs shed
+# or not written by the central station are not acked, and are resent by
+# the stations.
+test_logs()
+{
+	RATE=${2:-100}
+	REPORT="/tmp/dcp-logs.json"
+
+	test_db db drop > /dev/null
+	test_db db create > /dev/null
+	"$SCRIPTDIR/loadgen.py" \
+		--central "$CENTRALSTATION --storage postgres --db-name $DBNAME --db-user $DBUSER" \
+		--protocol 2 --processes 2 --drones 50 --commands 0 \
+		--lifetime 0 --log-rate $RATE --control-rate 0 \
+		--duration 30 --output $REPORT || return 1
+	STORED=`psql -d $DBNAME -U $DBUSER -tA -c "SELECT count(*) FROM logs"`
+
+	ELAPSED=`report_field $REPORT elapsed_s`
+	SENT=`report_field $REPORT logs.sent`
+	echo "logs sent/s: `python3 -c "print(round($SENT / $ELAPSED, 3))"`"
+	echo "logs acked/s: `report_field $REPORT logs.acked_per_s`"
+	echo "logs stored/s: `python3 -c "print(round($STORED / $ELAPSED, 3))"`"
+	echo "logs resent: `report_field $REPORT logs.resent`," \
+	     "given up: `report_field $REPORT logs.failed`"
+	echo "log RTT p50/p99 ms: `report_field $REPORT rtt.log.p50_ms`" \
+	     "/ `report_field $REPORT rtt.log.p99_ms`"
+}
+
+
+
+################
+### FAILURES ###
+################
+# Ten drones, each one driven by a command station, crash about every 100
+# seconds and stay silent for 30. They do not log: the central station
+# only hears them through its pings, over a link losing the given share
+# of the datagrams both ways.
+test_failures()
+{
+	LOSSES=${2:-"0,0.05,0.2"}
+
+	echo "loss  crashes  detected  latency p50/p99 ms  false positives/station-hour"
+	for LOSS in ${LOSSES//,/ }; do
+		REPORT="/tmp/dcp-failures-$LOSS.json"
+		"$SCRIPTDIR/loadgen.py" \
+			--central "$CENTRALSTATION --storage memory --ping-interval 1000" \
+			--protocol 2 --drones 10 --commands 10 --lifetime 0 \
+			--log-rate 0 --loss $LOSS --crash-rate 0.01 \
+			--crash-downtime 30 --duration 600 \
+			--output $REPORT || return 1
+		echo "$LOSS  `report_field $REPORT failure_detection.crashes`" \
+		     " `report_field $REPORT failure_detection.detected`" \
+		     " `report_field $REPORT failure_detection.latency.p50_ms`" \
+		     "/ `report_field $REPORT failure_detection.latency.p99_ms`" \
+		     " `report_field $REPORT failure_detection.false_positives_per_station_hour`"
+	done
+}
+
+
+
+############
+### SOAK ###
+############
+# A fleet of 100 stations which log, drive each other, say bye after 30
+# seconds on average and come back, for an hour by default. Past the
+# warmup, the RSS of the central station may not grow by more than 2 MB.
+test_soak()
+{
+	MINUTES=${2:-60}
+	REPORT="/tmp/dcp-soak.json"
+
+	"$SCRIPTDIR/loadgen.py" \
+		--central "$CENTRALSTATION --storage memory" \
+		--protocol 2 --processes 2 --drones 25 --commands 25 \
+		--lifetime 30 --log-rate 5 --control-rate 20 \
+		--duration $((MINUTES * 60)) --rss-interval 10 \
+		--max-rss-growth 2048 --output $REPORT
+	RESULT=$?
+
+	echo "registrations: `report_field $REPORT registrations.count`"
+	echo "RSS after warmup/end/max kB: `report_field $REPORT central_rss.warmup_kb`" \
+	     "/ `report_field $REPORT central_rss.end_kb`" \
+	     "/ `report_field $REPORT central_rss.max_kb`"
+	echo "RSS slope kB/h: `report_field $REPORT central_rss.slope_kb_per_h`"
+	if [ $RESULT -ne 0 ]; then
+		echo "FAILED"
+		return 1
+	fi
+	echo "OK"
+}
+
+
+
+
+
+
 # Check that we got at least a testname
 if (($# < 1)); then 
 	usage
@@ -197,4 +460,24 @@ if [ "$TESTNAME" == "db" ]; then
 	test_db $@	
 elif [ "$TESTNAME" == "test1" ]; then
 	test_test1 $@
+elif [ "$TESTNAME" == "timestamps" ]; then
+	test_timestamps $@
+elif [ "$TESTNAME" == "rtt" ]; then
+	test_rtt $@
+elif [ "$TESTNAME" == "codec" ]; then
+	test_codec $@
+elif [ "$TESTNAME" == "ackqueue" ]; then
+	test_ackqueue $@
+elif [ "$TESTNAME" == "dispatch" ]; then
+	test_dispatch $@
+elif [ "$TESTNAME" == "scaling" ]; then
+	test_scaling $@
+elif [ "$TESTNAME" == "registrations" ]; then
+	test_registrations $@
+elif [ "$TESTNAME" == "logs" ]; then
+	test_logs $@
+elif [ "$TESTNAME" == "failures" ]; then
+	test_failures $@
+elif [ "$TESTNAME" == "soak" ]; then
+	test_soak $@
 fi
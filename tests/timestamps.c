@@ -0,0 +1,131 @@
+/*!
+ *   \file  timestamps.c
+ *   \brief  DCP timestamps wraparound test.
+ *
+ *  Fast-forwards the UAV server clock through several wraps of the 24-bit
+ *  DCP timestamps and checks that the commands are still accepted in
+ *  order and rejected when stale. Run with ./tests/test.sh timestamps.
+ *
+ *  \author  Bertrand.F (),
+ *
+ *  \internal
+ *      Compiler:  gcc
+ *     Copyright:  Copyright (C), 2014, Bertrand.F
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The handlers and the server state are internal to uav_server.c */
+#include "../UAVStation/src/uav_server.c"
+
+#define NBWRAPS     (3)     ///< Wraps to go through.
+#define STEP        (4099)  ///< Msec the clock moves between two commands.
+#define SESSID      (3)     ///< Command station session.
+
+static uint64_t fake_now;   ///< Injected clock, msec.
+static int      nbfailed;
+
+static uint64_t fake_clock()
+{
+    return fake_now;
+}
+
+static void check(int cond, const char* what, uint32_t ts)
+{
+    if(!cond) {
+        printf("FAIL: %s (timestamp=0x%06x)\n", what, ts);
+        nbfailed++;
+    }
+}
+
+static int send_ailerons(uint32_t ts)
+{
+    struct dcp_packet_s packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.cmd          = DCP_CMDAILERON;
+    packet.sessid       = SESSID;
+    packet.timestamp    = ts;
+    packet.datalen      = 3;
+    return handler_ailerons(&packet);
+}
+
+/*!
+ *  \brief  Serial number comparisons around the wrap.
+ */
+static void test_compare()
+{
+    check(DCP_TIMESTAMPLT(0xFFFFF0u, 0x000010u), "0xFFFFF0 < 0x10", 0xFFFFF0);
+    check(!DCP_TIMESTAMPLT(0x000010u, 0xFFFFF0u), "!(0x10 < 0xFFFFF0)", 0x10);
+    check(DCP_TIMESTAMPLT(0x000010u, 0x000020u), "0x10 < 0x20", 0x10);
+    check(!DCP_TIMESTAMPLT(0x000020u, 0x000020u), "!(0x20 < 0x20)", 0x20);
+    check(!DCP_TIMESTAMPLT(0u, (uint32_t)DCP_TIMESTAMPHALF) &&
+          !DCP_TIMESTAMPLT((uint32_t)DCP_TIMESTAMPHALF, 0u),
+          "half apart is not ordered", DCP_TIMESTAMPHALF);
+    check(DCP_TIMESTAMPDIFF(0x000010u, 0xFFFFF0u) == 0x20,
+          "0x10 - 0xFFFFF0 == 0x20", 0x10);
+    check(DCP_TIMESTAMPDIFF(0xFFFFF0u, 0x000010u) == -0x20,
+          "0xFFFFF0 - 0x10 == -0x20", 0xFFFFF0);
+}
+
+/*!
+ *  \brief  Commands through NBWRAPS wraps of the timestamps.
+ */
+static void test_wraps()
+{
+    uint32_t ts, prev=0;
+    int nbwraps=0, nbcommands=0;
+
+    uavsrv_clock            = fake_clock;
+    fake_now                = 123456789;
+    uavsrv.start_time       = uavsrv_clock();
+    uavsrv.command_sessid   = SESSID;
+    uavsrv.last_ailerons    = -1;
+
+    while(nbwraps < NBWRAPS) {
+        fake_now += STEP;
+        ts = uavsrv_msec_sincestart();
+        check(ts <= DCP_TIMESTAMPMASK, "timestamp fits 24 bits", ts);
+        if(ts < prev)
+            nbwraps++;
+
+        check(send_ailerons(ts) == 0, "command accepted", ts);
+        /* Replayed from a second ago: refused */
+        check(send_ailerons(DCP_TIMESTAMP(ts - 1000)) < 0 &&
+              uavsrv_err == UAVSRV_ERR_BADTIMESTAMP, "stale command refused", ts);
+
+        prev = ts;
+        nbcommands++;
+    }
+
+    /* A new session starts from the command station's own clock */
+    uavsrv.last_ailerons = -1;
+    check(send_ailerons(DCP_TIMESTAMP(prev + DCP_TIMESTAMPHALF + 1)) == 0,
+          "first command of a session accepted", prev);
+
+    printf("%d wraps, %d commands\n", nbwraps, nbcommands);
+}
+
+int main()
+{
+    openlog("timestamps", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    test_compare();
+    test_wraps();
+
+    printf("%s\n", nbfailed ? "FAILED" : "OK");
+    return nbfailed ? 1 : 0;
+}